@@ -0,0 +1,81 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// One invocation per instance: frustum test of its bounding sphere, then LOD pick by distance. Visible instances
+// append a VkDrawIndexedIndirectCommand, the count feeds vkCmdDrawIndexedIndirectCount.
+// Layouts must match src/gpu_culling.hpp
+layout(local_size_x = 64) in;
+
+struct Instance {
+    vec4 positionScale;
+    uint mesh;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+struct MeshInfo {
+    float boundingRadius;
+    uint firstLod;
+    uint lodCount;
+    uint padding;
+};
+
+struct MeshLod {
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    float maxDistance;
+};
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Meshes { MeshInfo meshes[]; };
+layout(std430, set = 0, binding = 2) readonly buffer Lods { MeshLod lods[]; };
+layout(std430, set = 0, binding = 3) writeonly buffer Draws { DrawCommand draws[]; };
+layout(std430, set = 0, binding = 4) buffer Count { uint drawCount; };
+
+layout(push_constant) uniform Params {
+    vec4 planes[6];
+    vec4 cameraPosition;                                      // w scales distances before the LOD pick
+    uint instanceCount;
+    uint maxDraws;
+} params;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= params.instanceCount) {
+        return;
+    }
+    Instance instance = instances[index];
+    MeshInfo mesh = meshes[instance.mesh];
+    vec3 center = instance.positionScale.xyz;
+    float radius = mesh.boundingRadius * instance.positionScale.w;
+    for (int i = 0; i < 6; ++i) {
+        if (dot(params.planes[i].xyz, center) + params.planes[i].w < -radius) {
+            return;
+        }
+    }
+
+    // The last LOD catches everything further than the others reach
+    float distance = max(length(center - params.cameraPosition.xyz) - radius, 0.0) * params.cameraPosition.w;
+    uint lod = mesh.firstLod + mesh.lodCount - 1;
+    for (uint i = 0; i + 1 < mesh.lodCount; ++i) {
+        if (distance <= lods[mesh.firstLod + i].maxDistance) {
+            lod = mesh.firstLod + i;
+            break;
+        }
+    }
+
+    uint slot = atomicAdd(drawCount, 1u);
+    if (slot < params.maxDraws) {
+        draws[slot] = DrawCommand(lods[lod].indexCount, 1u, lods[lod].firstIndex, lods[lod].vertexOffset, index);
+    }
+}
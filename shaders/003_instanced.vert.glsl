@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+// Per instance, firstInstance of each indirect draw picks the instance
+layout(location = 2) in vec4 inPositionScale;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = vec4(inPosition * inPositionScale.w + inPositionScale.xyz, 1.0);
+    fragColor = inColor;
+}
@@ -1,8 +1,19 @@
 import subprocess
 import os
+import struct
 
 glsl_compiler = "glslc"
 shader_dir = os.path.dirname(os.path.realpath(__file__))
+SHADER_STAGES = ("vert", "frag", "comp")
+
+# Shader pack layout, must match src/shader_pack.hpp
+# header | hash table (table_size entries) | names | spir-v blobs, each aligned to PACK_ALIGNMENT
+PACK_FILENAME = "shaders.pack"
+PACK_MAGIC = 0x4b50534b  # "KSPK"
+PACK_VERSION = 1
+PACK_ALIGNMENT = 64
+HEADER_FORMAT = "<IIIIQQ"  # magic, version, entry count, table size, table offset, file size
+ENTRY_FORMAT = "<QIIQQ"  # name hash, name offset, name length, data offset, data size
 
 
 def compile_shader_stage(filename):
@@ -11,12 +22,18 @@ def compile_shader_stage(filename):
         return
     print("Compiling shader: {}".format(filename))
     base_filename = os.path.basename(filename)
-    is_vert = "vert" in base_filename
-    shader_type = "vert" if is_vert else "frag"
-    new_spv_filename = "{}.{}.spv".format(base_filename.split('.')[0], shader_type)
+    # The stage is the middle extension (name.comp.glsl), older files only have "vert" somewhere in the name
+    parts = base_filename.split('.')
+    if len(parts) > 2 and parts[-2] in SHADER_STAGES:
+        shader_type = parts[-2]
+    else:
+        shader_type = "vert" if "vert" in base_filename else "frag"
+    new_spv_filename = "{}.{}.spv".format(parts[0], shader_type)
     cmd = [
         glsl_compiler,
-        "-fshader-stage={}".format("vert" if is_vert else "frag"),
+        "-fshader-stage={}".format(shader_type),
+        # Shared declarations such as include/bindless.glsl, files in there are not compiled on their own
+        "-I", "include",
         filename,
         "-o",
         new_spv_filename
@@ -25,8 +42,64 @@ def compile_shader_stage(filename):
     subprocess.call(cmd)
 
 
+def name_hash(name):
+    # FNV-1a 64, 0 marks an empty slot so it is never a valid hash
+    value = 0xcbf29ce484222325
+    for byte in name.encode("utf-8"):
+        value ^= byte
+        value = (value * 0x100000001b3) & 0xffffffffffffffff
+    return value or 1
+
+
+def align(offset):
+    return (offset + PACK_ALIGNMENT - 1) & ~(PACK_ALIGNMENT - 1)
+
+
+def write_shader_pack(spv_filenames):
+    table_size = 1
+    while table_size < 2 * max(len(spv_filenames), 1):
+        table_size *= 2
+    header_size = struct.calcsize(HEADER_FORMAT)
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+
+    names = b""
+    name_offsets = {}
+    names_offset = header_size + table_size * entry_size
+    for spv_filename in spv_filenames:
+        name_offsets[spv_filename] = names_offset + len(names)
+        names += spv_filename.encode("utf-8")
+
+    table = [None] * table_size
+    blobs = b""
+    data_offset = align(names_offset + len(names))
+    for spv_filename in spv_filenames:
+        with open(spv_filename, "rb") as spv_file:
+            code = spv_file.read()
+        padding = align(data_offset + len(blobs)) - (data_offset + len(blobs))
+        blobs += b"\0" * padding
+        entry = (name_hash(spv_filename), name_offsets[spv_filename], len(spv_filename.encode("utf-8")),
+                 data_offset + len(blobs), len(code))
+        blobs += code
+        # Open addressing with linear probing
+        slot = entry[0] & (table_size - 1)
+        while table[slot] is not None:
+            slot = (slot + 1) & (table_size - 1)
+        table[slot] = entry
+
+    file_size = data_offset + len(blobs)
+    with open(PACK_FILENAME, "wb") as pack_file:
+        pack_file.write(struct.pack(HEADER_FORMAT, PACK_MAGIC, PACK_VERSION, len(spv_filenames), table_size,
+                                    header_size, file_size))
+        for entry in table:
+            pack_file.write(struct.pack(ENTRY_FORMAT, *(entry or (0, 0, 0, 0, 0))))
+        pack_file.write(names)
+        pack_file.write(b"\0" * (data_offset - names_offset - len(names)))
+        pack_file.write(blobs)
+    print("Packed {} shaders into {} ({} bytes)".format(len(spv_filenames), PACK_FILENAME, file_size))
+
+
 print("Compiling Shaders!")
 os.chdir(shader_dir)
 for i in os.listdir("."):
     compile_shader_stage(i)
-
+write_shader_pack(sorted(i for i in os.listdir(".") if i.endswith(".spv")))
@@ -0,0 +1,21 @@
+// Declarations of the app's bindless table, see src/bindless_table.hpp. #include it after
+// #extension GL_GOOGLE_include_directive : require
+// and index with slots from push constants or buffers. Slots that differ within a draw or dispatch need
+// nonuniformEXT().
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define BINDLESS_SET 0
+#define BINDLESS_BUFFER_BINDING 0
+#define BINDLESS_TEXTURE_BINDING 1
+
+// Declares a storage buffer array named `name` over the buffer slots, e.g.
+// BINDLESS_BUFFERS(Instances, instanceBuffers, { Instance instances[]; })
+// then instanceBuffers[slot].instances[i]
+#define BINDLESS_BUFFERS(block, name, members) \
+    layout(std430, set = BINDLESS_SET, binding = BINDLESS_BUFFER_BINDING) readonly buffer block members name[]
+
+layout(set = BINDLESS_SET, binding = BINDLESS_TEXTURE_BINDING) uniform sampler2D bindlessTextures[];
+
+vec4 sampleBindless(uint slot, vec2 uv) {
+    return texture(bindlessTextures[nonuniformEXT(slot)], uv);
+}
@@ -1,5 +1,7 @@
 #include "base.hpp"
 #include "log.hpp"
+#include <algorithm>
+#include <cstring>
 
 bool BaseApplication::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     uint32_t deviceExtensionCount;
@@ -19,7 +21,7 @@ VkSurfaceFormatKHR BaseApplication::chooseSwapSurfaceFormat(const std::vector<Vk
     for (const auto &availableFormat : availableFormats) {
         if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
             availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-            info("\t Choosing swap surface format {}", availableFormat.format);
+            LOG_DEBUG("\t Choosing swap surface format {}", availableFormat.format);
             return availableFormat;
         }
     }
@@ -27,24 +29,27 @@ VkSurfaceFormatKHR BaseApplication::chooseSwapSurfaceFormat(const std::vector<Vk
 }
 
 VkPresentModeKHR BaseApplication::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
-    for (const auto &availablePresentMode : availablePresentModes) {
-        // Triple Buffering
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            info("\t Choosing swap present mode {}", availablePresentMode);
-            return availablePresentMode;
+    for (auto presentMode : _presentPacer.settings().presentModes) {
+        if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) !=
+            availablePresentModes.end()) {
+            LOG_DEBUG("\t Choosing swap present mode {}", presentMode);
+            return presentMode;
         }
     }
-    info("\t Choosing swap present mode {}", VK_PRESENT_MODE_FIFO_KHR);
+    LOG_DEBUG("\t Choosing swap present mode {}", VK_PRESENT_MODE_FIFO_KHR);
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 VkExtent2D BaseApplication::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
     if (capabilities.currentExtent.width != UINT32_MAX) {
-        info("\t Choosing swap extent with width {} and height {}", capabilities.currentExtent.width,
-             capabilities.currentExtent.height);
+        LOG_DEBUG("\t Choosing swap extent with width {} and height {}", capabilities.currentExtent.width,
+                  capabilities.currentExtent.height);
         return capabilities.currentExtent;
     } else {
-        VkExtent2D actualExtent = {WIDTH, HEIGHT};
+        // The window may have been resized since it was created, and the framebuffer is in pixels, not screen units
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(_window, &width, &height);
+        VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
         actualExtent.width = std::max(
                 capabilities.minImageExtent.width,
                 std::min(capabilities.maxImageExtent.width,
@@ -53,12 +58,89 @@ VkExtent2D BaseApplication::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &cap
                 capabilities.minImageExtent.height,
                 std::min(capabilities.maxImageExtent.height,
                          actualExtent.height));
-        info("\t Choosing swap extent with width {} and height {}", actualExtent.width, actualExtent.height);
+        LOG_DEBUG("\t Choosing swap extent with width {} and height {}", actualExtent.width, actualExtent.height);
         return actualExtent;
     }
 }
 
 
+void BaseApplication::createFrameResources() {
+    _frames.resize(_framesInFlight);
+    for (auto &frame : _frames) {
+        // Transient pool, reset in one go when the slot comes round again rather than per command buffer
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = _indices.graphicsFamily.value();
+        if (vkCreateCommandPool(_device, &poolInfo, _allocationCallbacks, &frame.commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create frame command pool");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(_device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not allocate frame command buffer");
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        // Start signalled so the first wait on each slot doesn't block
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        if (vkCreateSemaphore(_device, &semaphoreInfo, _allocationCallbacks, &frame.imageAvailable) != VK_SUCCESS ||
+            vkCreateFence(_device, &fenceInfo, _allocationCallbacks, &frame.inFlight) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create frame synchronization objects");
+        }
+
+        // As many recording slices as threads that can record: the workers plus the render thread
+        size_t recorderCount = _threadPool.size() + 1;
+        frame.recorderPools.resize(recorderCount);
+        frame.secondaryBuffers.resize(recorderCount);
+        for (size_t i = 0; i < recorderCount; ++i) {
+            if (vkCreateCommandPool(_device, &poolInfo, _allocationCallbacks, &frame.recorderPools[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Error: Could not create recorder command pool");
+            }
+            VkCommandBufferAllocateInfo secondaryInfo{};
+            secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            secondaryInfo.commandPool = frame.recorderPools[i];
+            secondaryInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            secondaryInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(_device, &secondaryInfo, &frame.secondaryBuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Error: Could not allocate secondary command buffer");
+            }
+        }
+    }
+
+    if (!_headless) {
+        createRenderFinishedSemaphores();
+    }
+    _imagesInFlight.assign(_swapChainImages.size(), VK_NULL_HANDLE);
+    info("Success: Created resources for {} frames in flight", _framesInFlight);
+}
+
+void BaseApplication::createFramebuffers() {
+    _swapChainFramebuffers.resize(_swapChainImageViews.size());
+    for (size_t i = 0; i < _swapChainImageViews.size(); ++i) {
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = _renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &_swapChainImageViews[i];
+        framebufferInfo.width = _swapChainExtent.width;
+        framebufferInfo.height = _swapChainExtent.height;
+        framebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(_device, &framebufferInfo, _allocationCallbacks, &_swapChainFramebuffers[i]) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create framebuffer");
+        }
+    }
+    LOG_FRAME_INFO("Success: Created {} framebuffers", _swapChainFramebuffers.size());
+}
+
 void BaseApplication::createImageViews() {
     _swapChainImageViews.resize(_swapChainImages.size());
     size_t idx = 0;
@@ -78,10 +160,11 @@ void BaseApplication::createImageViews() {
         imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
         imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(_device, &imageViewCreateInfo, nullptr, &_swapChainImageViews[idx]) != VK_SUCCESS) {
+        if (vkCreateImageView(_device, &imageViewCreateInfo, _allocationCallbacks, &_swapChainImageViews[idx]) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Error: Could not create Image View");
         }
-        info("Success: Created ImageView!");
+        LOG_DEBUG("Success: Created ImageView!");
         ++idx;
     }
 }
@@ -89,32 +172,123 @@ void BaseApplication::createImageViews() {
 void BaseApplication::createLogicalDevice() {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    float queuePriority = 1.0f;
-
-    info("\t Graphics Index: {} | Present Index: {}", _indices.graphicsFamily.value(),
-         _indices.presentFamily.value());
-
-    // Graphics Family Queue
-    VkDeviceQueueCreateInfo gfxQueueCreateInfo{};
-    gfxQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    gfxQueueCreateInfo.queueFamilyIndex = _indices.graphicsFamily.value();
-    gfxQueueCreateInfo.queueCount = 1;
-    gfxQueueCreateInfo.pQueuePriorities = &queuePriority;
-    queueCreateInfos.push_back(gfxQueueCreateInfo);
-
-    // Present Family Queue
-    VkDeviceQueueCreateInfo presentQueueCreateInfo{};
-    gfxQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    gfxQueueCreateInfo.queueFamilyIndex = _indices.presentFamily.value();
-    gfxQueueCreateInfo.queueCount = 1;
-    gfxQueueCreateInfo.pQueuePriorities = &queuePriority;
-    queueCreateInfos.push_back(presentQueueCreateInfo);
+    std::vector<float> queuePriorities(MAX_QUEUES_PER_FAMILY, 1.0f);
+
+    if (_indices.presentFamily.has_value()) {
+        info("\t Graphics Index: {} | Present Index: {}", _indices.graphicsFamily.value(),
+             _indices.presentFamily.value());
+    } else {
+        info("\t Graphics Index: {} | No present queue (headless)", _indices.graphicsFamily.value());
+    }
+    info("\t Compute Index: {} | Transfer Index: {}", _indices.computeFamily.value(), _indices.transferFamily.value());
+
+    // Several queues per family where there are, so roles sharing a family still get a queue each and extra
+    // compute/transfer queues can be used in parallel. A family can only appear once in the create infos.
+    std::set<uint32_t> uniqueQueueFamilies = _indices.uniqueFamilies();
+    for (uint32_t queueFamily : uniqueQueueFamilies) {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamily;
+        queueCreateInfo.queueCount = std::min(_indices.queueCounts[queueFamily], MAX_QUEUES_PER_FAMILY);
+        queueCreateInfo.pQueuePriorities = queuePriorities.data();
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    // Present pacing waits on present ids where the device can, the feature structs may only be chained then
+    bool presentWaitAvailable = !_headless && isDeviceExtensionAvailable(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+                                isDeviceExtensionAvailable(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+    supportedPresentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+    supportedPresentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    supportedPresentId.pNext = &supportedPresentWait;
+
+    // Pipelines linked from prebuilt parts on first use, see PipelineLibraries
+    bool pipelineLibraryAvailable = isDeviceExtensionAvailable(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+                                    isDeviceExtensionAvailable(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedPipelineLibrary{};
+    supportedPipelineLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    supportedPipelineLibrary.pNext = presentWaitAvailable ? &supportedPresentId : nullptr;
+
+    // GPU-driven drawing is optional, enable what it needs when all of it is there
+    VkPhysicalDeviceVulkan12Features supported12Features{};
+    supported12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported12Features.pNext = pipelineLibraryAvailable ? static_cast<void *>(&supportedPipelineLibrary)
+                                                         : supportedPipelineLibrary.pNext;
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &supported12Features;
+    vkGetPhysicalDeviceFeatures2(_physicalDevice, &supportedFeatures);
+    _presentPacer._presentWaitSupported = presentWaitAvailable && supportedPresentId.presentId &&
+                                          supportedPresentWait.presentWait;
+    _gpuDrivenSupported = supported12Features.drawIndirectCount && supportedFeatures.features.multiDrawIndirect &&
+                          supportedFeatures.features.drawIndirectFirstInstance;
+    // The bindless table, same story
+    _bindlessSupported = supported12Features.descriptorIndexing && supported12Features.runtimeDescriptorArray &&
+                         supported12Features.descriptorBindingPartiallyBound &&
+                         supported12Features.descriptorBindingUpdateUnusedWhilePending &&
+                         supported12Features.descriptorBindingStorageBufferUpdateAfterBind &&
+                         supported12Features.descriptorBindingSampledImageUpdateAfterBind &&
+                         supported12Features.shaderStorageBufferArrayNonUniformIndexing &&
+                         supported12Features.shaderSampledImageArrayNonUniformIndexing;
+    // Without fast linking, linking costs about as much as a full pipeline and the libraries buy nothing
+    if (pipelineLibraryAvailable && supportedPipelineLibrary.graphicsPipelineLibrary) {
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT pipelineLibraryProperties{};
+        pipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &pipelineLibraryProperties;
+        vkGetPhysicalDeviceProperties2(_physicalDevice, &properties);
+        _pipelineLibrarySupported = pipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+    }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.multiDrawIndirect = _gpuDrivenSupported;
+    deviceFeatures.drawIndirectFirstInstance = _gpuDrivenSupported;
+    // Uploads signal a timeline semaphore that the graphics submits wait on
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    vulkan12Features.drawIndirectCount = _gpuDrivenSupported;
+    vulkan12Features.descriptorIndexing = _bindlessSupported;
+    vulkan12Features.runtimeDescriptorArray = _bindlessSupported;
+    vulkan12Features.descriptorBindingPartiallyBound = _bindlessSupported;
+    vulkan12Features.descriptorBindingUpdateUnusedWhilePending = _bindlessSupported;
+    vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = _bindlessSupported;
+    vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = _bindlessSupported;
+    vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = _bindlessSupported;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing = _bindlessSupported;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.presentWait = VK_TRUE;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    presentIdFeatures.presentId = VK_TRUE;
+    if (_presentPacer._presentWaitSupported) {
+        vulkan12Features.pNext = &presentIdFeatures;
+        _deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        _deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+    pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    pipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+    if (_pipelineLibrarySupported) {
+        pipelineLibraryFeatures.pNext = vulkan12Features.pNext;
+        vulkan12Features.pNext = &pipelineLibraryFeatures;
+        _deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        _deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    }
+    // Heap budgets the texture streamer evicts by, nothing to enable beyond the extension
+    _memoryBudgetSupported = isDeviceExtensionAvailable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (_memoryBudgetSupported) {
+        _deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
     // Creating the Logical Device
     VkDeviceCreateInfo deviceCreateInfo{};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.pNext = &vulkan12Features;
     deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
     deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
@@ -134,38 +308,161 @@ void BaseApplication::createLogicalDevice() {
         deviceCreateInfo.enabledLayerCount = 0;
     }
 
-    if (vkCreateDevice(_physicalDevice, &deviceCreateInfo, nullptr, &_device) != VK_SUCCESS) {
+    if (vkCreateDevice(_physicalDevice, &deviceCreateInfo, _allocationCallbacks, &_device) != VK_SUCCESS) {
         throw std::runtime_error("ERROR: failed to create logical device");
     }
-    info("Success: Created the Logical Device");
-    // FIXME: Is the graphics and present queue the same? This is ok but sometimes this will be different
-    vkGetDeviceQueue(_device, _indices.graphicsFamily.value(), 0, &_graphicsQueue);
-    vkGetDeviceQueue(_device, _indices.presentFamily.value(), 0, &_presentQueue);
-    info("Success: Got the graphics/present queue");
+    info("Success: Created the Logical Device ({} GPU-driven drawing, {} bindless descriptors, {} pipeline libraries)",
+         _gpuDrivenSupported ? "with" : "without", _bindlessSupported ? "with" : "without",
+         _pipelineLibrarySupported ? "with" : "without");
+    _queues.assign(_indices.queueCounts.size(), {});
+    for (const auto &queueCreateInfo : queueCreateInfos) {
+        auto &familyQueues = _queues[queueCreateInfo.queueFamilyIndex];
+        familyQueues.resize(queueCreateInfo.queueCount);
+        for (uint32_t i = 0; i < queueCreateInfo.queueCount; ++i) {
+            vkGetDeviceQueue(_device, queueCreateInfo.queueFamilyIndex, i, &familyQueues[i]);
+        }
+        info("\t Created {} queues in family {}", queueCreateInfo.queueCount, queueCreateInfo.queueFamilyIndex);
+    }
+
+    // Roles sharing a family take the next queue in it, and share one once the family runs out.
+    // Presenting from the graphics queue when it can saves a queue switch at the end of the frame.
+    std::vector<uint32_t> nextQueue(_queues.size(), 0);
+    auto takeQueue = [&](uint32_t family) {
+        const auto &familyQueues = _queues[family];
+        return familyQueues[nextQueue[family]++ % familyQueues.size()];
+    };
+    _graphicsQueue = takeQueue(_indices.graphicsFamily.value());
+    if (_indices.presentFamily.has_value()) {
+        _presentQueue = _indices.presentFamily == _indices.graphicsFamily ? _graphicsQueue
+                                                                          : takeQueue(_indices.presentFamily.value());
+    }
+    _computeQueue = takeQueue(_indices.computeFamily.value());
+    _transferQueue = takeQueue(_indices.transferFamily.value());
+    info("Success: Got the graphics/present/compute/transfer queues (compute {}, transfer {})",
+         _computeQueue == _graphicsQueue ? "shares graphics" : "separate",
+         _transferQueue == _graphicsQueue ? "shares graphics" : "separate");
+}
+
+void BaseApplication::createOffscreenTargets() {
+    _swapChainImageFormat = OFFSCREEN_FORMAT;
+    _swapChainExtent = {WIDTH, HEIGHT};
+    // At least one image per frame in flight, otherwise the frames would queue up behind each other's image
+    uint32_t imageCount = std::max(OFFSCREEN_IMAGE_COUNT, _framesInFlight);
+    _swapChainImages.resize(imageCount);
+    _offscreenImageAllocations.resize(imageCount);
+
+    for (uint32_t i = 0; i < imageCount; ++i) {
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = _swapChainImageFormat;
+        imageCreateInfo.extent = {_swapChainExtent.width, _swapChainExtent.height, 1};
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // Render to it like a swap chain image, and allow copying out of it since nothing presents it
+        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        _swapChainImages[i] = _allocator.createImage(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                     _offscreenImageAllocations[i]);
+    }
+    info("Success: Created {} offscreen render targets with width {} and height {}", imageCount,
+         _swapChainExtent.width, _swapChainExtent.height);
+}
+
+
+void BaseApplication::createRenderFinishedSemaphores() {
+    // The present waits on these, and we can't tell when a present is done with a semaphore, so they are tied to
+    // the image (which can't be reacquired until its present finished) instead of the frame slot
+    _renderFinishedSemaphores.resize(_swapChainImages.size());
+    for (auto &semaphore : _renderFinishedSemaphores) {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (vkCreateSemaphore(_device, &semaphoreInfo, _allocationCallbacks, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create render finished semaphore");
+        }
+    }
+}
+
+void BaseApplication::createRenderGraph() {
+    _renderGraph.reset();
+    buildRenderGraph(_renderGraph);
+    _renderGraph.compile();
 }
 
+void BaseApplication::createRenderPass() {
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = _swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Offscreen images are never presented, leave them ready to be copied out instead
+    colorAttachment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    // Don't write the attachment until the acquire semaphore (waited at this stage) says the image is ours
+    VkSubpassDependency dependencies[2]{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // The implicit dependency out of the render pass only reaches bottom of pipe. Frame capture copies the image
+    // right after, so the writes and the final layout transition have to reach its transfer reads.
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = _frameCapture.isEnabled() ? 2 : 1;
+    renderPassInfo.pDependencies = dependencies;
+
+    if (vkCreateRenderPass(_device, &renderPassInfo, _allocationCallbacks, &_renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create render pass");
+    }
+    _pipelineStates.addRenderPass(_renderPass, renderPassInfo);
+    info("Success: Created the render pass");
+}
 
 void BaseApplication::createSurface() {
-    if (glfwCreateWindowSurface(_instance, _window, nullptr, &_surface) != VK_SUCCESS) {
+    if (glfwCreateWindowSurface(_instance, _window, _allocationCallbacks, &_surface) != VK_SUCCESS) {
         throw std::runtime_error("ERROR: Could not create a window surface");
     }
     info("Success: Created the surface");
 }
 
 void BaseApplication::createSwapChain() {
-    // Check device first
-    if (_device != VK_NULL_HANDLE) {
-        vkDeviceWaitIdle(_device);
-    }
-
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(_physicalDevice);
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    // How many images in the swap chain?
-    // + 1 means not waiting on driver to complete internal operations before getting another image to render to
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    // How many images in the swap chain? Extra images mean not waiting on the driver to complete internal
+    // operations before getting another image to render to, at the cost of frames queued for longer
+    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + _presentPacer.settings().extraImages;
 
     // Don't allow the imageCount to be greater than the max Image Count capability
     if (swapChainSupport.capabilities.maxImageCount > 0 &&
@@ -184,6 +481,15 @@ void BaseApplication::createSwapChain() {
     swapChainCreateInfo.imageExtent = extent;
     swapChainCreateInfo.imageArrayLayers = 1; // Unless stereoscopic 3d stuff this will be 1
     swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // What kind of operations we'll use the images in swap chain for
+    // Frame capture copies out of the images
+    if (_frameCapture.isEnabled()) {
+        if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+            swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        } else {
+            warn("Swap chain images can't be copied from on this surface, frame capture is off");
+            _frameCapture._path.clear();
+        }
+    }
 
     uint32_t queueFamilyIndices[] = {_indices.graphicsFamily.value(), _indices.presentFamily.value()};
     if (_indices.graphicsFamily.value() != _indices.presentFamily.value()) {
@@ -204,63 +510,316 @@ void BaseApplication::createSwapChain() {
     swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
     swapChainCreateInfo.presentMode = presentMode;
-    // Only set this to false if you want to read pixels back and get predictable results
-    swapChainCreateInfo.clipped = VK_TRUE;
+    // Captured frames need every pixel, also where another window covers ours
+    swapChainCreateInfo.clipped = _frameCapture.isEnabled() ? VK_FALSE : VK_TRUE;
+    // Lets the driver hand resources over from the old swap chain, which stays valid for presents already queued
+    swapChainCreateInfo.oldSwapchain = _swapChain;
 
-    if (vkCreateSwapchainKHR(_device, &swapChainCreateInfo, nullptr, &_swapChain) != VK_SUCCESS) {
+    if (vkCreateSwapchainKHR(_device, &swapChainCreateInfo, _allocationCallbacks, &_swapChain) != VK_SUCCESS) {
         throw std::runtime_error("Error: Could not create swap chain");
     }
-    info("Success: Created the swap chain");
+    LOG_FRAME_INFO("Success: Created the swap chain");
 
     // Retrieve the swap chain images
     vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, nullptr);
     _swapChainImages.resize(imageCount);
     vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, _swapChainImages.data());
-    info("Success: Retrieved the swapChainImages");
+    LOG_FRAME_INFO("Success: Retrieved the swapChainImages");
 
     _swapChainImageFormat = surfaceFormat.format;
     _swapChainExtent = extent;
 }
 
+void BaseApplication::destroyRetiredSwapChains(bool all) {
+    // Retired in frame order. Once the fence of a frame after the last one to use a swap chain has signalled, so have
+    // the graphics submits that rendered into its images. When presents go to the graphics queue as well, the ones of
+    // those images were submitted before that frame and have started too.
+    size_t ready = 0;
+    while (ready < _retiredSwapChains.size() &&
+           (all || _retiredSwapChains[ready].lastFrame + _framesInFlight <= _frameNumber)) {
+        ++ready;
+    }
+    if (ready == 0) {
+        return;
+    }
+    // A separate present queue isn't ordered against the fence, its presents may still be waiting on the retired
+    // semaphores. Only ever happens right after a resize, so waiting for it to drain is cheap enough.
+    if (_presentQueue != VK_NULL_HANDLE && _presentQueue != _graphicsQueue) {
+        vkQueueWaitIdle(_presentQueue);
+    }
+    for (size_t i = 0; i < ready; ++i) {
+        RetiredSwapChain &retired = _retiredSwapChains[i];
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(_device, framebuffer, _allocationCallbacks);
+        }
+        for (auto imageView : retired.imageViews) {
+            vkDestroyImageView(_device, imageView, _allocationCallbacks);
+        }
+        for (auto semaphore : retired.renderFinishedSemaphores) {
+            vkDestroySemaphore(_device, semaphore, _allocationCallbacks);
+        }
+        vkDestroySwapchainKHR(_device, retired.swapChain, _allocationCallbacks);
+    }
+    _retiredSwapChains.erase(_retiredSwapChains.begin(),
+                             _retiredSwapChains.begin() + static_cast<std::ptrdiff_t>(ready));
+}
+
+void BaseApplication::drawFrame() {
+    // A minimized window has nothing to present to
+    if (!_headless) {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(_window, &width, &height);
+        if (width == 0 || height == 0) {
+            return;
+        }
+    }
+    _frameTimer.beginFrame();
+    CpuScope frameScope(_profiler, "drawFrame");
+    FrameData &frame = _frames[_currentFrame];
+
+    // Only waits for the submit made _framesInFlight frames ago, not the one we just made
+    {
+        CpuScope waitScope(_profiler, "wait for frame slot");
+        vkWaitForFences(_device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+    }
+    destroyRetiredSwapChains(false);
+
+    uint32_t imageIndex;
+    if (_headless) {
+        imageIndex = static_cast<uint32_t>(_frameNumber % _swapChainImages.size());
+    } else {
+        VkResult result = vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, frame.imageAvailable,
+                                                VK_NULL_HANDLE, &imageIndex);
+        // Nothing was signalled or submitted, the slot's fence is untouched, so the frame can just be skipped.
+        // Suboptimal images still present fine, the swap chain is replaced after this frame's present.
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreateSwapChain();
+            return;
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("Error: Failed to acquire swap chain image");
+        }
+    }
+
+    // Only now that the frame will be submitted: a skipped frame comes back to the same slot, and these must run once
+    // per submit
+    _deletionQueue.beginFrame(_currentFrame);
+    // Before anything is recorded with the pipelines it swaps
+    _pipelineStates.beginFrame();
+    // So the slot's timestamps from last time are ready to read
+    _profiler.beginFrame(_currentFrame);
+    if (_bindless.isReady()) {
+        _bindless.beginFrame(_frameNumber);
+    }
+    if (_textureStreamer.isReady()) {
+        _textureStreamer.beginFrame(_currentFrame, _frameNumber);
+    }
+    if (_frameCapture.isReady()) {
+        _frameCapture.beginFrame(_currentFrame);
+    }
+
+    // The image may still be in use by another slot if images come back out of order
+    if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+        vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    }
+    _imagesInFlight[imageIndex] = frame.inFlight;
+
+    vkResetFences(_device, 1, &frame.inFlight);
+    vkResetCommandPool(_device, frame.commandPool, 0);
+    // Uploads queued since the last frame start copying now, while this frame is recorded
+    _uploadQueue.flush();
+    recordCommandBuffer(frame.commandBuffer, imageIndex);
+
+    // Binary semaphores ignore their entry in the timeline values
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    std::vector<uint64_t> waitValues;
+    if (!_headless) {
+        waitSemaphores.push_back(frame.imageAvailable);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        waitValues.push_back(0);
+    }
+    VkPipelineStageFlags uploadStages;
+    uint64_t uploadValue = _uploadQueue.takeGraphicsWait(uploadStages);
+    if (uploadValue != 0) {
+        waitSemaphores.push_back(_uploadQueue._timeline);
+        waitStages.push_back(uploadStages);
+        waitValues.push_back(uploadValue);
+    }
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame.commandBuffer;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    if (!_headless) {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &_renderFinishedSemaphores[imageIndex];
+    }
+    if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to submit draw command buffer");
+    }
+    _profiler.markSubmit();
+
+    if (!_headless) {
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &_renderFinishedSemaphores[imageIndex];
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &_swapChain;
+        presentInfo.pImageIndices = &imageIndex;
+        VkPresentIdKHR presentId{};
+        _presentPacer.preparePresent(presentInfo, presentId);
+        VkResult result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized) {
+            recreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Error: Failed to present swap chain image");
+        }
+    }
+
+    _currentFrame = (_currentFrame + 1) % _framesInFlight;
+    ++_frameNumber;
+}
+
 void BaseApplication::findQueueFamilies(VkPhysicalDevice device) {
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-    int i = 0;
+    // Called once per candidate device, don't keep indices from the previous one
+    _indices = QueueFamilyIndices{};
+    uint32_t i = 0;
     VkBool32 presentSupport = false;
     for (const auto &queueFamily : queueFamilies) {
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
-        if (presentSupport) {
-            info("Success: Found presentFamily queue indices");
-            _indices.presentFamily = i;
-        }
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        _indices.queueCounts.push_back(queueFamily.queueCount);
+        bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+        if (graphics && !_indices.graphicsFamily.has_value()) {
             info("Success: Found graphicsFamily queue indices");
             _indices.graphicsFamily = i;
-            // Once we find the device with present and graphics lets get out?
-            break;
+        }
+        // Prefer presenting from the graphics family, otherwise take the first family that can
+        if (!_headless && (!_indices.presentFamily.has_value() || (_indices.graphicsFamily == i &&
+                                                                  _indices.presentFamily != i))) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+            if (presentSupport) {
+                info("Success: Found presentFamily queue indices");
+                _indices.presentFamily = i;
+            }
+        }
+        // Compute without graphics is the async compute engine
+        if (compute && !graphics && !_indices.computeFamily.has_value()) {
+            info("Success: Found async computeFamily queue indices");
+            _indices.computeFamily = i;
+        }
+        // A transfer-only family is usually the copy engine, which runs next to the graphics queue
+        if (transfer && !graphics && !compute && !_indices.transferFamily.has_value()) {
+            info("Success: Found dedicated transferFamily queue indices");
+            _indices.transferFamily = i;
         }
         i++;
     }
+    // Graphics queues can always compute and copy
+    if (!_indices.computeFamily.has_value()) {
+        _indices.computeFamily = _indices.graphicsFamily;
+    }
+    if (!_indices.transferFamily.has_value()) {
+        _indices.transferFamily = _indices.graphicsFamily;
+    }
+}
+
+
+void BaseApplication::framebufferResizeCallback(GLFWwindow *window, int width, int height) {
+    static_cast<BaseApplication *>(glfwGetWindowUserPointer(window))->_framebufferResized = true;
 }
 
 void BaseApplication::initWindow() {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
     _window = glfwCreateWindow(WIDTH, HEIGHT, "FIXME", nullptr, nullptr);
+    glfwSetWindowUserPointer(_window, this);
+    glfwSetFramebufferSizeCallback(_window, framebufferResizeCallback);
+    glfwSetWindowRefreshCallback(_window, windowRefreshCallback);
 }
 
 void BaseApplication::initVulkan() {
-    getRequiredExtensions();
-    createInstance();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createGraphicsPipelines();
+    _allocationCallbacks = _hostAllocator.callbacks();
+    if (_framesInFlight == 0) {
+        _framesInFlight = _presentPacer.settings().framesInFlight;
+    }
+    // Each phase is a profiler scope, so startup cost shows up in the stats and the trace
+    {
+        CpuScope scope(_profiler, "init: instance");
+        getRequiredExtensions();
+        createInstance();
+    }
+    if (_headless) {
+        // Nothing to present to, so the swapchain extension is not needed (and lavapipe-only nodes may lack it)
+        _deviceExtensions.erase(std::remove_if(_deviceExtensions.begin(), _deviceExtensions.end(),
+                                               [](const char *extension) {
+                                                   return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+                                               }), _deviceExtensions.end());
+    } else {
+        createSurface();
+    }
+    {
+        CpuScope scope(_profiler, "init: device");
+        pickPhysicalDevice();
+        createLogicalDevice();
+    }
+    _presentPacer.init();
+    _allocator.init();
+    _uploadQueue.init();
+    _profiler.init();
+    _deletionQueue.init();
+    if (_bindlessSupported) {
+        _bindless.init();
+    }
+    _pipelineCache.load(_pipelineCachePath);
+    {
+        CpuScope scope(_profiler, "init: render targets");
+        if (_headless) {
+            createOffscreenTargets();
+        } else {
+            createSwapChain();
+        }
+        createImageViews();
+        createRenderPass();
+        createFramebuffers();
+    }
+    if (_frameCapture.isEnabled()) {
+        _frameCapture.init();
+    }
+    if (!_shaderPack.open(_shaderPackPath)) {
+        info("\t No shader pack at {}, loading shaders from individual files", _shaderPackPath);
+    }
+    {
+        CpuScope scope(_profiler, "init: pipelines");
+        createGraphicsPipelines();
+    }
+    createRenderGraph();
+    loadMeshes();
+    createFrameResources();
+}
+
+bool BaseApplication::isDeviceExtensionAvailable(const char *extension) {
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    return std::any_of(availableExtensions.begin(), availableExtensions.end(), [extension](const auto &available) {
+        return strcmp(available.extensionName, extension) == 0;
+    });
 }
 
 bool BaseApplication::isDeviceSuitable(VkPhysicalDevice device) {
@@ -269,25 +828,84 @@ bool BaseApplication::isDeviceSuitable(VkPhysicalDevice device) {
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
     findQueueFamilies(device);
+    // Timeline semaphores are core in 1.2, but the driver still has to support them
+    bool timelineSemaphoreSupported = false;
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        timelineSemaphoreSupported = vulkan12Features.timelineSemaphore == VK_TRUE;
+    }
     // See if it supports all the deviceExtensions we want
     bool deviceExtensionsSupported = checkDeviceExtensionSupport(device);
 
-    // Check that the swapchain is ok
-    bool swapChainAdequate = false;
-    if (deviceExtensionsSupported) {
+    // Check that the swapchain is ok (headless renders offscreen, so there is nothing to check)
+    bool swapChainAdequate = _headless;
+    if (deviceExtensionsSupported && !_headless) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         info("Success: Swapchain support is adequate");
     }
-    return (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
-            deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) && _indices.isComplete() &&
-           deviceExtensionsSupported && swapChainAdequate;
+    return rateDeviceType(deviceProperties.deviceType) > 0 && _indices.isComplete(!_headless) &&
+           deviceExtensionsSupported && swapChainAdequate && timelineSemaphoreSupported;
+}
+
+void BaseApplication::mainLoop() {
+    // There is no window to close when headless, so always stop after a fixed number of frames
+    uint64_t frameLimit = _frameLimit;
+    if (_headless && frameLimit == 0) {
+        frameLimit = HEADLESS_DEFAULT_FRAMES;
+    }
+    uint64_t firstFrame = _frameNumber;
+    _hostAllocator.markFrameLoop();
+    while (_headless || !glfwWindowShouldClose(_window)) {
+        // Waiting here rather than in drawFrame keeps the wait before the input sample, not between it and the frame
+        if (!_headless) {
+            _presentPacer.pace();
+            glfwPollEvents();
+            // Sleep while minimized instead of spinning on frames that are never drawn
+            int width = 0, height = 0;
+            glfwGetFramebufferSize(_window, &width, &height);
+            if (width == 0 || height == 0) {
+                glfwWaitEvents();
+                continue;
+            }
+        }
+        runFrame();
+        if (frameLimit != 0 && _frameNumber >= frameLimit) {
+            break;
+        }
+    }
+    vkDeviceWaitIdle(_device);
+    _frameTimer.report("Frame time (total)");
+    _recordTimer.report("Command recording (total)");
+    if (!_headless) {
+        _presentPacer.report();
+    }
+    _profiler.report();
+    _pipelineStates.report();
+    if (_textureStreamer.isReady()) {
+        _textureStreamer.report();
+    }
+    if (_hostAllocator._enabled) {
+        _hostAllocator.report(_frameNumber - firstFrame);
+    }
 }
 
-void BaseApplication::mainLoop() const {
-    while (!glfwWindowShouldClose(_window)) {
-        glfwPollEvents();
+void BaseApplication::runFrame() {
+    _presentPacer.markInput();
+    drawFrame();
+    // Leaves first-frame costs (pipeline warmup, initial uploads) out of the stats. Refresh callback frames count too,
+    // so the warmup can be passed between two checks of the loop.
+    if (_warmupFrames != 0 && !_warmedUp && _frameNumber >= _warmupFrames) {
+        _frameTimer.reset();
+        _recordTimer.reset();
+        _warmedUp = true;
     }
+    _frameTimer.reportPeriodically();
 }
 
 void BaseApplication::pickPhysicalDevice() {
@@ -300,20 +918,28 @@ void BaseApplication::pickPhysicalDevice() {
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.data());
 
-    // Check devices
+    // Check devices, preferring real GPUs over software (CPU) implementations like lavapipe
+    int bestRating = 0;
     for (const auto &device: devices) {
-        if (isDeviceSuitable(device)) {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        int rating = rateDeviceType(deviceProperties.deviceType);
+        if (rating > bestRating && isDeviceSuitable(device)) {
             _physicalDevice = device;
-            info("Success: Found suitable device");
-            break;
+            bestRating = rating;
+            info("Success: Found suitable device {}", deviceProperties.deviceName);
         }
     }
 
     if (_physicalDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("Error: Failed to find a suitable GPU.");
     }
+    // isDeviceSuitable() filled the indices for whichever device it looked at last
+    findQueueFamilies(_physicalDevice);
+    vkGetPhysicalDeviceProperties(_physicalDevice, &_deviceProperties);
 }
 
+
 SwapChainSupportDetails BaseApplication::querySwapChainSupport(VkPhysicalDevice device) {
     SwapChainSupportDetails details;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
@@ -332,22 +958,268 @@ SwapChainSupportDetails BaseApplication::querySwapChainSupport(VkPhysicalDevice
     return details;
 }
 
+int BaseApplication::rateDeviceType(VkPhysicalDeviceType deviceType) {
+    switch (deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void BaseApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    auto start = std::chrono::steady_clock::now();
+    CpuScope recordScope(_profiler, "record commands");
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to begin recording command buffer");
+    }
+    _profiler.resetQueries(commandBuffer);
+    uint32_t frameScope = _profiler.beginGpuScope(commandBuffer, "frame");
+    // Takes ownership of buffers uploaded on the transfer family, before anything reads them
+    _uploadQueue.recordAcquireBarriers(commandBuffer);
+    // Streamed texture levels, ready for anything sampling them later in the frame
+    if (_textureStreamer.isReady()) {
+        _textureStreamer.record(commandBuffer);
+    }
+    // Compute can't run inside a render pass, so the culling pass goes first
+    if (_gpuCulling.isReady()) {
+        _gpuCulling.recordCulling(commandBuffer, _currentFrame);
+    }
+    if (!_renderGraph.empty()) {
+        _renderGraph.execute(commandBuffer);
+    }
+
+    // A subpass is either all inline or all secondary command buffers, so small draw lists stay inline
+    FrameData &frame = _frames[_currentFrame];
+    uint32_t drawTotal = drawCount();
+    uint32_t sliceCount = std::min(static_cast<uint32_t>(frame.secondaryBuffers.size()),
+                                   (drawTotal + MIN_DRAWS_PER_RECORDER - 1) / MIN_DRAWS_PER_RECORDER);
+    bool parallel = sliceCount > 1;
+
+    VkClearValue clearColor{};
+    clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = _renderPass;
+    renderPassInfo.framebuffer = _swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = _swapChainExtent;
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+    uint32_t renderPassScope = _profiler.beginGpuScope(commandBuffer, "main render pass");
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+    if (parallel) {
+        recordSecondaryCommandBuffers(frame, imageIndex, drawTotal, sliceCount);
+        vkCmdExecuteCommands(commandBuffer, sliceCount, frame.secondaryBuffers.data());
+    } else {
+        setViewportAndScissor(commandBuffer);
+        recordDrawCommands(commandBuffer);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+    _profiler.endGpuScope(commandBuffer, renderPassScope);
+    if (_frameCapture.isReady()) {
+        _frameCapture.record(commandBuffer, _swapChainImages[imageIndex],
+                             _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                             _swapChainExtent, _swapChainImageFormat, _currentFrame, _frameNumber);
+    }
+    _profiler.endGpuScope(commandBuffer, frameScope);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to record command buffer");
+    }
+    _recordTimer.addSample(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void BaseApplication::recordSecondaryCommandBuffers(FrameData &frame, uint32_t imageIndex, uint32_t drawTotal,
+                                                    uint32_t sliceCount) {
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = _renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = _swapChainFramebuffers[imageIndex];
+
+    // Each slice owns its pool, so no two threads ever touch the same pool. Resetting the whole pool gives the
+    // command buffer's memory back in one go instead of buffer by buffer.
+    _threadPool.parallelFor(sliceCount, [&](size_t slice) {
+        CpuScope sliceScope(_profiler, "record draw slice");
+        vkResetCommandPool(_device, frame.recorderPools[slice], 0);
+        VkCommandBuffer commandBuffer = frame.secondaryBuffers[slice];
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                          VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Failed to begin recording secondary command buffer");
+        }
+        // Dynamic state isn't inherited from the primary
+        setViewportAndScissor(commandBuffer);
+        auto first = static_cast<uint32_t>(uint64_t(drawTotal) * slice / sliceCount);
+        auto last = static_cast<uint32_t>(uint64_t(drawTotal) * (slice + 1) / sliceCount);
+        {
+            GpuScope drawScope(_profiler, commandBuffer, "draw slice");
+            recordDraws(commandBuffer, first, last);
+        }
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Failed to record secondary command buffer");
+        }
+    });
+}
+
+void BaseApplication::recreateSwapChain() {
+    // Minimized: there is no valid extent to create one with, try again once the window is back
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(_window, &width, &height);
+    if (width == 0 || height == 0) {
+        _framebufferResized = true;
+        return;
+    }
+    CpuScope scope(_profiler, "recreate swap chain");
+    _framebufferResized = false;
+
+    // Frames in flight still render into and present the old images, so everything tied to them is retired rather
+    // than destroyed. The frame being drawn now is the last one that may use them.
+    RetiredSwapChain retired;
+    retired.swapChain = _swapChain;
+    retired.imageViews.swap(_swapChainImageViews);
+    retired.framebuffers.swap(_swapChainFramebuffers);
+    retired.renderFinishedSemaphores.swap(_renderFinishedSemaphores);
+    retired.lastFrame = _frameNumber;
+    _retiredSwapChains.push_back(std::move(retired));
+    _presentPacer.swapChainRecreated();
+
+    VkFormat oldFormat = _swapChainImageFormat;
+    createSwapChain();
+    if (_swapChainImageFormat != oldFormat) {
+        // The render pass and every pipeline depend on the format. Frames in flight still use the old ones.
+        warn("Swap chain format changed, rebuilding the render pass and pipelines");
+        _pipelineStates.clear();
+        _pipelines.clear();
+        _pipelineStates.removeRenderPass(_renderPass);
+        _deletionQueue.retire(UniqueRenderPass(_device, _renderPass, _allocationCallbacks));
+        createRenderPass();
+        createGraphicsPipelines();
+    }
+    createImageViews();
+    createFramebuffers();
+    createRenderFinishedSemaphores();
+    createRenderGraph();
+    _imagesInFlight.assign(_swapChainImages.size(), VK_NULL_HANDLE);
+    // Once per frame while a window is dragged
+    LOG_FRAME_INFO("Success: Recreated the swap chain at {}x{}, {} old ones waiting for their frames",
+                   _swapChainExtent.width, _swapChainExtent.height, _retiredSwapChains.size());
+}
+
+void BaseApplication::setViewportAndScissor(VkCommandBuffer commandBuffer) {
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) _swapChainExtent.width;
+    viewport.height = (float) _swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = _swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void BaseApplication::windowRefreshCallback(GLFWwindow *window) {
+    auto app = static_cast<BaseApplication *>(glfwGetWindowUserPointer(window));
+    if (app->_swapChain != VK_NULL_HANDLE && !app->_frames.empty()) {
+        // Paced like the loop's frames, or this one would present past the policy's limit and sample no input
+        app->_presentPacer.pace();
+        app->runFrame();
+    }
+}
 
 BaseApplication::~BaseApplication() {
     info("Clean up: BaseApplication");
-    // Call the structure on all elements
-    for (BasePipeline pipeline : _pipelines) {
-        pipeline.cleanup();
+    // Frames may still be in flight if we got here through an exception
+    if (_device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(_device);
+    }
+    for (auto &frame : _frames) {
+        vkDestroySemaphore(_device, frame.imageAvailable, _allocationCallbacks);
+        vkDestroyFence(_device, frame.inFlight, _allocationCallbacks);
+        vkDestroyCommandPool(_device, frame.commandPool, _allocationCallbacks);
+        for (auto recorderPool : frame.recorderPools) {
+            vkDestroyCommandPool(_device, recorderPool, _allocationCallbacks);
+        }
+    }
+    for (auto semaphore : _renderFinishedSemaphores) {
+        vkDestroySemaphore(_device, semaphore, _allocationCallbacks);
+    }
+    destroyRetiredSwapChains(true);
+    if (_textureStreamer.isReady()) {
+        _textureStreamer.cleanup();
+    }
+    if (_frameCapture.isReady()) {
+        _frameCapture.cleanup();
+    }
+    _renderGraph.cleanup();
+    _deletionQueue.cleanup();
+    _pipelineStates.cleanup();
+    _gpuCulling.cleanup();
+    if (_bindless.isReady()) {
+        _bindless.cleanup();
+    }
+    for (auto &mesh : _meshes) {
+        mesh.destroy(*this);
     }
+    // Saved at shutdown so everything compiled this run is there next launch
+    _pipelineCache.save();
+    _pipelineCache.cleanup();
+    for (auto framebuffer : _swapChainFramebuffers) {
+        vkDestroyFramebuffer(_device, framebuffer, _allocationCallbacks);
+    }
+    vkDestroyRenderPass(_device, _renderPass, _allocationCallbacks);
     for (auto imageView : _swapChainImageViews) {
-        vkDestroyImageView(_device, imageView, nullptr);
-    }
-    vkDestroySwapchainKHR(_device, _swapChain, nullptr);
-    vkDestroyDevice(_device, nullptr);
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
-    vkDestroyInstance(_instance, nullptr);
-    glfwDestroyWindow(_window);
-    glfwTerminate();
+        vkDestroyImageView(_device, imageView, _allocationCallbacks);
+    }
+    if (_headless) {
+        for (size_t i = 0; i < _offscreenImageAllocations.size(); ++i) {
+            _allocator.destroyImage(_swapChainImages[i], _offscreenImageAllocations[i]);
+        }
+    } else {
+        vkDestroySwapchainKHR(_device, _swapChain, _allocationCallbacks);
+    }
+    _profiler.cleanup();
+    if (_uploadQueue._timeline != VK_NULL_HANDLE) {
+        _uploadQueue.cleanup();
+    }
+    _allocator.cleanup();
+    vkDestroyDevice(_device, _allocationCallbacks);
+    if (!_headless) {
+        vkDestroySurfaceKHR(_instance, _surface, _allocationCallbacks);
+    }
+    vkDestroyInstance(_instance, _allocationCallbacks);
+    if (_hostAllocator._enabled) {
+        uint64_t leaked = 0;
+        for (size_t scope = 0; scope < HostAllocator::SCOPE_COUNT; ++scope) {
+            leaked += _hostAllocator.stats(static_cast<VkSystemAllocationScope>(scope)).liveBytes;
+        }
+        if (leaked != 0) {
+            warn("{} bytes of host allocations still live after destroying the instance", leaked);
+        }
+    }
+    if (!_headless) {
+        glfwDestroyWindow(_window);
+        glfwTerminate();
+    }
 }
 
 
@@ -9,15 +9,49 @@
 #include <string>
 #include <optional>
 #include <set>
+#include "bindless_table.hpp"
+#include "deletion_queue.hpp"
+#include "device_allocator.hpp"
+#include "frame.hpp"
+#include "frame_capture.hpp"
+#include "gpu_culling.hpp"
+#include "host_allocator.hpp"
+#include "mesh.hpp"
 #include "pipeline.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_state_cache.hpp"
+#include "present_pacer.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "shader_pack.hpp"
+#include "texture_streamer.hpp"
+#include "thread_pool.hpp"
+#include "upload_queue.hpp"
 
 
+// Compute and transfer always end up set: on their own family when the device has one (so the work runs alongside
+// graphics on separate hardware queues), on the graphics family otherwise
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> computeFamily;                    // Compute without graphics (async compute) if any
+    std::optional<uint32_t> transferFamily;                   // Transfer-only family if there is one
+    std::vector<uint32_t> queueCounts;                        // Queues each family of the device offers
 
-    [[nodiscard]] bool isComplete() const {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+    // Headless runs have no surface, so there is no present family to find
+    [[nodiscard]] bool isComplete(bool requirePresent = true) const {
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !requirePresent);
+    }
+
+    // Every family the device gets queues from
+    [[nodiscard]] std::set<uint32_t> uniqueFamilies() const {
+        std::set<uint32_t> families;
+        for (const auto &family : {graphicsFamily, presentFamily, computeFamily, transferFamily}) {
+            if (family.has_value()) {
+                families.insert(family.value());
+            }
+        }
+        return families;
     }
 };
 
@@ -27,6 +61,15 @@ struct SwapChainSupportDetails {
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+// What a swap chain replaced by a resize leaves behind, destroyed once no frame in flight can use it
+struct RetiredSwapChain {
+    VkSwapchainKHR swapChain{};
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    uint64_t lastFrame = 0;                                   // Last frame number that may have used it
+};
+
 
 class BaseApplication {
 public:
@@ -35,23 +78,73 @@ public:
     //////////////////////////////////////////////////////////
     const uint32_t WIDTH = 800;
     const uint32_t HEIGHT = 600;
+    const uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+    const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    const uint64_t HEADLESS_DEFAULT_FRAMES = 1000;
+    const uint32_t MAX_QUEUES_PER_FAMILY = 4;
+    const uint32_t MIN_DRAWS_PER_RECORDER = 512;              // Smaller slices cost more to stitch than they save
+    bool _headless = false;                                   // No window/surface, render into offscreen images
+    uint32_t _framesInFlight = 0;                             // CPU frames ahead of the GPU, 0: the policy's
+    uint64_t _frameLimit = 0;                                 // Stop after this many frames, 0 runs until the window closes
+    uint64_t _warmupFrames = 0;                               // Frames left out of the frame time stats
+    bool _gpuDrivenSupported = false;                         // Indirect count draws with firstInstance, see GpuCulling
+    bool _bindlessSupported = false;                          // Descriptor indexing features BindlessTable needs
+    bool _memoryBudgetSupported = false;                      // VK_EXT_memory_budget, see TextureStreamer
+    bool _pipelineLibrarySupported = false;                   // Graphics pipeline libraries with fast linking, see
+                                                              // PipelineLibraries
+    std::string _pipelineCachePath = "pipeline_cache.bin";
+    std::string _shaderPackPath = "shaders/shaders.pack";
+    HostAllocator _hostAllocator;                             // Set its _enabled before run(), outlives all objects
+    const VkAllocationCallbacks *_allocationCallbacks = nullptr; // Passed to every vkCreate/vkDestroy
     GLFWwindow *_window{};
     QueueFamilyIndices _indices;
-    std::vector<BasePipeline> _pipelines;
+    std::vector<const BasePipeline *> _pipelines;             // The app's own, owned by _pipelineStates
+    std::vector<Mesh> _meshes;                                // Destroyed with the app
     std::vector<const char *> _validationLayers;
     std::vector<const char *> _extensions;
     std::vector<const char *> _deviceExtensions = {
             VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
-    std::vector<VkImage> _swapChainImages;
+    std::vector<VkImage> _swapChainImages;                    // Offscreen images we own when headless
+    std::vector<Allocation> _offscreenImageAllocations;
     std::vector<VkImageView> _swapChainImageViews;
+    std::vector<VkFramebuffer> _swapChainFramebuffers;
+    std::vector<VkSemaphore> _renderFinishedSemaphores;       // Per image: the present is what waits on it
+    std::vector<VkFence> _imagesInFlight;                     // Fence of the frame slot last rendering to each image
+    std::vector<RetiredSwapChain> _retiredSwapChains;
+    bool _framebufferResized = false;                         // Set on resize, the next frame recreates the swap chain
+    std::vector<FrameData> _frames;
+    uint32_t _currentFrame = 0;
+    uint64_t _frameNumber = 0;
+    bool _warmedUp = false;                                   // Stats reset once _warmupFrames were drawn
+    FrameTimer _frameTimer;
+    FrameTimer _recordTimer;                                  // CPU time spent recording each frame's commands
     VkDevice _device{};
     VkExtent2D _swapChainExtent;
     VkFormat _swapChainImageFormat;
     VkInstance _instance{};
     VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties _deviceProperties{};
+    PipelineCache _pipelineCache{*this};
+    PipelineStateCache _pipelineStates{*this};                // Every pipeline, one per distinct description
+    DeviceAllocator _allocator{*this};                        // All buffer and image memory comes from here
+    ThreadPool _threadPool;                                   // Shared workers, one per core
+    ShaderPack _shaderPack;
+    UploadQueue _uploadQueue{*this};
+    Profiler _profiler{*this};
+    GpuCulling _gpuCulling{*this};                            // Culls and draws on the GPU once the app inits it
+    BindlessTable _bindless{*this};                           // Ready when _bindlessSupported
+    PresentPacer _presentPacer{*this};                        // Set its _policy before run()
+    DeletionQueue _deletionQueue{*this};                      // Destroys what frames in flight may still use
+    RenderGraph _renderGraph{*this};                          // Filled by buildRenderGraph
+    TextureStreamer _textureStreamer{*this};                  // Streams once the app inits it, needs _bindless
+    FrameCapture _frameCapture{*this};                        // Set its _path before run() to write the frames out
+    std::vector<std::vector<VkQueue>> _queues;                // Every queue created, by family then queue index
     VkQueue _graphicsQueue{};
     VkQueue _presentQueue{};
+    VkQueue _computeQueue{};                                  // These two may be _graphicsQueue on small devices
+    VkQueue _transferQueue{};
+    VkRenderPass _renderPass{};
     VkSurfaceKHR _surface{};                                  // Window Surface Integration from glfw
     VkSwapchainKHR _swapChain{};
 
@@ -63,13 +156,18 @@ public:
 
     //////////////////////////////////////////////////////////
     void run() {
-        initWindow();
+        if (!_headless) {
+            initWindow();
+        }
         initVulkan();
         mainLoop();
     }
 
     ~BaseApplication();
 
+    // To the swap chain extent, for the main render pass and render graph passes of the same size
+    void setViewportAndScissor(VkCommandBuffer commandBuffer);
+
 private:
     //////////////////////////////////////////////////////////
     // Private Member Variables
@@ -79,32 +177,73 @@ private:
 
     static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
 
-    static VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
+    // The first of the present policy's modes the surface supports
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
 
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
+    void createFrameResources();
+
+    void createFramebuffers();
+
     void createImageViews();
 
     void createLogicalDevice();
 
+    void createOffscreenTargets();
+
+    void createRenderFinishedSemaphores();
+
+    // Rebuilds the app's render graph, the transient images follow the swap chain extent
+    void createRenderGraph();
+
+    void createRenderPass();
+
     void createSurface();
 
+    // Hands the current swap chain (if any) to the new one as its oldSwapchain
     void createSwapChain();
 
+    // Destroys retired swap chains no frame in flight can use any more, or all of them
+    void destroyRetiredSwapChains(bool all);
+
+    void drawFrame();
+
     void findQueueFamilies(VkPhysicalDevice device);
 
+    static void framebufferResizeCallback(GLFWwindow *window, int width, int height);
+
     void initWindow();
 
     void initVulkan();
 
+    bool isDeviceExtensionAvailable(const char *extension);
+
     bool isDeviceSuitable(VkPhysicalDevice device);
 
-    void mainLoop() const;
+    void mainLoop();
 
     void pickPhysicalDevice();
 
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
+    static int rateDeviceType(VkPhysicalDeviceType deviceType);
+
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+    // Splits the draw list into `sliceCount` secondary command buffers recorded in parallel on the thread pool
+    void recordSecondaryCommandBuffers(FrameData &frame, uint32_t imageIndex, uint32_t drawTotal,
+                                       uint32_t sliceCount);
+
+    // Replaces the swap chain without waiting for the device: frames in flight finish on the old one
+    void recreateSwapChain();
+
+    // One paced frame and its stats, from the frame loop or the refresh callback. The caller paces.
+    void runFrame();
+
+    // Some platforms block the event loop while the window is being resized, so frames are drawn from here then
+    static void windowRefreshCallback(GLFWwindow *window);
+
     //////////////////////////////////////////////////////////
     // Virtual Methods
     //////////////////////////////////////////////////////////
@@ -114,5 +253,23 @@ private:
 
     virtual void createGraphicsPipelines() = 0;
 
+    // Fill _meshes here, the uploads are queued and go out with the first frame
+    virtual void loadMeshes() {}
+
+    // Declare offscreen passes here, they are recorded before the main render pass. Called again after every
+    // swap chain recreation, with the graph empty.
+    virtual void buildRenderGraph(RenderGraph &graph) {}
+
+    // Called inside the frame's render pass with viewport and scissor already set
+    virtual void recordDrawCommands(VkCommandBuffer commandBuffer) = 0;
+
+    // Size of the draw list. Past MIN_DRAWS_PER_RECORDER draws the list is recorded in slices through recordDraws
+    // instead of recordDrawCommands.
+    virtual uint32_t drawCount() { return 0; }
+
+    // Records draws [first, last) into a secondary command buffer, called from several threads at once. Viewport and
+    // scissor are set, nothing else is bound.
+    virtual void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) {}
+
 };
 
@@ -0,0 +1,368 @@
+#include "log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include "example/helloworld.hpp"
+#include "scene.hpp"
+
+// Headless scenarios for tracking performance between versions, on any driver including lavapipe.
+// Every result is a distribution (mean/p50/p99/max) written to one JSON file.
+
+namespace {
+
+struct BenchOptions {
+    uint32_t iterations = 5;                                  // Repeats of the startup and upload scenarios
+    uint64_t frames = 200;                                    // Measured frames of the 1k draw scenario
+    uint64_t warmupFrames = 10;
+    VkDeviceSize uploadBytes = 256ull * 1024 * 1024;          // Per upload iteration
+    std::string only;                                         // Run scenarios whose name contains this
+    std::string outPath = "kaiidth_bench.json";
+    std::string pipelineCachePath = "kaiidth_bench_cache.bin";
+    std::string shaderPackPath = "shaders/shaders.pack";
+};
+
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    FrameStats stats;
+};
+
+struct DeviceInfo {
+    std::string name;
+    uint32_t apiVersion = 0;
+    uint32_t driverVersion = 0;
+    uint32_t vendorID = 0;
+    uint32_t deviceID = 0;
+};
+
+const VkDeviceSize UPLOAD_CHUNK = 64ull * 1024 * 1024;
+
+void configure(HelloWorldApplication &app, const BenchOptions &options) {
+    app._headless = true;
+    // Validation would dominate every number
+    app.enableValidation_ = false;
+    // Fixed rather than taken from the present policy, so results stay comparable with earlier runs
+    app._framesInFlight = 2;
+    app._pipelineCachePath = options.pipelineCachePath;
+    app._shaderPackPath = options.shaderPackPath;
+}
+
+void rememberDevice(const HelloWorldApplication &app, DeviceInfo &device) {
+    device.name = app._deviceProperties.deviceName;
+    device.apiVersion = app._deviceProperties.apiVersion;
+    device.driverVersion = app._deviceProperties.driverVersion;
+    device.vendorID = app._deviceProperties.vendorID;
+    device.deviceID = app._deviceProperties.deviceID;
+}
+
+// Every run starts from scratch. The cold run has no pipeline cache file, the warm run loads what the cold run saved.
+void benchStartup(const BenchOptions &options, std::vector<BenchResult> &results, DeviceInfo &device) {
+    std::vector<double> instanceMs, deviceMs, targetsMs, coldPipelinesMs, warmPipelinesMs;
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        for (bool warm : {false, true}) {
+            if (!warm) {
+                std::filesystem::remove(options.pipelineCachePath);
+            }
+            HelloWorldApplication app;
+            configure(app, options);
+            app._frameLimit = 1;
+            app.run();
+            instanceMs.push_back(app._profiler.scopeStats("init: instance").meanMs);
+            deviceMs.push_back(app._profiler.scopeStats("init: device").meanMs);
+            targetsMs.push_back(app._profiler.scopeStats("init: render targets").meanMs);
+            (warm ? warmPipelinesMs : coldPipelinesMs).push_back(app._profiler.scopeStats("init: pipelines").meanMs);
+            rememberDevice(app, device);
+        }
+    }
+    results.push_back({"startup.instance", "ms", FrameTimer::computeStats(instanceMs)});
+    results.push_back({"startup.device", "ms", FrameTimer::computeStats(deviceMs)});
+    results.push_back({"startup.offscreen_targets", "ms", FrameTimer::computeStats(targetsMs)});
+    results.push_back({"startup.pipelines_cold_cache", "ms", FrameTimer::computeStats(coldPipelinesMs)});
+    results.push_back({"startup.pipelines_warm_cache", "ms", FrameTimer::computeStats(warmPipelinesMs)});
+}
+
+void benchDraws(const BenchOptions &options, uint32_t drawCount, const char *label, uint64_t frames,
+                bool gpuCulling, std::vector<BenchResult> &results, DeviceInfo &device, bool offscreenPasses = false) {
+    HelloWorldApplication app;
+    configure(app, options);
+    app._drawCount = drawCount;
+    app._useGpuCulling = gpuCulling;
+    app._offscreenPasses = offscreenPasses;
+    app._warmupFrames = options.warmupFrames;
+    app._frameLimit = options.warmupFrames + frames;
+    app.run();
+    rememberDevice(app, device);
+    results.push_back({std::string(label) + ".frame_time", "ms", app._frameTimer.stats()});
+    results.push_back({std::string(label) + ".record_time", "ms", app._recordTimer.stats()});
+}
+
+// Host memory to device-local buffer through the staging ring and the transfer queue, including the wait for the copy
+void benchUpload(const BenchOptions &options, std::vector<BenchResult> &results, DeviceInfo &device) {
+    HelloWorldApplication app;
+    configure(app, options);
+    app._frameLimit = 1;
+    app.run();
+    rememberDevice(app, device);
+
+    // Random bytes so nothing along the way can take a shortcut on zeros
+    std::vector<unsigned char> data(UPLOAD_CHUNK);
+    std::mt19937 random(42);
+    for (auto &byte : data) {
+        byte = static_cast<unsigned char>(random());
+    }
+    Allocation allocation;
+    VkBuffer buffer = app._allocator.createBuffer(UPLOAD_CHUNK, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocation);
+    std::vector<double> mibPerSecond;
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        for (VkDeviceSize uploaded = 0; uploaded < options.uploadBytes; uploaded += UPLOAD_CHUNK) {
+            VkDeviceSize size = std::min(UPLOAD_CHUNK, options.uploadBytes - uploaded);
+            app._uploadQueue.uploadBuffer(buffer, 0, data.data(), size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                          VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        }
+        app._uploadQueue.wait(app._uploadQueue.flush());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mibPerSecond.push_back(static_cast<double>(options.uploadBytes) / (1024.0 * 1024.0) / seconds);
+    }
+    app._allocator.destroyBuffer(buffer, allocation);
+    results.push_back({"upload.bandwidth", "MiB/s", FrameTimer::computeStats(mibPerSecond)});
+}
+
+// Eight 1024x1024 textures written to a temporary directory, streamed in at the quad's size under a resident cap too
+// small for all of them, so levels are decoded, uploaded and evicted while the frames are timed
+void benchTextureStreaming(const BenchOptions &options, std::vector<BenchResult> &results, DeviceInfo &device) {
+    const uint32_t textureCount = 8;
+    const uint32_t size = 1024;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "kaiidth_bench_textures";
+    std::filesystem::create_directories(directory);
+    HelloWorldApplication app;
+    configure(app, options);
+    std::vector<unsigned char> pixels(size_t(size) * size * 3);
+    for (uint32_t i = 0; i < textureCount; ++i) {
+        for (size_t j = 0; j < pixels.size(); ++j) {
+            pixels[j] = static_cast<unsigned char>(j * (i + 1) / 7);
+        }
+        std::string path = (directory / ("texture_" + std::to_string(i) + ".ppm")).string();
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error("Error: Could not write " + path);
+        }
+        fprintf(file, "P6\n%u %u\n255\n", size, size);
+        fwrite(pixels.data(), 1, pixels.size(), file);
+        fclose(file);
+        app._texturePaths.push_back(path);
+    }
+    app._textureStreamer._maxBytes = 8ull * 1024 * 1024;
+    app._warmupFrames = options.warmupFrames;
+    app._frameLimit = options.warmupFrames + options.frames;
+    app.run();
+    rememberDevice(app, device);
+    results.push_back({"texture_streaming.frame_time", "ms", app._frameTimer.stats()});
+    results.push_back({"texture_streaming.record_time", "ms", app._recordTimer.stats()});
+    std::filesystem::remove_all(directory);
+}
+
+// Pipelines asked for through find() while the app runs, as a material system would. Each variant is new state for
+// the same shaders (a specialization constant they don't declare): the time from its first lookup to the one that
+// hands it out, then of lookups that hit. Fast linked where the device has graphics pipeline libraries.
+void benchPipelineFind(const BenchOptions &options, std::vector<BenchResult> &results, DeviceInfo &device) {
+    const uint32_t variantCount = 64;
+    const uint32_t hitLookups = 1000;
+    HelloWorldApplication app;
+    configure(app, options);
+    app._frameLimit = 1;
+    app.run();
+    rememberDevice(app, device);
+
+    PipelineDescription description = app._pipelines[0]->_description;
+    std::vector<double> readyMs, hitUs;
+    for (uint32_t i = 0; i < variantCount; ++i) {
+        description.specialization = {{1000, i}};
+        auto start = std::chrono::steady_clock::now();
+        while (app._pipelineStates.find(description, app._renderPass) == nullptr) {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) {
+                throw std::runtime_error("Error: find() didn't hand out a pipeline within 10 seconds");
+            }
+            std::this_thread::yield();
+        }
+        auto ready = std::chrono::steady_clock::now();
+        for (uint32_t j = 0; j < hitLookups; ++j) {
+            app._pipelineStates.find(description, app._renderPass);
+        }
+        auto hits = std::chrono::steady_clock::now();
+        readyMs.push_back(std::chrono::duration<double, std::milli>(ready - start).count());
+        hitUs.push_back(std::chrono::duration<double, std::micro>(hits - ready).count() / hitLookups);
+    }
+    results.push_back({"pipeline_find.miss_to_ready", "ms", FrameTimer::computeStats(readyMs)});
+    results.push_back({"pipeline_find.hit", "us", FrameTimer::computeStats(hitUs)});
+}
+
+// CPU only: a million objects in 1024 groups, about half of them in view. Each iteration moves 1% of the groups, so
+// a tenth of a percent of the objects, then culls everything on the thread pool.
+void benchScene(const BenchOptions &options, std::vector<BenchResult> &results) {
+    const uint32_t groupCount = 1024;
+    const uint32_t childCount = 1023;
+    Scene scene;
+    scene.reserve(size_t(groupCount) * (childCount + 1));
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> spread(-1000.0f, 1000.0f);
+    std::vector<uint32_t> groups;
+    for (uint32_t i = 0; i < groupCount; ++i) {
+        uint32_t group = scene.create();
+        scene.setLocalPosition(group, glm::vec3(spread(random), spread(random), spread(random) + 1000.0f));
+        groups.push_back(group);
+        for (uint32_t j = 0; j < childCount; ++j) {
+            uint32_t object = scene.create(group);
+            scene.setLocalPosition(object, glm::vec3(spread(random), spread(random), spread(random)) * 0.05f);
+            scene.setBounds(object, glm::vec3(0.0f), 1.0f);
+            scene.setMesh(object, j % 16, j % 4);
+        }
+    }
+    scene.updateTransforms();
+
+    // 90 degree perspective looking down +z, Vulkan depth 0..1
+    const float nearZ = 0.1f, farZ = 4000.0f;
+    glm::mat4 viewProjection(0.0f);
+    viewProjection[0][0] = 1.0f;
+    viewProjection[1][1] = 1.0f;
+    viewProjection[2][2] = farZ / (farZ - nearZ);
+    viewProjection[2][3] = 1.0f;
+    viewProjection[3][2] = -farZ * nearZ / (farZ - nearZ);
+
+    ThreadPool threadPool;
+    std::vector<uint32_t> visible;
+    std::vector<double> updateMs, cullMs;
+    for (uint64_t i = 0; i < options.warmupFrames + options.frames; ++i) {
+        for (uint32_t j = 0; j < groupCount / 100; ++j) {
+            uint32_t group = groups[random() % groupCount];
+            scene.setLocalPosition(group, glm::vec3(spread(random), spread(random), spread(random) + 1000.0f));
+        }
+        auto start = std::chrono::steady_clock::now();
+        scene.updateTransforms();
+        auto updated = std::chrono::steady_clock::now();
+        visible.clear();
+        scene.cull(viewProjection, threadPool, visible);
+        auto culled = std::chrono::steady_clock::now();
+        if (i >= options.warmupFrames) {
+            updateMs.push_back(std::chrono::duration<double, std::milli>(updated - start).count());
+            cullMs.push_back(std::chrono::duration<double, std::milli>(culled - updated).count());
+        }
+    }
+    results.push_back({"scene_1m.update_transforms", "ms", FrameTimer::computeStats(updateMs)});
+    results.push_back({"scene_1m.cull", "ms", FrameTimer::computeStats(cullMs)});
+}
+
+bool writeJson(const std::string &path, const DeviceInfo &device, const std::vector<BenchResult> &results) {
+    FILE *file = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "{\n  \"device\": {\"name\": \"%s\", \"vendorID\": %u, \"deviceID\": %u, "
+                  "\"apiVersion\": \"%u.%u.%u\", \"driverVersion\": %u},\n",
+            device.name.c_str(), device.vendorID, device.deviceID,
+            VK_API_VERSION_MAJOR(device.apiVersion), VK_API_VERSION_MINOR(device.apiVersion),
+            VK_API_VERSION_PATCH(device.apiVersion), device.driverVersion);
+    fprintf(file, "  \"threads\": %u,\n  \"results\": [", std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"count\": %llu, \"mean\": %.4f, \"p50\": %.4f, "
+                      "\"p99\": %.4f, \"max\": %.4f}", i == 0 ? "" : ",", result.name.c_str(), result.unit.c_str(),
+                static_cast<unsigned long long>(result.stats.count), result.stats.meanMs, result.stats.p50Ms,
+                result.stats.p99Ms, result.stats.maxMs);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return file == stdout || fclose(file) == 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    logging::AsyncScope asyncLogging;
+    BenchOptions options;
+    bool verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = std::max(1ull, std::strtoull(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--warmup-frames") == 0 && i + 1 < argc) {
+            options.warmupFrames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--upload-mib") == 0 && i + 1 < argc) {
+            options.uploadBytes = std::max(1ull, std::strtoull(argv[++i], nullptr, 10)) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            options.only = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            options.outPath = argv[++i];
+        } else if (strcmp(argv[i], "--shader-pack") == 0 && i + 1 < argc) {
+            options.shaderPackPath = argv[++i];
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        }
+    }
+    if (!verbose) {
+        spdlog::set_level(spdlog::level::warn);
+    }
+    auto selected = [&options](const char *scenario) {
+        return options.only.empty() || strstr(scenario, options.only.c_str()) != nullptr;
+    };
+
+    std::vector<BenchResult> results;
+    DeviceInfo device;
+    try {
+        if (selected("startup")) {
+            benchStartup(options, results, device);
+        }
+        // Fewer frames as the draw count grows, so each scenario takes a similar wall time
+        if (selected("draws_1k")) {
+            benchDraws(options, 1000, "draws_1k", options.frames, false, results, device);
+        }
+        if (selected("draws_100k")) {
+            benchDraws(options, 100000, "draws_100k", std::max<uint64_t>(options.frames / 4, 10), false, results,
+                       device);
+        }
+        if (selected("draws_1m")) {
+            benchDraws(options, 1000000, "draws_1m", std::max<uint64_t>(options.frames / 20, 5), false, results,
+                       device);
+        }
+        if (selected("gpu_culling_1m")) {
+            benchDraws(options, 1000000, "gpu_culling_1m", std::max<uint64_t>(options.frames / 4, 10), true, results,
+                       device);
+        }
+        if (selected("render_graph")) {
+            benchDraws(options, 1000, "render_graph", options.frames, false, results, device, true);
+        }
+        if (selected("texture_streaming")) {
+            benchTextureStreaming(options, results, device);
+        }
+        if (selected("upload")) {
+            benchUpload(options, results, device);
+        }
+        if (selected("pipeline_find")) {
+            benchPipelineFind(options, results, device);
+        }
+        if (selected("scene_1m")) {
+            benchScene(options, results);
+        }
+    } catch (const std::exception &e) {
+        logging::stop();                                      // What was logged before the error comes first
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (const auto &result : results) {
+        fprintf(stderr, "%-32s mean %10.3f | p50 %10.3f | p99 %10.3f | max %10.3f %s\n", result.name.c_str(),
+                result.stats.meanMs, result.stats.p50Ms, result.stats.p99Ms, result.stats.maxMs, result.unit.c_str());
+    }
+    if (!writeJson(options.outPath, device, results)) {
+        std::cerr << "Error: Could not write " << options.outPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#include "bindless_table.hpp"
+
+#include <algorithm>
+#include "base.hpp"
+#include "log.hpp"
+
+void BindlessTable::init() {
+    // Combined image samplers count against both the sampler and the sampled image limits, and every binding
+    // against the per-stage total since the table is visible to all stages
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(_app._physicalDevice, &properties);
+    _buffers.capacity = std::min({MAX_BUFFERS, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                  indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                  indexingProperties.maxPerStageUpdateAfterBindResources / 2});
+    _textures.capacity = std::min({MAX_TEXTURES, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                   indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                   indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                   indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                                   indexingProperties.maxPerStageUpdateAfterBindResources - _buffers.capacity});
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = BUFFER_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = _buffers.capacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = TEXTURE_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = _textures.capacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+    // Update unused while pending: slots that pending command buffers don't read can be written at any time
+    VkDescriptorBindingFlags bindingFlags[2];
+    for (auto &flags : bindingFlags) {
+        flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 2;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(_app._device, &layoutInfo, _app._allocationCallbacks, &_setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create bindless descriptor set layout");
+    }
+
+    VkDescriptorPoolSize poolSizes[2]{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = _buffers.capacity;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = _textures.capacity;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+    if (vkCreateDescriptorPool(_app._device, &poolInfo, _app._allocationCallbacks, &_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create bindless descriptor pool");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_setLayout;
+    if (vkAllocateDescriptorSets(_app._device, &allocInfo, &_set) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not allocate bindless descriptor set");
+    }
+    info("Success: Bindless table with {} buffer and {} texture slots", _buffers.capacity, _textures.capacity);
+}
+
+void BindlessTable::cleanup() {
+    info("Clean up: Bindless table ({} buffers and {} textures still in it)", _buffers.used, _textures.used);
+    vkDestroyDescriptorPool(_app._device, _pool, _app._allocationCallbacks);
+    vkDestroyDescriptorSetLayout(_app._device, _setLayout, _app._allocationCallbacks);
+    _set = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t slot = allocateSlot(_buffers, "buffer");
+    VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = BUFFER_BINDING;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    // Writes to one set have to be externally synchronized, which the lock also takes care of
+    vkUpdateDescriptorSets(_app._device, 1, &write, 0, nullptr);
+    return slot;
+}
+
+uint32_t BindlessTable::addTexture(VkImageView imageView, VkSampler sampler, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t slot = allocateSlot(_textures, "texture");
+    VkDescriptorImageInfo imageInfo{sampler, imageView, layout};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = TEXTURE_BINDING;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_app._device, 1, &write, 0, nullptr);
+    return slot;
+}
+
+void BindlessTable::releaseBuffer(uint32_t slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    retireSlot(_buffers, slot);
+}
+
+void BindlessTable::releaseTexture(uint32_t slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    retireSlot(_textures, slot);
+}
+
+void BindlessTable::beginFrame(uint64_t frameNumber) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frameNumber = frameNumber;
+    recycleSlots(_buffers, frameNumber);
+    recycleSlots(_textures, frameNumber);
+}
+
+void BindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout) const {
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, 0, 1, &_set, 0, nullptr);
+}
+
+VkPushConstantRange BindlessTable::pushConstantRange() {
+    VkPushConstantRange range{};
+    range.stageFlags = VK_SHADER_STAGE_ALL;
+    range.offset = 0;
+    range.size = PUSH_CONSTANT_SIZE;
+    return range;
+}
+
+// The helpers below expect _mutex to be held
+
+uint32_t BindlessTable::allocateSlot(SlotAllocator &slots, const char *kind) {
+    uint32_t slot;
+    if (!slots.freeSlots.empty()) {
+        slot = slots.freeSlots.back();
+        slots.freeSlots.pop_back();
+    } else if (slots.next < slots.capacity) {
+        slot = slots.next++;
+    } else {
+        throw std::runtime_error(std::string("Error: Bindless table is out of ") + kind + " slots");
+    }
+    ++slots.used;
+    return slot;
+}
+
+void BindlessTable::retireSlot(SlotAllocator &slots, uint32_t slot) {
+    if (slot == INVALID_SLOT) {
+        return;
+    }
+    slots.retired.emplace_back(_frameNumber, slot);
+    --slots.used;
+}
+
+void BindlessTable::recycleSlots(SlotAllocator &slots, uint64_t frameNumber) {
+    // Frame N's fence wait means every frame up to N - _framesInFlight has finished. Slots retire in frame order.
+    size_t recycled = 0;
+    while (recycled < slots.retired.size() && slots.retired[recycled].first + _app._framesInFlight <= frameNumber) {
+        slots.freeSlots.push_back(slots.retired[recycled].second);
+        ++recycled;
+    }
+    slots.retired.erase(slots.retired.begin(), slots.retired.begin() + static_cast<std::ptrdiff_t>(recycled));
+}
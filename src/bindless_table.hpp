@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class BaseApplication;
+
+// One big descriptor set holding every storage buffer and texture, bound once per command buffer. Resources are
+// addressed by slot: shaders index the arrays in shaders/include/bindless.glsl with slots passed in push constants
+// or other buffers, so there is no descriptor set per draw to allocate, write or bind.
+//
+// The set is update-after-bind and partially bound, so slots can be written while frames using the set are in flight
+// and unwritten slots are fine as long as nothing reads them. A released slot is only reused once every frame that
+// might still read it has finished.
+class BindlessTable {
+public:
+    static constexpr uint32_t BUFFER_BINDING = 0;
+    static constexpr uint32_t TEXTURE_BINDING = 1;
+    static constexpr uint32_t MAX_BUFFERS = 16384;            // Lowered to what the device allows
+    static constexpr uint32_t MAX_TEXTURES = 16384;
+    static constexpr uint32_t PUSH_CONSTANT_SIZE = 128;       // The most every device has to support
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    BaseApplication &_app;
+    VkDescriptorSetLayout _setLayout{};
+    VkDescriptorPool _pool{};
+    VkDescriptorSet _set{};
+
+    explicit BindlessTable(BaseApplication &app) : _app(app) {}
+
+    // Needs the device, with the descriptor indexing features enabled (BaseApplication::_bindlessSupported)
+    void init();
+
+    void cleanup();
+
+    [[nodiscard]] bool isReady() const { return _set != VK_NULL_HANDLE; }
+
+    // Writes the resource into a free slot and returns it. Safe from any thread, also while frames are in flight.
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+    uint32_t addTexture(VkImageView imageView, VkSampler sampler,
+                        VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // The slot goes back to the free list after _framesInFlight more frames. The resource itself can only be
+    // destroyed once no frame in flight reads it either.
+    void releaseBuffer(uint32_t slot);
+
+    void releaseTexture(uint32_t slot);
+
+    // Once per frame after the frame slot's fence wait, recycles slots no frame in flight can still read
+    void beginFrame(uint64_t frameNumber);
+
+    // Binds the table as set 0 of `layout`, any layout made from _setLayout and pushConstantRange() works
+    void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout) const;
+
+    // Every pipeline using the table shares this range, so handles pushed once stay valid across pipeline switches
+    [[nodiscard]] static VkPushConstantRange pushConstantRange();
+
+    [[nodiscard]] uint32_t bufferCapacity() const { return _buffers.capacity; }
+
+    [[nodiscard]] uint32_t textureCapacity() const { return _textures.capacity; }
+
+private:
+    struct SlotAllocator {
+        uint32_t capacity = 0;
+        uint32_t next = 0;                                    // Slots from here on were never handed out
+        std::vector<uint32_t> freeSlots;
+        std::vector<std::pair<uint64_t, uint32_t>> retired;   // Frame number it was released in, slot
+        uint32_t used = 0;
+    };
+
+    uint32_t allocateSlot(SlotAllocator &slots, const char *kind);
+
+    void retireSlot(SlotAllocator &slots, uint32_t slot);
+
+    void recycleSlots(SlotAllocator &slots, uint64_t frameNumber);
+
+    SlotAllocator _buffers;
+    SlotAllocator _textures;
+    uint64_t _frameNumber = 0;
+    std::mutex _mutex;
+};
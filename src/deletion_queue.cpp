@@ -0,0 +1,66 @@
+#include "deletion_queue.hpp"
+
+#include "base.hpp"
+#include "log.hpp"
+
+void DeletionQueue::init() {
+    _slots.resize(_app._framesInFlight);
+}
+
+void DeletionQueue::cleanup() {
+    size_t left = pending();
+    for (uint32_t slot = 0; slot < _slots.size(); ++slot) {
+        beginFrame(slot);
+    }
+    info("Clean up: Deletion queue ({} resources destroyed during the run, {} at exit)", _destroyed - left, left);
+}
+
+void DeletionQueue::push(std::function<void()> destroy) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_slots.empty()) {
+        // Nothing is in flight before the first frame
+        destroy();
+        return;
+    }
+    _slots[_current].push_back(std::move(destroy));
+}
+
+void DeletionQueue::retireBuffer(VkBuffer buffer, Allocation allocation) {
+    if (buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    push([this, buffer, allocation]() mutable { _app._allocator.destroyBuffer(buffer, allocation); });
+}
+
+void DeletionQueue::retireImage(VkImage image, Allocation allocation) {
+    if (image == VK_NULL_HANDLE) {
+        return;
+    }
+    push([this, image, allocation]() mutable { _app._allocator.destroyImage(image, allocation); });
+}
+
+void DeletionQueue::beginFrame(uint32_t slot) {
+    std::vector<std::function<void()>> destroys;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_slots.empty()) {
+            return;
+        }
+        destroys.swap(_slots[slot]);
+        _current = slot;
+        _destroyed += destroys.size();
+    }
+    // Outside the lock, destroying may take a while and other threads keep pushing into the new current slot
+    for (auto &destroy : destroys) {
+        destroy();
+    }
+}
+
+size_t DeletionQueue::pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (const auto &slot : _slots) {
+        count += slot.size();
+    }
+    return count;
+}
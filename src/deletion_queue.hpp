@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+#include "vk_handle.hpp"
+
+class BaseApplication;
+
+// Destroys resources once no frame in flight can use them any more, instead of waiting for the device to go idle.
+// Whatever is released while frame N is current lands in frame N's slot and is destroyed when drawFrame comes round
+// to that slot again and its fence has signalled, so the GPU is done with frame N and everything before it.
+class DeletionQueue {
+public:
+    BaseApplication &_app;
+
+    explicit DeletionQueue(BaseApplication &app) : _app(app) {}
+
+    // One slot per frame in flight, needs _framesInFlight
+    void init();
+
+    // Destroys everything that is left, only once the device is idle
+    void cleanup();
+
+    // Safe from any thread. `destroy` runs on the thread calling beginFrame.
+    void push(std::function<void()> destroy);
+
+    template<typename Handle, void (VKAPI_PTR *Destroy)(VkDevice, Handle, const VkAllocationCallbacks *)>
+    void retire(DeviceHandle<Handle, Destroy> &&handle) {
+        if (!handle) {
+            return;
+        }
+        VkDevice device = handle.device();
+        const VkAllocationCallbacks *allocator = handle.allocator();
+        Handle object = handle.release();
+        push([device, object, allocator] { Destroy(device, object, allocator); });
+    }
+
+    // The allocation goes back to the app's allocator along with the buffer
+    void retireBuffer(VkBuffer buffer, Allocation allocation);
+
+    void retireImage(VkImage image, Allocation allocation);
+
+    // Right after waiting on `slot`'s fence: destroys what the slot collected last time round and starts collecting
+    // for the frame about to be recorded
+    void beginFrame(uint32_t slot);
+
+    [[nodiscard]] size_t pending() const;
+
+private:
+    std::vector<std::vector<std::function<void()>>> _slots;
+    uint32_t _current = 0;
+    size_t _destroyed = 0;
+    mutable std::mutex _mutex;
+};
@@ -0,0 +1,375 @@
+#include "device_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+namespace {
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+// Best fit: the free range that leaves the least behind, to keep big ranges big
+bool suballocate(MemoryBlock &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+    auto best = block.freeRanges.end();
+    VkDeviceSize bestLeftover = UINT64_MAX;
+    for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range) {
+        VkDeviceSize aligned = alignUp(range->first, alignment);
+        VkDeviceSize rangeEnd = range->first + range->second;
+        if (aligned + size <= rangeEnd && rangeEnd - (aligned + size) < bestLeftover) {
+            best = range;
+            bestLeftover = rangeEnd - (aligned + size);
+            if (bestLeftover == 0) {
+                break;
+            }
+        }
+    }
+    if (best == block.freeRanges.end()) {
+        return false;
+    }
+    VkDeviceSize rangeStart = best->first;
+    VkDeviceSize rangeEnd = best->first + best->second;
+    offset = alignUp(rangeStart, alignment);
+    block.freeRanges.erase(best);
+    // Alignment padding stays free and merges back once its neighbour is freed
+    if (offset > rangeStart) {
+        block.freeRanges.emplace(rangeStart, offset - rangeStart);
+    }
+    if (offset + size < rangeEnd) {
+        block.freeRanges.emplace(offset + size, rangeEnd - (offset + size));
+    }
+    block.used += size;
+    return true;
+}
+
+void release(MemoryBlock &block, VkDeviceSize offset, VkDeviceSize size) {
+    block.used -= size;
+    auto next = block.freeRanges.lower_bound(offset);
+    if (next != block.freeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            block.freeRanges.erase(previous);
+        }
+    }
+    if (next != block.freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        block.freeRanges.erase(next);
+    }
+    block.freeRanges.emplace(offset, size);
+}
+
+}
+
+void DeviceAllocator::init() {
+    vkGetPhysicalDeviceMemoryProperties(_app._physicalDevice, &_memoryProperties);
+    _bufferImageGranularity = std::max<VkDeviceSize>(_app._deviceProperties.limits.bufferImageGranularity, 1);
+    _pools.resize(_memoryProperties.memoryTypeCount * 2);
+    info("Success: Device allocator ready with {} memory types, bufferImageGranularity {}",
+         _memoryProperties.memoryTypeCount, _bufferImageGranularity);
+}
+
+void DeviceAllocator::cleanup() {
+    info("Clean up: Device allocator");
+    report();
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &pool : _pools) {
+        for (auto &block : pool) {
+            vkFreeMemory(_app._device, block->memory, _app._allocationCallbacks);
+        }
+        pool.clear();
+    }
+    if (_dedicatedCount > 0) {
+        warn("{} dedicated allocations were never freed", _dedicatedCount);
+    }
+}
+
+Allocation DeviceAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags required,
+                                     VkMemoryPropertyFlags preferred, ResourceKind kind) {
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, required, preferred);
+    Allocation allocation;
+    allocation.memoryType = memoryType;
+    allocation.size = requirements.size;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+    VkDeviceSize blockSize = std::min(DEFAULT_BLOCK_SIZE, heapSize / 8);
+    // Anything that would take up half a block is better off on its own
+    if (requirements.size > blockSize / 2) {
+        if (!allocateDedicated(requirements.size, memoryType, allocation)) {
+            throw std::runtime_error("Error: Out of device memory for a dedicated allocation");
+        }
+        ++_allocationCount;
+        return allocation;
+    }
+
+    auto &pool = _pools[poolIndex(memoryType, kind)];
+    MemoryBlock *block = nullptr;
+    VkDeviceSize offset = 0;
+    for (auto &candidate : pool) {
+        if (candidate->size - candidate->used >= requirements.size &&
+            suballocate(*candidate, requirements.size, requirements.alignment, offset)) {
+            block = candidate.get();
+            break;
+        }
+    }
+    if (block == nullptr) {
+        block = createBlock(memoryType, requirements.size);
+        block->pool = poolIndex(memoryType, kind);
+        pool.emplace_back(block);
+        if (!suballocate(*block, requirements.size, requirements.alignment, offset)) {
+            throw std::runtime_error("Error: Fresh memory block can't fit the allocation");
+        }
+    }
+
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.block = block;
+    allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+    ++_allocationCount;
+    return allocation;
+}
+
+void DeviceAllocator::free(Allocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_allocationCount;
+    if (allocation.block == nullptr) {
+        vkFreeMemory(_app._device, allocation.memory, _app._allocationCallbacks);
+        --_dedicatedCount;
+        _dedicatedBytes -= allocation.size;
+    } else {
+        MemoryBlock *block = allocation.block;
+        release(*block, allocation.offset, allocation.size);
+        // Keep one empty block per pool around so allocate/free churn doesn't hit vkAllocateMemory every time
+        auto &pool = _pools[block->pool];
+        if (block->used == 0 && pool.size() > 1) {
+            vkFreeMemory(_app._device, block->memory, _app._allocationCallbacks);
+            pool.erase(std::find_if(pool.begin(), pool.end(),
+                                    [block](const std::unique_ptr<MemoryBlock> &candidate) {
+                                        return candidate.get() == block;
+                                    }));
+        }
+    }
+    allocation = Allocation{};
+}
+
+VkBuffer DeviceAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+                                       VkMemoryPropertyFlags preferred, Allocation &allocation) {
+    VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = usage;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if (vkCreateBuffer(_app._device, &bufferCreateInfo, _app._allocationCallbacks, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create buffer");
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(_app._device, buffer, &requirements);
+    allocation = allocate(requirements, required, preferred, ResourceKind::Linear);
+    vkBindBufferMemory(_app._device, buffer, allocation.memory, allocation.offset);
+    return buffer;
+}
+
+void DeviceAllocator::destroyBuffer(VkBuffer buffer, Allocation &allocation) {
+    vkDestroyBuffer(_app._device, buffer, _app._allocationCallbacks);
+    free(allocation);
+}
+
+VkImage DeviceAllocator::createImage(const VkImageCreateInfo &imageCreateInfo, VkMemoryPropertyFlags required,
+                                     Allocation &allocation) {
+    VkImage image;
+    if (vkCreateImage(_app._device, &imageCreateInfo, _app._allocationCallbacks, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create image");
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(_app._device, image, &requirements);
+    ResourceKind kind = imageCreateInfo.tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    allocation = allocate(requirements, required, 0, kind);
+    vkBindImageMemory(_app._device, image, allocation.memory, allocation.offset);
+    return image;
+}
+
+void DeviceAllocator::destroyImage(VkImage image, Allocation &allocation) {
+    vkDestroyImage(_app._device, image, _app._allocationCallbacks);
+    free(allocation);
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                                         VkMemoryPropertyFlags preferred) const {
+    // First pass wants the preferred flags as well, second settles for the required ones
+    for (VkMemoryPropertyFlags wanted : {required | preferred, required}) {
+        for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i) {
+            if ((typeFilter & (1u << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+                return i;
+            }
+        }
+    }
+    throw std::runtime_error("Error: Failed to find a suitable memory type");
+}
+
+MemoryStats DeviceAllocator::stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    MemoryStats memoryStats;
+    VkDeviceSize totalFree = 0;
+    VkDeviceSize largestFree = 0;
+    for (auto &pool : _pools) {
+        for (auto &block : pool) {
+            memoryStats.bytesReserved += block->size;
+            memoryStats.bytesUsed += block->used;
+            ++memoryStats.deviceMemoryCount;
+            for (auto &range : block->freeRanges) {
+                totalFree += range.second;
+                largestFree = std::max(largestFree, range.second);
+            }
+        }
+    }
+    memoryStats.bytesReserved += _dedicatedBytes;
+    memoryStats.bytesUsed += _dedicatedBytes;
+    memoryStats.deviceMemoryCount += _dedicatedCount;
+    memoryStats.allocationCount = _allocationCount;
+    memoryStats.fragmentation = totalFree > 0 ? 1.0 - double(largestFree) / double(totalFree) : 0.0;
+    return memoryStats;
+}
+
+void DeviceAllocator::report() {
+    MemoryStats memoryStats = stats();
+    info("Device memory: {} allocations in {} device memory objects (limit {}) | reserved {} KiB | used {} KiB | "
+         "fragmentation {:.2f}", memoryStats.allocationCount, memoryStats.deviceMemoryCount,
+         _app._deviceProperties.limits.maxMemoryAllocationCount, memoryStats.bytesReserved / 1024,
+         memoryStats.bytesUsed / 1024, memoryStats.fragmentation);
+}
+
+MemoryBlock *DeviceAllocator::createBlock(uint32_t memoryType, VkDeviceSize minimumSize) {
+    VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+    VkDeviceSize blockSize = std::max(std::min(DEFAULT_BLOCK_SIZE, heapSize / 8), minimumSize);
+
+    auto block = std::make_unique<MemoryBlock>();
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.memoryTypeIndex = memoryType;
+    // Halve the block on failure, a smaller block is still better than giving up
+    VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (; blockSize >= minimumSize; blockSize /= 2) {
+        allocateInfo.allocationSize = blockSize;
+        result = vkAllocateMemory(_app._device, &allocateInfo, _app._allocationCallbacks, &block->memory);
+        if (result == VK_SUCCESS) {
+            break;
+        }
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Error: Out of device memory for a new memory block");
+    }
+    block->size = allocateInfo.allocationSize;
+    block->memoryType = memoryType;
+    block->freeRanges.emplace(0, block->size);
+    // Host visible blocks stay mapped for their whole life
+    if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void *mapped;
+        if (vkMapMemory(_app._device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            vkFreeMemory(_app._device, block->memory, _app._allocationCallbacks);
+            throw std::runtime_error("Error: Could not map memory block");
+        }
+        block->mapped = static_cast<unsigned char *>(mapped);
+    }
+    LOG_DEBUG("\t Allocated {} KiB memory block of type {}", block->size / 1024, memoryType);
+    return block.release();
+}
+
+bool DeviceAllocator::allocateDedicated(VkDeviceSize size, uint32_t memoryType, Allocation &allocation) {
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryType;
+    if (vkAllocateMemory(_app._device, &allocateInfo, _app._allocationCallbacks, &allocation.memory) != VK_SUCCESS) {
+        return false;
+    }
+    if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(_app._device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped) != VK_SUCCESS) {
+            vkFreeMemory(_app._device, allocation.memory, _app._allocationCallbacks);
+            allocation.memory = VK_NULL_HANDLE;
+            return false;
+        }
+    }
+    ++_dedicatedCount;
+    _dedicatedBytes += size;
+    return true;
+}
+
+size_t DeviceAllocator::poolIndex(uint32_t memoryType, ResourceKind kind) const {
+    // With a granularity of 1 linear and optimal resources can share blocks
+    if (_bufferImageGranularity <= 1) {
+        kind = ResourceKind::Linear;
+    }
+    return memoryType * 2 + (kind == ResourceKind::Optimal ? 1 : 0);
+}
+
+void RingBuffer::create(DeviceAllocator &allocator, VkDeviceSize capacity, VkBufferUsageFlags usage,
+                        VkMemoryPropertyFlags required, uint32_t frameSlots) {
+    _allocator = &allocator;
+    _capacity = capacity;
+    _buffer = allocator.createBuffer(capacity, usage, required, 0, _allocation);
+    _frameMarks.assign(frameSlots, FrameMark{});
+    _head = _tail = _used = _frameBytes = 0;
+}
+
+void RingBuffer::destroy() {
+    if (_allocator != nullptr && _buffer != VK_NULL_HANDLE) {
+        _allocator->destroyBuffer(_buffer, _allocation);
+    }
+    _buffer = VK_NULL_HANDLE;
+}
+
+bool RingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment, RingAllocation &ringAllocation) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_used == 0) {
+        _head = _tail = 0;
+    }
+    VkDeviceSize offset = alignUp(_head, alignment);
+    VkDeviceSize consumed;
+    if (_head >= _tail && _used < _capacity) {
+        // Free space is [head, capacity) plus [0, tail)
+        if (offset + size <= _capacity) {
+            consumed = offset + size - _head;
+        } else if (size <= _tail) {
+            // Skip the end of the ring, those bytes come back with this frame's
+            offset = 0;
+            consumed = _capacity - _head + size;
+        } else {
+            return false;
+        }
+    } else if (_head < _tail && offset + size <= _tail) {
+        consumed = offset + size - _head;
+    } else {
+        return false;
+    }
+    _head = offset + size;
+    _used += consumed;
+    _frameBytes += consumed;
+    ringAllocation.buffer = _buffer;
+    ringAllocation.offset = offset;
+    ringAllocation.mapped = _allocation.mapped ? static_cast<unsigned char *>(_allocation.mapped) + offset : nullptr;
+    return true;
+}
+
+void RingBuffer::beginFrame(uint32_t frameSlot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    FrameMark &mark = _frameMarks[frameSlot];
+    if (mark.valid) {
+        _tail = mark.head;
+        _used -= mark.bytes;
+        mark.valid = false;
+    }
+}
+
+void RingBuffer::endFrame(uint32_t frameSlot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frameMarks[frameSlot] = FrameMark{_head, _frameBytes, true};
+    _frameBytes = 0;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class BaseApplication;
+
+// Buffers are linear resources and optimal-tiling images are not. When the device's bufferImageGranularity is
+// bigger than 1 the two kinds are kept in separate blocks, so they can never end up sharing a granularity page.
+enum class ResourceKind {
+    Linear,
+    Optimal,
+};
+
+// One VkDeviceMemory that long-lived resources are sub-allocated from
+struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    uint32_t memoryType = 0;
+    size_t pool = 0;
+    unsigned char *mapped = nullptr;
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;          // offset -> size, kept coalesced
+};
+
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;                                   // Already offset, set for host visible memory
+    uint32_t memoryType = 0;
+    MemoryBlock *block = nullptr;                             // nullptr for dedicated allocations
+};
+
+struct MemoryStats {
+    VkDeviceSize bytesReserved = 0;                           // Everything obtained from vkAllocateMemory
+    VkDeviceSize bytesUsed = 0;                               // What has been handed out of it
+    double fragmentation = 0.0;                               // 1 - largest free range / total free, 0 is best
+    uint32_t allocationCount = 0;
+    uint32_t deviceMemoryCount = 0;                           // Counts against maxMemoryAllocationCount
+};
+
+// Allocates large VkDeviceMemory blocks per memory type and sub-allocates long-lived resources out of them with a
+// best-fit free list that coalesces on free. Big resources get a dedicated allocation. Safe to call from any thread.
+class DeviceAllocator {
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    BaseApplication &_app;
+
+    explicit DeviceAllocator(BaseApplication &app) : _app(app) {}
+
+    // Needs the physical and logical device
+    void init();
+
+    void cleanup();
+
+    // `required` flags must be present, `preferred` ones are picked when some memory type has them
+    Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags required,
+                        VkMemoryPropertyFlags preferred, ResourceKind kind);
+
+    void free(Allocation &allocation);
+
+    VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+                          VkMemoryPropertyFlags preferred, Allocation &allocation);
+
+    void destroyBuffer(VkBuffer buffer, Allocation &allocation);
+
+    VkImage createImage(const VkImageCreateInfo &imageCreateInfo, VkMemoryPropertyFlags required,
+                        Allocation &allocation);
+
+    void destroyImage(VkImage image, Allocation &allocation);
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred = 0) const;
+
+    [[nodiscard]] MemoryStats stats();
+
+    void report();
+
+    [[nodiscard]] const VkPhysicalDeviceMemoryProperties &memoryProperties() const { return _memoryProperties; }
+
+private:
+    MemoryBlock *createBlock(uint32_t memoryType, VkDeviceSize minimumSize);
+
+    bool allocateDedicated(VkDeviceSize size, uint32_t memoryType, Allocation &allocation);
+
+    [[nodiscard]] size_t poolIndex(uint32_t memoryType, ResourceKind kind) const;
+
+    VkPhysicalDeviceMemoryProperties _memoryProperties{};
+    VkDeviceSize _bufferImageGranularity = 1;
+    std::vector<std::vector<std::unique_ptr<MemoryBlock>>> _pools;
+    uint32_t _dedicatedCount = 0;
+    VkDeviceSize _dedicatedBytes = 0;
+    uint32_t _allocationCount = 0;
+    std::mutex _mutex;
+};
+
+struct RingAllocation {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void *mapped = nullptr;                                   // Already offset, set for host visible rings
+};
+
+// One persistently mapped buffer handed out front to back for per-frame transient data (staging, uniforms).
+// Space used during a frame comes back in one go once that frame slot's fence has signalled.
+class RingBuffer {
+public:
+    void create(DeviceAllocator &allocator, VkDeviceSize capacity, VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags required, uint32_t frameSlots);
+
+    void destroy();
+
+    // Returns false when the ring is full, the caller decides whether to wait for a frame or split the data
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, RingAllocation &ringAllocation);
+
+    // The slot's previous frame has finished on the GPU: everything it allocated can be reused
+    void beginFrame(uint32_t frameSlot);
+
+    // Everything allocated since the last endFrame belongs to this slot
+    void endFrame(uint32_t frameSlot);
+
+    [[nodiscard]] VkBuffer buffer() const { return _buffer; }
+
+    [[nodiscard]] VkDeviceSize capacity() const { return _capacity; }
+
+    [[nodiscard]] VkDeviceSize used() const { return _used; }
+
+private:
+    struct FrameMark {
+        VkDeviceSize head = 0;
+        VkDeviceSize bytes = 0;
+        bool valid = false;
+    };
+
+    DeviceAllocator *_allocator = nullptr;
+    VkBuffer _buffer = VK_NULL_HANDLE;
+    Allocation _allocation;
+    VkDeviceSize _capacity = 0;
+    VkDeviceSize _head = 0;
+    VkDeviceSize _tail = 0;
+    VkDeviceSize _used = 0;                                   // Includes space skipped when wrapping around
+    VkDeviceSize _frameBytes = 0;
+    std::vector<FrameMark> _frameMarks;
+    std::mutex _mutex;
+};
@@ -1,9 +1,17 @@
 #pragma once
+#include <random>
 #include "helpers.hpp"
+#include "mesh_file.hpp"
 #include "pipeline.hpp"
 #include "base.hpp"
 
 class HelloWorldApplication : public BaseApplication {
+public:
+    uint32_t _drawCount = 1;                                  // Draws of the quad per frame, one draw call each
+    bool _useGpuCulling = false;                              // Scatter _drawCount instances, cull and draw on the GPU
+    std::string _meshPath;                                    // Mesh file to draw instead of the quad, if any
+    bool _offscreenPasses = false;                            // Also run the render graph's offscreen passes
+    std::vector<std::string> _texturePaths;                   // Streamed in and requested at the quad's size
 
 private:
     void getRequiredExtensions() override {
@@ -15,42 +23,216 @@ private:
     }
 
     void createGraphicsPipelines() override {
-        BasePipeline p = BasePipeline(*this);
-
-        p.addShader("shaders/001_triangle.vert.spv", true);
-        p.addShader("shaders/001_triangle.frag.spv", false);
-
-        _pipelines.push_back(p);
-
-
-//        addShader(this, "shaders/001_triangle.vert.spv", true);
-//        addShader(this, "shaders/001_triangle.frag.spv", false);
-//
-//        // How to load stuff into the buffers in shaders
-//        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-//        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-//
-//        vertexInputInfo.vertexBindingDescriptionCount = 0;
-//        vertexInputInfo.pVertexBindingDescriptions = nullptr;
-//
-//        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-//        vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-//
-//        // What kind of geometry
-//        VkPipelineInputAssemblyStateCreateInfo vertexInputAssembly{};
-//        vertexInputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-//        vertexInputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-//        vertexInputAssembly.primitiveRestartEnable = VK_FALSE;
-//
-//        // Viewports
-//        VkViewport viewport{};
-//        viewport.x = 0.0f;
-//        viewport.y = 0.0f;
-//        viewport.width = (float) _swapChainExtent.width;
-//        viewport.height = (float) _swapChainExtent.height;
-//        viewport.minDepth = 0.0f;
-//        viewport.maxDepth = 1.0f;
-
-    }
-
-};
\ No newline at end of file
+        // Decided before anything depends on it: the mesh file and the instanced pipeline, then loadMeshes()
+        if (_useGpuCulling && !_gpuDrivenSupported) {
+            warn("Device can't draw indirect with a count, falling back to CPU draws");
+            _useGpuCulling = false;
+        }
+        // All pipelines are described up front and created together across the thread pool
+        std::vector<PipelineDescription> descriptions = {
+                {"shaders/002_mesh.vert.spv", "shaders/001_triangle.frag.spv",
+                 Vertex::bindingDescriptions(), Vertex::attributeDescriptions()},
+        };
+        // The file's streams decide the vertex input. It stays mapped so swap chain recreation can read them again.
+        if (!_meshPath.empty() && !_useGpuCulling) {
+            if (!_meshFile.isOpen() && !_meshFile.open(_meshPath)) {
+                throw std::runtime_error("Error: Mesh file " + _meshPath + " not found");
+            }
+            descriptions[0].vertexBindings = _meshFile.vertexBindings();
+            descriptions[0].vertexAttributes = _meshFile.vertexAttributes();
+        }
+        if (_useGpuCulling) {
+            PipelineDescription instanced{"shaders/003_instanced.vert.spv", "shaders/001_triangle.frag.spv",
+                                          Vertex::bindingDescriptions(), Vertex::attributeDescriptions()};
+            instanced.vertexBindings.push_back(GpuInstance::bindingDescription(GpuCulling::INSTANCE_BINDING));
+            instanced.vertexAttributes.push_back(GpuInstance::attributeDescription(GpuCulling::INSTANCE_BINDING, 2));
+            descriptions.push_back(instanced);
+        }
+        _pipelines = _pipelineStates.prepare(descriptions, _renderPass);
+    }
+
+    void loadMeshes() override {
+        loadTextures();
+        if (_useGpuCulling) {
+            if (!_meshPath.empty()) {
+                warn("The GPU-culled scene has its own meshes, ignoring {}", _meshPath);
+            }
+            loadCulledScene();
+            return;
+        }
+        if (_meshFile.isOpen()) {
+            _meshes.emplace_back();
+            _meshes.back().create(*this, _meshFile);
+            return;
+        }
+        // Clockwise on screen, since the pipeline culls back faces with a clockwise front face
+        std::vector<Vertex> vertices = {
+                {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+                {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+                {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+                {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}},
+        };
+        std::vector<uint32_t> indices = {0, 1, 2, 2, 3, 0};
+        _meshes.emplace_back();
+        _meshes.back().create(*this, vertices, indices);
+    }
+
+    // A bloom-like chain that nothing composites yet: the first mesh drawn offscreen, blitted down to half size and
+    // back up. The two full size images are never alive at the same time, so the graph gives them one allocation.
+    void buildRenderGraph(RenderGraph &graph) override {
+        if (!_offscreenPasses) {
+            return;
+        }
+        GraphImageDesc full{VK_FORMAT_R8G8B8A8_UNORM, _swapChainExtent};
+        GraphImageDesc half{VK_FORMAT_R8G8B8A8_UNORM, {std::max(_swapChainExtent.width / 2, 1u),
+                                                        std::max(_swapChainExtent.height / 2, 1u)}};
+        uint32_t scene = graph.createImage("offscreen scene", full);
+        uint32_t downsampled = graph.createImage("downsampled", half);
+        uint32_t upsampled = graph.createImage("upsampled", full);
+
+        graph.addPass("offscreen scene", [scene](RenderGraph::PassBuilder &pass) {
+            pass.colorAttachment(scene, AttachmentLoad::Clear, {{0.1f, 0.1f, 0.1f, 1.0f}});
+        }, [this](VkCommandBuffer commandBuffer) {
+            // Its render pass differs from the main one, so the pipeline is made on first use. The pass only clears
+            // until it's there.
+            const BasePipeline *pipeline = _pipelineStates.find(_pipelines[0]->_description,
+                                                                 _renderGraph.renderPass("offscreen scene"));
+            if (pipeline == nullptr) {
+                return;
+            }
+            setViewportAndScissor(commandBuffer);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->_pipeline.get());
+            const Mesh &mesh = _meshes[0];
+            mesh.bind(commandBuffer);
+            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+        });
+        graph.addPass("downsample", [scene, downsampled](RenderGraph::PassBuilder &pass) {
+            pass.read(scene, GraphUsage::TransferSrc);
+            pass.write(downsampled, GraphUsage::TransferDst);
+        }, [this, scene, downsampled, full, half](VkCommandBuffer commandBuffer) {
+            blit(commandBuffer, _renderGraph.image(scene), full.extent, _renderGraph.image(downsampled), half.extent);
+        });
+        graph.addPass("upsample", [downsampled, upsampled](RenderGraph::PassBuilder &pass) {
+            pass.read(downsampled, GraphUsage::TransferSrc);
+            pass.write(upsampled, GraphUsage::TransferDst);
+            // Nothing reads the result yet
+            pass.sideEffect();
+        }, [this, downsampled, upsampled, full, half](VkCommandBuffer commandBuffer) {
+            blit(commandBuffer, _renderGraph.image(downsampled), half.extent, _renderGraph.image(upsampled),
+                 full.extent);
+        });
+    }
+
+    // Whole color image to whole color image, filtered
+    static void blit(VkCommandBuffer commandBuffer, VkImage source, VkExtent2D sourceExtent, VkImage destination,
+                     VkExtent2D destinationExtent) {
+        VkImageBlit region{};
+        region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.srcOffsets[1] = {static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height),
+                                1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.dstOffsets[1] = {static_cast<int32_t>(destinationExtent.width),
+                                static_cast<int32_t>(destinationExtent.height), 1};
+        vkCmdBlitImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+    }
+
+    void loadTextures() {
+        if (_texturePaths.empty()) {
+            return;
+        }
+        if (!_bindlessSupported) {
+            warn("Device has no bindless descriptors, not streaming the {} textures", _texturePaths.size());
+            return;
+        }
+        _textureStreamer.init();
+        for (const auto &path : _texturePaths) {
+            _textureIds.push_back(_textureStreamer.load(path));
+        }
+    }
+
+    // The quad's shader doesn't sample them yet, but the requests are what streams levels in and decides evictions.
+    // The quad covers half the swap chain on each side.
+    void requestTextures() {
+        float pixels = float(std::max(_swapChainExtent.width, _swapChainExtent.height)) / 2.0f;
+        for (uint32_t texture : _textureIds) {
+            _textureStreamer.request(texture, pixels);
+        }
+    }
+
+    void recordDrawCommands(VkCommandBuffer commandBuffer) override {
+        if (_gpuCulling.isReady()) {
+            requestTextures();
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelines[1]->_pipeline.get());
+            _meshes[0].bind(commandBuffer);
+            _gpuCulling.recordDraws(commandBuffer, _currentFrame);
+            return;
+        }
+        recordDraws(commandBuffer, 0, _drawCount);
+    }
+
+    // The GPU-driven path is a single draw call, so it never needs recording slices
+    uint32_t drawCount() override {
+        return _gpuCulling.isReady() ? 0 : _drawCount;
+    }
+
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) override {
+        // Once per frame, also when the draws are recorded in slices
+        if (first == 0) {
+            requestTextures();
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelines[0]->_pipeline.get());
+        const Mesh &mesh = _meshes[0];
+        mesh.bind(commandBuffer);
+        for (uint32_t i = first; i < last; ++i) {
+            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+        }
+    }
+
+    // Three LODs of a subdivided quad in one mesh, instances scattered over twice the screen in each direction so
+    // about a quarter of them survive the frustum test. Nearer instances (smaller z) get the finer grids.
+    void loadCulledScene() {
+        const uint32_t lodGrids[] = {8, 4, 1};
+        const float lodDistances[] = {1.3f, 1.6f, 0.0f};
+        const glm::vec3 lodColors[] = {{1.0f, 0.3f, 0.3f}, {0.3f, 1.0f, 0.3f}, {0.3f, 0.3f, 1.0f}};
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<GpuMeshLod> lods;
+        for (uint32_t lod = 0; lod < 3; ++lod) {
+            uint32_t grid = lodGrids[lod];
+            lods.push_back({6 * grid * grid, static_cast<uint32_t>(indices.size()),
+                            static_cast<int32_t>(vertices.size()), lodDistances[lod]});
+            for (uint32_t y = 0; y <= grid; ++y) {
+                for (uint32_t x = 0; x <= grid; ++x) {
+                    vertices.push_back({{float(x) / grid - 0.5f, float(y) / grid - 0.5f, 0.0f}, lodColors[lod]});
+                }
+            }
+            // Same clockwise winding as the single quad
+            for (uint32_t y = 0; y < grid; ++y) {
+                for (uint32_t x = 0; x < grid; ++x) {
+                    uint32_t corner = y * (grid + 1) + x;
+                    uint32_t quad[] = {corner, corner + 1, corner + grid + 2, corner + grid + 2, corner + grid + 1,
+                                       corner};
+                    indices.insert(indices.end(), std::begin(quad), std::end(quad));
+                }
+            }
+        }
+        _meshes.emplace_back();
+        _meshes.back().create(*this, vertices, indices);
+
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+        std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+        std::uniform_real_distribution<float> scale(0.02f, 0.08f);
+        std::vector<GpuInstance> instances(std::max(_drawCount, 1u));
+        for (auto &instance : instances) {
+            instance.positionScale = glm::vec4(position(random), position(random), depth(random), scale(random));
+        }
+        // Half the diagonal of the unit quad
+        _gpuCulling.init({{0.7072f, 0, 3}}, lods, instances);
+        _gpuCulling.setCamera(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    }
+
+    MeshFile _meshFile;
+    std::vector<uint32_t> _textureIds;
+};
@@ -0,0 +1,68 @@
+#include "frame.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include "log.hpp"
+
+void FrameTimer::beginFrame() {
+    auto now = Clock::now();
+    if (!_started) {
+        _started = true;
+        _lastReport = now;
+    } else {
+        addSample(std::chrono::duration<double, std::milli>(now - _lastFrameStart).count());
+    }
+    _lastFrameStart = now;
+}
+
+void FrameTimer::addSample(double ms) {
+    if (_samplesMs.size() < _capacity) {
+        _samplesMs.push_back(ms);
+    } else {
+        _samplesMs[_next] = ms;
+        _next = (_next + 1) % _capacity;
+    }
+}
+
+void FrameTimer::reset() {
+    _samplesMs.clear();
+    _next = 0;
+    _started = false;
+}
+
+FrameStats FrameTimer::stats() const {
+    return computeStats(_samplesMs);
+}
+
+void FrameTimer::reportPeriodically(double intervalSeconds) {
+    auto now = Clock::now();
+    if (std::chrono::duration<double>(now - _lastReport).count() < intervalSeconds) {
+        return;
+    }
+    _lastReport = now;
+    report("Frame time");
+}
+
+void FrameTimer::report(const char *label) const {
+    FrameStats frameStats = stats();
+    info("{}: {} frames | mean {:.3f} ms | p50 {:.3f} ms | p99 {:.3f} ms | max {:.3f} ms", label, frameStats.count,
+         frameStats.meanMs, frameStats.p50Ms, frameStats.p99Ms, frameStats.maxMs);
+}
+
+FrameStats FrameTimer::computeStats(std::vector<double> samples) {
+    FrameStats frameStats;
+    if (samples.empty()) {
+        return frameStats;
+    }
+    frameStats.count = samples.size();
+    frameStats.meanMs = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+    auto percentile = [&samples](double p) {
+        auto nth = samples.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(samples.size() - 1));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    };
+    frameStats.p50Ms = percentile(0.50);
+    frameStats.p99Ms = percentile(0.99);
+    frameStats.maxMs = *std::max_element(samples.begin(), samples.end());
+    return frameStats;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Everything one frame-in-flight slot owns. The CPU only waits on a slot's fence when it comes round
+// to that slot again, never on the frame it just submitted.
+struct FrameData {
+    VkCommandPool commandPool{};                              // Reset as a whole each time the slot is reused
+    VkCommandBuffer commandBuffer{};
+    VkSemaphore imageAvailable{};                             // Signalled by acquire, waited on by the submit
+    VkFence inFlight{};                                       // Signalled when the slot's submit finishes
+    // One pool and secondary command buffer per recording slice, each only ever touched by one thread at a time
+    std::vector<VkCommandPool> recorderPools;
+    std::vector<VkCommandBuffer> secondaryBuffers;
+};
+
+struct FrameStats {
+    uint64_t count = 0;
+    double meanMs = 0.0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+// Measures the time between consecutive frame starts, keeping the last `capacity` samples
+class FrameTimer {
+public:
+    explicit FrameTimer(size_t capacity = 100000) : _capacity(capacity) {}
+
+    void beginFrame();
+
+    // For timing things other than whole frames
+    void addSample(double ms);
+
+    void reset();
+
+    [[nodiscard]] FrameStats stats() const;
+
+    // Logs the stats at most once per `intervalSeconds`, call once per frame
+    void reportPeriodically(double intervalSeconds = 2.0);
+
+    void report(const char *label) const;
+
+    static FrameStats computeStats(std::vector<double> samples);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    size_t _capacity;
+    size_t _next = 0;
+    std::vector<double> _samplesMs;
+    Clock::time_point _lastFrameStart{};
+    Clock::time_point _lastReport{};
+    bool _started = false;
+};
@@ -0,0 +1,239 @@
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+void FrameCapture::init() {
+    _sequence = _path.find('{') != std::string::npos;
+    if (_sequence) {
+        try {
+            (void) fmt::format(fmt::runtime(_path), uint64_t(0));
+        } catch (const fmt::format_error &) {
+            throw std::runtime_error("Error: Capture path " + _path + " is not a valid frame number pattern");
+        }
+    } else {
+        _stream = fopen(_path.c_str(), "wb");
+        if (_stream == nullptr) {
+            throw std::runtime_error("Error: Could not open " + _path + " for the captured frames");
+        }
+    }
+    // Slots are reused oldest first. With more of them than frames in flight, the oldest copy has always been
+    // handed to the writer by the time its slot comes round again.
+    _slotCount = std::max(_slotCount != 0 ? _slotCount : _app._framesInFlight + EXTRA_SLOTS, _app._framesInFlight + 1);
+    _slots = std::make_unique<Slot[]>(_slotCount);
+    _stop = false;
+    _writer = std::thread(&FrameCapture::writeLoop, this);
+    info("Success: Capturing frames to {} through {} readback buffers", _path, _slotCount);
+}
+
+void FrameCapture::cleanup() {
+    // The device is idle, so every copy recorded is done
+    for (uint32_t i = 0; i < _slotCount; ++i) {
+        uint32_t index = (_nextSlot + i) % _slotCount;
+        if (_slots[index].state.load(std::memory_order_acquire) == SlotState::Recorded) {
+            queueWrite(index);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    _writer.join();
+    for (uint32_t i = 0; i < _slotCount; ++i) {
+        if (_slots[i].buffer != VK_NULL_HANDLE) {
+            _app._allocator.destroyBuffer(_slots[i].buffer, _slots[i].allocation);
+        }
+    }
+    _slots.reset();
+    if (_stream != nullptr) {
+        fclose(_stream);
+        _stream = nullptr;
+    }
+    info("Frame capture: {} frames captured, {} written, {} dropped with every buffer busy, {} failed to write",
+         _capturedCount, _writtenCount.load(), _droppedCount, _failedCount.load());
+    if (!_sequence && _streamExtent.width != 0) {
+        info("\t Play it with: ffplay -f rawvideo -pixel_format rgba -video_size {}x{} {}", _streamExtent.width,
+             _streamExtent.height, _path);
+    }
+}
+
+void FrameCapture::beginFrame(uint32_t frameSlot) {
+    // Oldest first, so the stream gets the frames in order
+    for (uint32_t i = 0; i < _slotCount; ++i) {
+        uint32_t index = (_nextSlot + i) % _slotCount;
+        const Slot &slot = _slots[index];
+        if (slot.state.load(std::memory_order_acquire) == SlotState::Recorded && slot.frameSlot == frameSlot) {
+            queueWrite(index);
+        }
+    }
+}
+
+void FrameCapture::record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, VkExtent2D extent,
+                          VkFormat format, uint32_t frameSlot, uint64_t frameNumber) {
+    if (!isSupported(format)) {
+        LOG_FRAME_WARN("Can't capture frames in format {}, only 8 bit RGBA and BGRA", static_cast<int>(format));
+        return;
+    }
+    Slot &slot = _slots[_nextSlot];
+    if (slot.state.load(std::memory_order_acquire) != SlotState::Free) {
+        if (!_waitWhenFull) {
+            ++_droppedCount;
+            LOG_FRAME_WARN("Dropped a captured frame, all {} readback buffers are waiting on the writer", _slotCount);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _written.wait(lock, [&slot] { return slot.state.load(std::memory_order_acquire) == SlotState::Free; });
+    }
+
+    // The slot is free, so no copy or write can be using its buffer
+    VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+    if (slot.capacity < size) {
+        if (slot.buffer != VK_NULL_HANDLE) {
+            _app._allocator.destroyBuffer(slot.buffer, slot.allocation);
+        }
+        // Cached memory keeps the writer's reads fast, coherent memory saves invalidating it
+        slot.buffer = _app._allocator.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                   VK_MEMORY_PROPERTY_HOST_CACHED_BIT, slot.allocation);
+        slot.capacity = size;
+    }
+
+    // Chains onto the render pass's dependency into the transfer stage, which already made the attachment writes and
+    // the final layout transition visible to transfer reads. Only the layout changes here.
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = layout;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &imageBarrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    // The copy is visible to the host once the frame's fence has signalled. The image goes back to where the render
+    // pass left it, offscreen images already are.
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = slot.buffer;
+    bufferBarrier.size = size;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = 0;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = layout;
+    uint32_t imageBarrierCount = layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 0 : 1;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
+                         &bufferBarrier, imageBarrierCount, &imageBarrier);
+
+    slot.frameSlot = frameSlot;
+    slot.frameNumber = frameNumber;
+    slot.extent = extent;
+    slot.bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    slot.state.store(SlotState::Recorded, std::memory_order_release);
+    _nextSlot = (_nextSlot + 1) % _slotCount;
+    ++_capturedCount;
+}
+
+bool FrameCapture::isSupported(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB ||
+           format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+void FrameCapture::queueWrite(uint32_t slot) {
+    _slots[slot].state.store(SlotState::Writing, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(slot);
+    }
+    _wake.notify_one();
+}
+
+void FrameCapture::writeLoop() {
+    while (true) {
+        uint32_t index;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return _stop || !_queue.empty(); });
+            // Stopping still writes everything queued
+            if (_queue.empty()) {
+                return;
+            }
+            index = _queue.front();
+            _queue.pop_front();
+        }
+        write(_slots[index]);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _slots[index].state.store(SlotState::Free, std::memory_order_release);
+        }
+        _written.notify_one();
+    }
+}
+
+void FrameCapture::write(const Slot &slot) {
+    // PPM wants RGB, the stream RGBA, whatever order the image had
+    const auto *source = static_cast<const unsigned char *>(slot.allocation.mapped);
+    size_t texels = size_t(slot.extent.width) * slot.extent.height;
+    size_t channels = _sequence ? 3 : 4;
+    _pixels.resize(texels * channels);
+    size_t red = slot.bgra ? 2 : 0;
+    size_t blue = slot.bgra ? 0 : 2;
+    for (size_t i = 0; i < texels; ++i) {
+        const unsigned char *texel = source + i * 4;
+        unsigned char *target = &_pixels[i * channels];
+        target[0] = texel[red];
+        target[1] = texel[1];
+        target[2] = texel[blue];
+        if (channels == 4) {
+            target[3] = texel[3];
+        }
+    }
+
+    if (_sequence) {
+        std::string path = fmt::format(fmt::runtime(_path), slot.frameNumber);
+        FILE *file = fopen(path.c_str(), "wb");
+        bool written = file != nullptr &&
+                       fprintf(file, "P6\n%u %u\n255\n", slot.extent.width, slot.extent.height) > 0 &&
+                       fwrite(_pixels.data(), 1, _pixels.size(), file) == _pixels.size();
+        if (file != nullptr && fclose(file) != 0) {
+            written = false;
+        }
+        if (!written) {
+            ++_failedCount;
+            LOG_FRAME_WARN("Could not write captured frame {}", path);
+            return;
+        }
+    } else {
+        if (_streamExtent.width == 0) {
+            _streamExtent = slot.extent;
+        }
+        if (slot.extent.width != _streamExtent.width || slot.extent.height != _streamExtent.height) {
+            ++_failedCount;
+            LOG_FRAME_WARN("Skipped captured frame {}: it is {}x{}, the video stream {}x{}", slot.frameNumber,
+                           slot.extent.width, slot.extent.height, _streamExtent.width, _streamExtent.height);
+            return;
+        }
+        if (fwrite(_pixels.data(), 1, _pixels.size(), _stream) != _pixels.size()) {
+            ++_failedCount;
+            LOG_FRAME_WARN("Could not write captured frame {} to {}", slot.frameNumber, _path);
+            return;
+        }
+    }
+    ++_writtenCount;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+
+class BaseApplication;
+
+// Reads finished frames back without stalling the render loop. The frame's own command buffer copies the image into
+// one of a ring of host-visible buffers. Once that frame slot's fence has signalled, a writer thread turns the buffer
+// into a file, so the render thread never maps, converts or writes pixels.
+//
+// A _path with a {} field (fmt syntax, e.g. "capture/frame_{:05}.ppm") writes one binary PPM per frame, named by
+// frame number. Any other path gets a raw RGBA video stream of every frame back to back, for
+// `ffmpeg -f rawvideo -pixel_format rgba -video_size WxH -i PATH`.
+class FrameCapture {
+public:
+    static constexpr uint32_t EXTRA_SLOTS = 2;                // Slots beyond frames in flight for the writer to chew on
+
+    BaseApplication &_app;
+    std::string _path;                                        // Set before run() to capture, see above
+    uint32_t _slotCount = 0;                                  // Readback buffers, 0: frames in flight + EXTRA_SLOTS
+    bool _waitWhenFull = false;                               // Wait for the writer instead of dropping the frame, for
+                                                              // batch renders that need every one
+
+    explicit FrameCapture(BaseApplication &app) : _app(app) {}
+
+    [[nodiscard]] bool isEnabled() const { return !_path.empty(); }
+
+    [[nodiscard]] bool isReady() const { return _writer.joinable(); }
+
+    // Needs _framesInFlight, starts the writer thread
+    void init();
+
+    // Only once the device is idle: writes the frames still in the ring, joins the writer and logs the stats
+    void cleanup();
+
+    // After the frame slot's fence wait: hands the copies recorded in that slot to the writer
+    void beginFrame(uint32_t frameSlot);
+
+    // Records the copy of `image`, which the frame has finished rendering, left in `layout` and leaves in it again.
+    // Whatever rendered it must have made its writes and its final layout transition visible to transfer reads,
+    // such as a render pass with a subpass dependency to VK_SUBPASS_EXTERNAL. Frames that find no free buffer are
+    // dropped and counted.
+    void record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, VkExtent2D extent, VkFormat format,
+                uint32_t frameSlot, uint64_t frameNumber);
+
+    // Only 8 bit RGBA and BGRA images can be captured
+    static bool isSupported(VkFormat format);
+
+private:
+    enum class SlotState : uint32_t {
+        Free,
+        Recorded,                                             // Copy recorded, the GPU may not have done it yet
+        Writing,                                              // With the writer thread
+    };
+
+    struct Slot {
+        std::atomic<SlotState> state{SlotState::Free};
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceSize capacity = 0;
+        uint32_t frameSlot = 0;
+        uint64_t frameNumber = 0;
+        VkExtent2D extent{};
+        bool bgra = false;
+    };
+
+    void writeLoop();
+
+    void write(const Slot &slot);
+
+    void queueWrite(uint32_t slot);
+
+    std::unique_ptr<Slot[]> _slots;
+    uint32_t _nextSlot = 0;
+    bool _sequence = false;                                   // One file per frame rather than a stream
+    FILE *_stream = nullptr;
+    VkExtent2D _streamExtent{};                               // Of the first frame, the stream can't change size
+    std::thread _writer;
+    std::mutex _mutex;
+    std::condition_variable _wake;                            // For the writer: more work or stop
+    std::condition_variable _written;                         // For a render thread waiting on a free slot
+    std::deque<uint32_t> _queue;
+    std::vector<unsigned char> _pixels;                       // Writer only, the frame in file order
+    bool _stop = false;
+    uint64_t _capturedCount = 0;
+    uint64_t _droppedCount = 0;
+    std::atomic<uint64_t> _writtenCount{0};
+    std::atomic<uint64_t> _failedCount{0};
+};
@@ -0,0 +1,247 @@
+#include "gpu_culling.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include "base.hpp"
+#include "log.hpp"
+#include "scene.hpp"
+
+VkVertexInputBindingDescription GpuInstance::bindingDescription(uint32_t binding) {
+    VkVertexInputBindingDescription description{};
+    description.binding = binding;
+    description.stride = sizeof(GpuInstance);
+    description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return description;
+}
+
+VkVertexInputAttributeDescription GpuInstance::attributeDescription(uint32_t binding, uint32_t location) {
+    VkVertexInputAttributeDescription attribute{};
+    attribute.location = location;
+    attribute.binding = binding;
+    attribute.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attribute.offset = offsetof(GpuInstance, positionScale);
+    return attribute;
+}
+
+void GpuCulling::init(const std::vector<GpuMeshInfo> &meshes, const std::vector<GpuMeshLod> &lods,
+                      const std::vector<GpuInstance> &instances) {
+    if (!_app._gpuDrivenSupported) {
+        throw std::runtime_error("Error: Device lacks the indirect draw features GPU culling needs");
+    }
+    if (meshes.empty() || lods.empty() || instances.empty()) {
+        throw std::runtime_error("Error: GPU culling needs at least one mesh, LOD and instance");
+    }
+    _instanceCount = static_cast<uint32_t>(instances.size());
+
+    // The instance table is read by the culling pass and again as a vertex input by the draws
+    _instanceBuffer = createTable(instances.data(), sizeof(GpuInstance) * instances.size(),
+                                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, _instanceAllocation);
+    _meshBuffer = createTable(meshes.data(), sizeof(GpuMeshInfo) * meshes.size(), 0, _meshAllocation);
+    _lodBuffer = createTable(lods.data(), sizeof(GpuMeshLod) * lods.size(), 0, _lodAllocation);
+
+    _frames.resize(_app._framesInFlight);
+    for (auto &frame : _frames) {
+        frame.drawBuffer = _app._allocator.createBuffer(sizeof(VkDrawIndexedIndirectCommand) * _instanceCount,
+                                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, frame.drawAllocation);
+        frame.countBuffer = _app._allocator.createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                                                         frame.countAllocation);
+    }
+    createPipeline();
+
+    // Identity camera until the app sets one: the clip space box, every distance 0
+    setCamera(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+    info("Success: GPU culling ready for {} instances of {} meshes with {} LODs", _instanceCount, meshes.size(),
+         lods.size());
+}
+
+void GpuCulling::cleanup() {
+    info("Clean up: GPU culling");
+    vkDestroyPipeline(_app._device, _pipeline, _app._allocationCallbacks);
+    vkDestroyPipelineLayout(_app._device, _pipelineLayout, _app._allocationCallbacks);
+    vkDestroyDescriptorPool(_app._device, _descriptorPool, _app._allocationCallbacks);
+    vkDestroyDescriptorSetLayout(_app._device, _descriptorSetLayout, _app._allocationCallbacks);
+    _pipeline = VK_NULL_HANDLE;
+    for (auto &frame : _frames) {
+        _app._allocator.destroyBuffer(frame.drawBuffer, frame.drawAllocation);
+        _app._allocator.destroyBuffer(frame.countBuffer, frame.countAllocation);
+    }
+    _frames.clear();
+    _app._allocator.destroyBuffer(_instanceBuffer, _instanceAllocation);
+    _app._allocator.destroyBuffer(_meshBuffer, _meshAllocation);
+    _app._allocator.destroyBuffer(_lodBuffer, _lodAllocation);
+    _instanceBuffer = _meshBuffer = _lodBuffer = VK_NULL_HANDLE;
+}
+
+void GpuCulling::setCamera(const glm::mat4 &viewProjection, const glm::vec3 &position, float lodScale) {
+    // The same planes the CPU culls the scene against
+    Frustum frustum = Frustum::fromViewProjection(viewProjection);
+    for (int i = 0; i < 6; ++i) {
+        _params.planes[i] = frustum.planes[i];
+    }
+    _params.cameraPosition = glm::vec4(position.x, position.y, position.z, lodScale);
+    _params.instanceCount = _instanceCount;
+    _params.maxDraws = _instanceCount;
+}
+
+void GpuCulling::recordCulling(VkCommandBuffer commandBuffer, uint32_t frameSlot) {
+    FrameDraws &frame = _frames[frameSlot];
+    GpuScope scope(_app._profiler, commandBuffer, "gpu culling");
+
+    // The slot's fence has signalled, so last time's indirect draws are done with these buffers
+    vkCmdFillBuffer(commandBuffer, frame.countBuffer, 0, sizeof(uint32_t), 0);
+    VkBufferMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    clearBarrier.buffer = frame.countBuffer;
+    clearBarrier.offset = 0;
+    clearBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                         nullptr, 1, &clearBarrier, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1,
+                            &frame.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &_params);
+    vkCmdDispatch(commandBuffer, (_instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    VkBufferMemoryBarrier drawBarriers[2]{};
+    for (auto &barrier : drawBarriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+    }
+    drawBarriers[0].buffer = frame.drawBuffer;
+    drawBarriers[1].buffer = frame.countBuffer;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+                         0, nullptr, 2, drawBarriers, 0, nullptr);
+}
+
+void GpuCulling::recordDraws(VkCommandBuffer commandBuffer, uint32_t frameSlot) {
+    const FrameDraws &frame = _frames[frameSlot];
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &_instanceBuffer, &offset);
+    vkCmdDrawIndexedIndirectCount(commandBuffer, frame.drawBuffer, 0, frame.countBuffer, 0, _instanceCount,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+}
+
+VkBuffer GpuCulling::createTable(const void *data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                 Allocation &allocation) {
+    VkBuffer buffer = _app._allocator.createBuffer(size, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocation);
+    VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+        dstStages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        dstAccess |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    }
+    _app._uploadQueue.uploadBuffer(buffer, 0, data, size, dstStages, dstAccess);
+    return buffer;
+}
+
+void GpuCulling::createPipeline() {
+    // Instances, meshes, LODs, draw commands, draw count
+    const uint32_t bindingCount = 5;
+    VkDescriptorSetLayoutBinding bindings[bindingCount]{};
+    for (uint32_t i = 0; i < bindingCount; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(_app._device, &layoutInfo, _app._allocationCallbacks, &_descriptorSetLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create culling descriptor set layout");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = bindingCount * static_cast<uint32_t>(_frames.size());
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = static_cast<uint32_t>(_frames.size());
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(_app._device, &poolInfo, _app._allocationCallbacks, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create culling descriptor pool");
+    }
+
+    // The tables are shared, only the draw commands and count differ between frame slots
+    for (auto &frame : _frames) {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = _descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(_app._device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not allocate culling descriptor set");
+        }
+        VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+                {_instanceBuffer, 0, VK_WHOLE_SIZE},
+                {_meshBuffer, 0, VK_WHOLE_SIZE},
+                {_lodBuffer, 0, VK_WHOLE_SIZE},
+                {frame.drawBuffer, 0, VK_WHOLE_SIZE},
+                {frame.countBuffer, 0, VK_WHOLE_SIZE},
+        };
+        VkWriteDescriptorSet writes[bindingCount]{};
+        for (uint32_t i = 0; i < bindingCount; ++i) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = frame.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(_app._device, bindingCount, writes, 0, nullptr);
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullParams);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_app._device, &pipelineLayoutInfo, _app._allocationCallbacks, &_pipelineLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create culling pipeline layout");
+    }
+
+    VkShaderModule shaderModule = BasePipeline::loadShaderModule(_app, SHADER);
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkCreateComputePipelines(_app._device, _app._pipelineCache._cache, 1, &pipelineInfo,
+                                               _app._allocationCallbacks, &_pipeline);
+    vkDestroyShaderModule(_app._device, shaderModule, _app._allocationCallbacks);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to create culling compute pipeline");
+    }
+    double createMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    _app._pipelineCache.recordCreation(createMs);
+    info("Success: Created culling compute pipeline in {:.3f} ms", createMs);
+}
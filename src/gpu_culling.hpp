@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+
+class BaseApplication;
+
+// std430 layouts shared with shaders/003_cull.comp.glsl, each one 16 byte aligned
+
+// Also a per-instance vertex input, see shaders/003_instanced.vert.glsl
+struct GpuInstance {
+    glm::vec4 positionScale;                                  // xyz world position, w uniform scale
+    uint32_t mesh = 0;                                        // Index into the mesh table
+    uint32_t padding[3]{};
+
+    static VkVertexInputBindingDescription bindingDescription(uint32_t binding);
+
+    static VkVertexInputAttributeDescription attributeDescription(uint32_t binding, uint32_t location);
+};
+
+struct GpuMeshInfo {
+    float boundingRadius;                                     // Around the mesh origin, before the instance scale
+    uint32_t firstLod;
+    uint32_t lodCount;
+    uint32_t padding = 0;
+};
+
+// A range of the scene's shared index buffer. LODs of a mesh go from most to least detailed.
+struct GpuMeshLod {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    float maxDistance;                                        // Used up to this distance, ignored on the last LOD
+};
+
+// GPU-driven drawing of a static instance list. A compute pass culls every instance's bounding sphere against the
+// frustum, picks a LOD and appends an indirect draw per survivor; one vkCmdDrawIndexedIndirectCount then draws them
+// all, so the CPU cost per frame doesn't depend on the instance count. Every mesh shares one vertex and one index
+// buffer, bound by the caller. Draw commands and count live per frame slot, so frames in flight never share them.
+class GpuCulling {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;            // local_size_x of the culling shader
+    static constexpr uint32_t INSTANCE_BINDING = 1;           // Vertex binding of the instance buffer
+    static constexpr const char *SHADER = "shaders/003_cull.comp.spv";
+
+    BaseApplication &_app;
+    uint32_t _instanceCount = 0;
+
+    explicit GpuCulling(BaseApplication &app) : _app(app) {}
+
+    // Queues the uploads of the tables and creates the culling pipeline. Needs the device's drawIndirectCount,
+    // multiDrawIndirect and drawIndirectFirstInstance features, see BaseApplication::_gpuDrivenSupported.
+    void init(const std::vector<GpuMeshInfo> &meshes, const std::vector<GpuMeshLod> &lods,
+              const std::vector<GpuInstance> &instances);
+
+    void cleanup();
+
+    [[nodiscard]] bool isReady() const { return _pipeline != VK_NULL_HANDLE; }
+
+    // Planes come out of the view-projection matrix (Vulkan clip space, depth 0..1). Distances to `position` are
+    // multiplied by `lodScale` before they are compared with GpuMeshLod::maxDistance.
+    void setCamera(const glm::mat4 &viewProjection, const glm::vec3 &position, float lodScale = 1.0f);
+
+    // Outside any render pass, before the draws of the same frame
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+    // Inside the render pass with the graphics pipeline and the shared vertex/index buffers bound
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+private:
+    struct CullParams {
+        glm::vec4 planes[6];
+        glm::vec4 cameraPosition;                             // w is the LOD distance scale
+        uint32_t instanceCount;
+        uint32_t maxDraws;
+    };
+
+    struct FrameDraws {
+        VkBuffer drawBuffer{};
+        Allocation drawAllocation;
+        VkBuffer countBuffer{};
+        Allocation countAllocation;
+        VkDescriptorSet descriptorSet{};
+    };
+
+    VkBuffer createTable(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, Allocation &allocation);
+
+    void createPipeline();
+
+    CullParams _params{};
+    VkBuffer _instanceBuffer{};
+    Allocation _instanceAllocation;
+    VkBuffer _meshBuffer{};
+    Allocation _meshAllocation;
+    VkBuffer _lodBuffer{};
+    Allocation _lodAllocation;
+    std::vector<FrameDraws> _frames;
+    VkDescriptorSetLayout _descriptorSetLayout{};
+    VkDescriptorPool _descriptorPool{};
+    VkPipelineLayout _pipelineLayout{};
+    VkPipeline _pipeline{};
+};
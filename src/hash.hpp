@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+// FNV-1a 64. Continues from `value`, so a hash can be built up over several calls.
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t value = FNV1A_OFFSET_BASIS) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        value ^= bytes[i];
+        value *= 0x100000001b3ull;
+    }
+    return value;
+}
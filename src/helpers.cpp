@@ -5,16 +5,20 @@
 #include "log.hpp"
 #include "base.hpp"
 
-std::vector<char> readFile(const std::string& filename) {
+std::vector<uint32_t> readSpirvFile(const std::string& filename) {
+    // Read straight into uint32_t storage so the words are aligned for vkCreateShaderModule
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
     info("\t Opening file {}", filename);
     if (!file.is_open()) {
         throw std::runtime_error("Error: Failed to open file. Did you compile the shader?");
     }
     size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize);
+    if (fileSize % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("Error: " + filename + " is not valid SPIR-V");
+    }
+    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
     file.seekg(0);
-    file.read(buffer.data(), fileSize);
+    file.read(reinterpret_cast<char *>(buffer.data()), fileSize);
     file.close();
     return buffer;
 }
@@ -40,10 +44,13 @@ bool checkValidationLayerSupport(BaseApplication *app) {
 }
 
 void getGenericRequiredExtensions(BaseApplication *app) {
-    // glfw extensions
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    // glfw extensions (headless has no window system, so no surface extensions either)
+    if (!app->_headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     if (app->enableValidation_) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -85,7 +92,7 @@ void createGenericVkInstance(const char *appName, BaseApplication *app) {
     createInfo.ppEnabledExtensionNames = app->_extensions.data();
     // Global Validation Layers
     createInfo.enabledLayerCount = 0;
-    VkResult result = vkCreateInstance(&createInfo, nullptr, &app->_instance);
+    VkResult result = vkCreateInstance(&createInfo, app->_allocationCallbacks, &app->_instance);
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Error: Failed to create instance");
     }
@@ -1,10 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
 class BaseApplication;
-std::vector<char> readFile(const std::string& filename);
+std::vector<uint32_t> readSpirvFile(const std::string& filename);
 bool checkValidationLayerSupport(BaseApplication *app);
 void getGenericRequiredExtensions(BaseApplication *app);
 void createGenericVkInstance(const char *appName, BaseApplication *app);
@@ -0,0 +1,200 @@
+#include "host_allocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "log.hpp"
+
+HostAllocator::HostAllocator() {
+    _callbacks.pUserData = this;
+    _callbacks.pfnAllocation = onAllocation;
+    _callbacks.pfnReallocation = onReallocation;
+    _callbacks.pfnFree = onFree;
+    _callbacks.pfnInternalAllocation = onInternalAllocation;
+    _callbacks.pfnInternalFree = onInternalFree;
+}
+
+HostScopeStats HostAllocator::stats(VkSystemAllocationScope scope) const {
+    const ScopeCounters &counters = _scopes[scope];
+    HostScopeStats stats;
+    stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.frees = counters.frees.load(std::memory_order_relaxed);
+    stats.internalBytes = counters.internalBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HostAllocator::markFrameLoop() {
+    for (size_t scope = 0; scope < SCOPE_COUNT; ++scope) {
+        _markedAllocations[scope] = _scopes[scope].allocations.load(std::memory_order_relaxed);
+    }
+}
+
+void HostAllocator::report(uint64_t frames) const {
+    for (size_t i = 0; i < SCOPE_COUNT; ++i) {
+        auto scope = static_cast<VkSystemAllocationScope>(i);
+        HostScopeStats scopeStats = stats(scope);
+        if (scopeStats.allocations == 0 && scopeStats.internalBytes == 0) {
+            continue;
+        }
+        double perFrame = frames == 0 ? 0.0 : double(scopeStats.allocations - _markedAllocations[i]) / double(frames);
+        info("Host allocations, {} scope: {:.1f} KB live, {:.1f} KB peak, {} allocations, {} frees, {:.2f} "
+             "allocations per frame, {:.1f} KB internal", scopeName(scope), scopeStats.liveBytes / 1024.0,
+             scopeStats.peakBytes / 1024.0, scopeStats.allocations, scopeStats.frees, perFrame,
+             scopeStats.internalBytes / 1024.0);
+    }
+}
+
+const char *HostAllocator::scopeName(VkSystemAllocationScope scope) {
+    switch (scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+            return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+            return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+            return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+            return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+            return "instance";
+        default:
+            return "unknown";
+    }
+}
+
+void *HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+    // Failures return nullptr, the driver turns that into VK_ERROR_OUT_OF_HOST_MEMORY
+    size_t needed = size + HEADER_SIZE;
+    void *memory;
+    if (alignment <= 16 && needed <= (MIN_CLASS_SIZE << (CLASS_COUNT - 1))) {
+        uint32_t sizeClass = 0;
+        while ((MIN_CLASS_SIZE << sizeClass) < needed) {
+            ++sizeClass;
+        }
+        void *block = allocateBlock(sizeClass);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        memory = static_cast<char *>(block) + HEADER_SIZE;
+        header(memory)->base = block;
+        header(memory)->sizeClass = sizeClass;
+    } else {
+        size_t align = std::max<size_t>(alignment, 16);
+        void *base = ::operator new(needed + align, std::nothrow);
+        if (base == nullptr) {
+            return nullptr;
+        }
+        uintptr_t address = (reinterpret_cast<uintptr_t>(base) + HEADER_SIZE + align - 1) & ~uintptr_t(align - 1);
+        memory = reinterpret_cast<void *>(address);
+        header(memory)->base = base;
+        header(memory)->sizeClass = LARGE;
+    }
+    header(memory)->size = size;
+    header(memory)->scope = static_cast<uint32_t>(scope);
+    _scopes[scope].allocations.fetch_add(1, std::memory_order_relaxed);
+    count(scope, static_cast<int64_t>(size));
+    return memory;
+}
+
+void *HostAllocator::reallocate(void *original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (original == nullptr) {
+        return allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        free(original);
+        return nullptr;
+    }
+    Header *originalHeader = header(original);
+    // Growing or shrinking within the block it already has
+    if (originalHeader->sizeClass != LARGE && alignment <= 16 &&
+        size + HEADER_SIZE <= (MIN_CLASS_SIZE << originalHeader->sizeClass)) {
+        _scopes[originalHeader->scope].allocations.fetch_add(1, std::memory_order_relaxed);
+        count(originalHeader->scope, static_cast<int64_t>(size) - static_cast<int64_t>(originalHeader->size));
+        originalHeader->size = size;
+        return original;
+    }
+    // On failure the original has to stay valid
+    void *memory = allocate(size, alignment, scope);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    std::memcpy(memory, original, std::min(size, originalHeader->size));
+    free(original);
+    return memory;
+}
+
+void HostAllocator::free(void *memory) {
+    if (memory == nullptr) {
+        return;
+    }
+    Header *memoryHeader = header(memory);
+    _scopes[memoryHeader->scope].frees.fetch_add(1, std::memory_order_relaxed);
+    count(memoryHeader->scope, -static_cast<int64_t>(memoryHeader->size));
+    if (memoryHeader->sizeClass == LARGE) {
+        ::operator delete(memoryHeader->base);
+        return;
+    }
+    SizeClass &sizeClass = _classes[memoryHeader->sizeClass];
+    void *block = memoryHeader->base;
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    *static_cast<void **>(block) = sizeClass.freeList;
+    sizeClass.freeList = block;
+}
+
+void *HostAllocator::allocateBlock(uint32_t sizeClass) {
+    SizeClass &pool = _classes[sizeClass];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.freeList == nullptr) {
+        size_t blockSize = MIN_CLASS_SIZE << sizeClass;
+        std::unique_ptr<unsigned char[]> chunk(new(std::nothrow) unsigned char[CHUNK_SIZE]);
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        for (size_t offset = 0; offset + blockSize <= CHUNK_SIZE; offset += blockSize) {
+            void *block = chunk.get() + offset;
+            *static_cast<void **>(block) = pool.freeList;
+            pool.freeList = block;
+        }
+        pool.chunks.push_back(std::move(chunk));
+    }
+    void *block = pool.freeList;
+    pool.freeList = *static_cast<void **>(block);
+    return block;
+}
+
+void HostAllocator::count(uint32_t scope, int64_t bytes) {
+    ScopeCounters &counters = _scopes[scope];
+    uint64_t live = counters.liveBytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed) +
+                    static_cast<uint64_t>(bytes);
+    uint64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void *VKAPI_PTR HostAllocator::onAllocation(void *userData, size_t size, size_t alignment,
+                                            VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator *>(userData)->allocate(size, alignment, scope);
+}
+
+void *VKAPI_PTR HostAllocator::onReallocation(void *userData, void *original, size_t size, size_t alignment,
+                                              VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator *>(userData)->reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_PTR HostAllocator::onFree(void *userData, void *memory) {
+    static_cast<HostAllocator *>(userData)->free(memory);
+}
+
+void VKAPI_PTR HostAllocator::onInternalAllocation(void *userData, size_t size, VkInternalAllocationType type,
+                                                   VkSystemAllocationScope scope) {
+    static_cast<HostAllocator *>(userData)->_scopes[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_PTR HostAllocator::onInternalFree(void *userData, size_t size, VkInternalAllocationType type,
+                                             VkSystemAllocationScope scope) {
+    static_cast<HostAllocator *>(userData)->_scopes[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct HostScopeStats {
+    uint64_t liveBytes = 0;
+    uint64_t peakBytes = 0;
+    uint64_t allocations = 0;                                 // Allocation and reallocation calls, not frees
+    uint64_t frees = 0;
+    uint64_t internalBytes = 0;                               // Driver allocations reported through the notifications
+};
+
+// VkAllocationCallbacks that take the driver's host allocations off malloc. Small requests come from per size class
+// free lists carved out of 64 KB chunks that are only returned at exit, big or overaligned ones go to operator new.
+// Every allocation is counted under its VkSystemAllocationScope, so live and peak bytes and the allocation rate of
+// each scope can be watched, e.g. to find command scope allocations that happen every frame.
+//
+// Opt-in: set _enabled before the app's run(), everything the app creates then passes callbacks() (through
+// BaseApplication::_allocationCallbacks). It has to stay enabled or disabled for the lifetime of the instance.
+class HostAllocator {
+public:
+    static constexpr size_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    bool _enabled = false;
+
+    HostAllocator();
+
+    HostAllocator(const HostAllocator &) = delete;
+
+    HostAllocator &operator=(const HostAllocator &) = delete;
+
+    // nullptr when disabled, so the driver keeps its own allocator
+    [[nodiscard]] const VkAllocationCallbacks *callbacks() const { return _enabled ? &_callbacks : nullptr; }
+
+    [[nodiscard]] HostScopeStats stats(VkSystemAllocationScope scope) const;
+
+    // Remembers the counts, report() then also gives the allocations per frame since
+    void markFrameLoop();
+
+    void report(uint64_t frames) const;
+
+    static const char *scopeName(VkSystemAllocationScope scope);
+
+private:
+    static constexpr size_t HEADER_SIZE = 32;                 // Keeps pool allocations 16 byte aligned
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MIN_CLASS_SIZE = 64;              // Header included
+    static constexpr size_t CLASS_COUNT = 7;                  // 64 bytes to 4 KB, powers of two
+    static constexpr uint32_t LARGE = UINT32_MAX;
+
+    // In front of every allocation
+    struct Header {
+        void *base;                                           // What operator new returned, large allocations only
+        size_t size;
+        uint32_t sizeClass;
+        uint32_t scope;
+    };
+
+    struct SizeClass {
+        std::mutex mutex;
+        void *freeList = nullptr;                             // Each free block holds the next pointer
+        std::vector<std::unique_ptr<unsigned char[]>> chunks;
+    };
+
+    struct ScopeCounters {
+        std::atomic<uint64_t> liveBytes{0};
+        std::atomic<uint64_t> peakBytes{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> internalBytes{0};
+    };
+
+    void *allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+    void *reallocate(void *original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+    void free(void *memory);
+
+    void *allocateBlock(uint32_t sizeClass);
+
+    void count(uint32_t scope, int64_t bytes);
+
+    static Header *header(void *memory) {
+        return reinterpret_cast<Header *>(static_cast<char *>(memory) - HEADER_SIZE);
+    }
+
+    static void *VKAPI_PTR onAllocation(void *userData, size_t size, size_t alignment,
+                                        VkSystemAllocationScope scope);
+
+    static void *VKAPI_PTR onReallocation(void *userData, void *original, size_t size, size_t alignment,
+                                          VkSystemAllocationScope scope);
+
+    static void VKAPI_PTR onFree(void *userData, void *memory);
+
+    static void VKAPI_PTR onInternalAllocation(void *userData, size_t size, VkInternalAllocationType type,
+                                               VkSystemAllocationScope scope);
+
+    static void VKAPI_PTR onInternalFree(void *userData, size_t size, VkInternalAllocationType type,
+                                         VkSystemAllocationScope scope);
+
+    VkAllocationCallbacks _callbacks{};
+    std::array<SizeClass, CLASS_COUNT> _classes;
+    std::array<ScopeCounters, SCOPE_COUNT> _scopes;
+    std::array<uint64_t, SCOPE_COUNT> _markedAllocations{};
+};
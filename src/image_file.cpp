@@ -0,0 +1,213 @@
+#include "image_file.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include "mapped_file.hpp"
+
+namespace {
+    // Reads one whitespace separated number of a PPM header, skipping comments
+    bool readPpmNumber(const unsigned char *data, size_t size, size_t &position, uint32_t &value) {
+        while (position < size) {
+            if (data[position] == '#') {
+                while (position < size && data[position] != '\n') {
+                    ++position;
+                }
+            } else if (std::isspace(data[position])) {
+                ++position;
+            } else {
+                break;
+            }
+        }
+        if (position >= size || !std::isdigit(data[position])) {
+            return false;
+        }
+        value = 0;
+        while (position < size && std::isdigit(data[position])) {
+            value = value * 10 + (data[position++] - '0');
+            if (value > 65535) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool loadPpm(const MappedFile &file, ImageData &image, std::string &error) {
+        const unsigned char *data = file.data();
+        size_t position = 2;
+        uint32_t maxValue = 0;
+        if (!readPpmNumber(data, file.size(), position, image.width) ||
+            !readPpmNumber(data, file.size(), position, image.height) ||
+            !readPpmNumber(data, file.size(), position, maxValue)) {
+            error = "bad PPM header";
+            return false;
+        }
+        if (maxValue == 0 || maxValue > 255) {
+            error = "only 8 bit PPM is supported";
+            return false;
+        }
+        // Exactly one whitespace character separates the header from the pixels
+        ++position;
+        size_t texels = size_t(image.width) * image.height;
+        if (image.width == 0 || image.height == 0 || position + texels * 3 > file.size()) {
+            error = "PPM pixel data is truncated";
+            return false;
+        }
+        image.pixels.resize(texels * 4);
+        const unsigned char *source = data + position;
+        for (size_t i = 0; i < texels; ++i) {
+            for (size_t channel = 0; channel < 3; ++channel) {
+                image.pixels[i * 4 + channel] = static_cast<unsigned char>(source[i * 3 + channel] * 255 / maxValue);
+            }
+            image.pixels[i * 4 + 3] = 255;
+        }
+        return true;
+    }
+
+    bool loadTga(const MappedFile &file, ImageData &image, std::string &error) {
+        const unsigned char *data = file.data();
+        if (file.size() < 18) {
+            error = "bad TGA header";
+            return false;
+        }
+        uint32_t idLength = data[0];
+        uint32_t colorMapType = data[1];
+        uint32_t imageType = data[2];
+        uint32_t colorMapLength = data[5] | (data[6] << 8);
+        uint32_t colorMapEntryBits = data[7];
+        image.width = data[12] | (data[13] << 8);
+        image.height = data[14] | (data[15] << 8);
+        uint32_t bitsPerPixel = data[16];
+        bool topDown = (data[17] & 0x20) != 0;
+        bool rle = imageType == 10 || imageType == 11;
+        bool gray = imageType == 3 || imageType == 11;
+        if (imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11) {
+            error = "only true-color and grayscale TGA are supported";
+            return false;
+        }
+        if ((gray && bitsPerPixel != 8) || (!gray && bitsPerPixel != 24 && bitsPerPixel != 32)) {
+            error = "unsupported TGA pixel size";
+            return false;
+        }
+        uint32_t bytesPerPixel = bitsPerPixel / 8;
+        // A color map may be there even when unused
+        size_t position = 18 + idLength + (colorMapType == 1 ? colorMapLength * ((colorMapEntryBits + 7) / 8) : 0);
+        size_t texels = size_t(image.width) * image.height;
+        if (texels == 0) {
+            error = "empty TGA";
+            return false;
+        }
+        image.pixels.resize(texels * 4);
+
+        auto writeTexel = [&](size_t index, const unsigned char *texel) {
+            // Rows are stored bottom to top unless the descriptor says otherwise
+            size_t x = index % image.width;
+            size_t y = index / image.width;
+            size_t row = topDown ? y : image.height - 1 - y;
+            unsigned char *target = &image.pixels[(row * image.width + x) * 4];
+            if (gray) {
+                target[0] = target[1] = target[2] = texel[0];
+                target[3] = 255;
+            } else {
+                target[0] = texel[2];
+                target[1] = texel[1];
+                target[2] = texel[0];
+                target[3] = bytesPerPixel == 4 ? texel[3] : 255;
+            }
+        };
+
+        size_t index = 0;
+        while (index < texels) {
+            uint32_t count = 1;
+            bool repeat = false;
+            if (rle) {
+                if (position >= file.size()) {
+                    break;
+                }
+                uint32_t packet = data[position++];
+                count = (packet & 0x7f) + 1;
+                repeat = (packet & 0x80) != 0;
+            }
+            count = static_cast<uint32_t>(std::min<size_t>(count, texels - index));
+            size_t packetBytes = size_t(repeat ? 1 : count) * bytesPerPixel;
+            if (position + packetBytes > file.size()) {
+                break;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                writeTexel(index++, data + position + (repeat ? 0 : i * bytesPerPixel));
+            }
+            position += packetBytes;
+        }
+        if (index < texels) {
+            error = "TGA pixel data is truncated";
+            return false;
+        }
+        return true;
+    }
+
+    const std::array<float, 256> &srgbToLinear() {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> values{};
+            for (size_t i = 0; i < values.size(); ++i) {
+                float c = float(i) / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    unsigned char linearToSrgb(float c) {
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+bool loadImageFile(const std::string &path, ImageData &image, std::string &error) {
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "could not open the file";
+        return false;
+    }
+    image = ImageData{};
+    if (file.size() >= 2 && file.data()[0] == 'P' && file.data()[1] == '6') {
+        return loadPpm(file, image, error);
+    }
+    // TGA has no magic number, so anything else is tried as one
+    return loadTga(file, image, error);
+}
+
+ImageData downsampleImage(const ImageData &image) {
+    const std::array<float, 256> &toLinear = srgbToLinear();
+    ImageData half;
+    half.width = std::max(image.width / 2, 1u);
+    half.height = std::max(image.height / 2, 1u);
+    half.pixels.resize(half.byteSize());
+    for (uint32_t y = 0; y < half.height; ++y) {
+        // Odd sizes repeat the last row or column
+        uint32_t y0 = std::min(y * 2, image.height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, image.height - 1);
+        for (uint32_t x = 0; x < half.width; ++x) {
+            uint32_t x0 = std::min(x * 2, image.width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, image.width - 1);
+            const unsigned char *texels[4] = {
+                    &image.pixels[(size_t(y0) * image.width + x0) * 4],
+                    &image.pixels[(size_t(y0) * image.width + x1) * 4],
+                    &image.pixels[(size_t(y1) * image.width + x0) * 4],
+                    &image.pixels[(size_t(y1) * image.width + x1) * 4],
+            };
+            unsigned char *target = &half.pixels[(size_t(y) * half.width + x) * 4];
+            for (size_t channel = 0; channel < 3; ++channel) {
+                float sum = 0.0f;
+                for (const unsigned char *texel : texels) {
+                    sum += toLinear[texel[channel]];
+                }
+                target[channel] = linearToSrgb(sum * 0.25f);
+            }
+            // Alpha isn't sRGB encoded
+            target[3] = static_cast<unsigned char>((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+        }
+    }
+    return half;
+}
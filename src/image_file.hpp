@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8 bit RGBA, rows top to bottom, sRGB encoded
+struct ImageData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<unsigned char> pixels;
+
+    [[nodiscard]] size_t byteSize() const { return size_t(width) * height * 4; }
+};
+
+// Binary PPM (P6 with a maxval up to 255) and true-color or grayscale TGA, uncompressed or RLE. Returns false with
+// `error` set for anything else.
+bool loadImageFile(const std::string &path, ImageData &image, std::string &error);
+
+// Half the size in each dimension, at least 1, averaging 2x2 blocks in linear space
+ImageData downsampleImage(const ImageData &image);
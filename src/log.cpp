@@ -0,0 +1,133 @@
+#include "log.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Bounded multi-producer ring, single consumer. A slot's sequence says whose turn it is: equal to the enqueue
+    // position it is free for that producer, one past it the message is ready for the writer.
+    std::array<logging::detail::Slot, logging::RING_SIZE> ring;
+    std::atomic<uint64_t> enqueuePosition{0};
+    uint64_t dequeuePosition = 0;                             // Writer only
+    std::atomic<uint64_t> droppedCount{0};
+    std::atomic<bool> writerRunning{false};
+    std::atomic<uint32_t> producers{0};                       // Between enter() and publish() or leave()
+    std::thread writer;
+    std::mutex wakeMutex;
+    std::condition_variable wake;                             // Warnings wake the writer early, or stop() does
+
+    // Hands everything ready to spdlog, returns whether there was anything
+    bool drain() {
+        spdlog::logger *logger = spdlog::default_logger_raw();
+        bool wrote = false;
+        while (true) {
+            logging::detail::Slot &slot = ring[dequeuePosition & (logging::RING_SIZE - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+                break;
+            }
+            logger->log(slot.time, spdlog::source_loc{}, slot.level, spdlog::string_view_t(slot.text, slot.size));
+            slot.sequence.store(dequeuePosition + logging::RING_SIZE, std::memory_order_release);
+            ++dequeuePosition;
+            wrote = true;
+        }
+        return wrote;
+    }
+
+    void writeLoop() {
+        uint64_t reportedDrops = 0;
+        while (writerRunning.load(std::memory_order_acquire)) {
+            if (drain()) {
+                spdlog::default_logger_raw()->flush();
+            } else {
+                // Producers never lock, so this polls. A millisecond keeps the console current at no real cost.
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            uint64_t drops = droppedCount.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                spdlog::default_logger_raw()->warn("Dropped {} log messages, the ring was full", drops - reportedDrops);
+                reportedDrops = drops;
+            }
+        }
+        // Producers that got in before stop() may not have published yet. New ones log synchronously, so this ends.
+        while (producers.load() != 0) {
+            drain();
+            std::this_thread::yield();
+        }
+        drain();
+        spdlog::default_logger_raw()->flush();
+    }
+}
+
+namespace logging {
+    void start() {
+        if (writerRunning.load()) {
+            return;
+        }
+        for (size_t i = 0; i < RING_SIZE; ++i) {
+            ring[i].sequence.store(enqueuePosition.load() + i, std::memory_order_relaxed);
+        }
+        dequeuePosition = enqueuePosition.load();
+        writerRunning.store(true, std::memory_order_release);
+        writer = std::thread(writeLoop);
+    }
+
+    void stop() {
+        if (!writerRunning.exchange(false)) {
+            return;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    uint64_t dropped() {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+    namespace detail {
+        bool enter() {
+            // Both sequentially consistent: either stop() sees this producer, or this producer sees stop()
+            producers.fetch_add(1);
+            if (!writerRunning.load()) {
+                producers.fetch_sub(1);
+                return false;
+            }
+            return true;
+        }
+
+        void leave() {
+            producers.fetch_sub(1, std::memory_order_release);
+        }
+
+        Slot *acquire() {
+            uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+            while (true) {
+                Slot &slot = ring[position & (RING_SIZE - 1)];
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<int64_t>(sequence - position);
+                if (difference == 0) {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        return &slot;
+                    }
+                } else if (difference < 0) {
+                    // The writer hasn't freed it yet, one lap behind
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                } else {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void publish(Slot *slot) {
+            uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+            slot->sequence.store(sequence + 1, std::memory_order_release);
+            if (slot->level >= spdlog::level::warn) {
+                wake.notify_one();
+            }
+            leave();
+        }
+    }
+}
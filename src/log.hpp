@@ -1,5 +1,169 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <spdlog/spdlog.h>
 
-using namespace spdlog;
\ No newline at end of file
+// trace(), debug(), info() and warn() format on the calling thread straight into a slot of a lock-free ring. Between
+// logging::start() and logging::stop() a background thread hands the slots to spdlog's default logger, so the caller
+// never takes a lock or waits on the console. A full ring drops the message, counted, rather than stall a frame.
+// Outside start/stop they log synchronously.
+//
+// The LOG_* macros are removed at compile time, arguments included, below SPDLOG_ACTIVE_LEVEL (trace in Debug builds,
+// info otherwise, see CMakeLists.txt). Code that runs every frame uses LOG_FRAME_*, which also log at most once per
+// FRAME_LOG_INTERVAL per call site.
+namespace logging {
+    constexpr size_t RING_SIZE = 1024;                        // Slots, a power of two
+    constexpr size_t MESSAGE_SIZE = 496;                      // Longer messages are cut
+    constexpr std::chrono::nanoseconds FRAME_LOG_INTERVAL = std::chrono::seconds(1);
+
+    // Starts the writer thread
+    void start();
+
+    // Writes what is left and joins the writer. Threads still logging afterwards log synchronously.
+    void stop();
+
+    // Messages lost to a full ring so far
+    [[nodiscard]] uint64_t dropped();
+
+    // Logs asynchronously for its lifetime. First thing in main(), so it outlives everything that logs.
+    class AsyncScope {
+    public:
+        AsyncScope() { start(); }
+
+        ~AsyncScope() { stop(); }
+
+        AsyncScope(const AsyncScope &) = delete;
+
+        AsyncScope &operator=(const AsyncScope &) = delete;
+    };
+
+    namespace detail {
+        struct Slot {
+            std::atomic<uint64_t> sequence{0};
+            spdlog::log_clock::time_point time;
+            spdlog::level::level_enum level = spdlog::level::info;
+            uint32_t size = 0;
+            char text[MESSAGE_SIZE];
+        };
+
+        // Counts the caller as a producer while the writer runs, until publish() or leave(). False once stop() has
+        // begun, then the caller logs synchronously.
+        [[nodiscard]] bool enter();
+
+        void leave();
+
+        // A free slot to format into, nullptr when the ring is full
+        Slot *acquire();
+
+        // Also leaves
+        void publish(Slot *slot);
+    }
+
+    template<typename... Args>
+    void log(spdlog::level::level_enum level, spdlog::format_string_t<Args...> format, Args &&...args) {
+        spdlog::logger *logger = spdlog::default_logger_raw();
+        if (!logger->should_log(level)) {
+            return;
+        }
+        if (!detail::enter()) {
+            logger->log(level, format, std::forward<Args>(args)...);
+            return;
+        }
+        detail::Slot *slot = detail::acquire();
+        if (slot == nullptr) {
+            detail::leave();
+            return;
+        }
+        auto result = fmt::format_to_n(slot->text, MESSAGE_SIZE, format, std::forward<Args>(args)...);
+        slot->size = static_cast<uint32_t>(std::min(result.size, MESSAGE_SIZE));
+        if (result.size > MESSAGE_SIZE) {
+            std::memcpy(slot->text + MESSAGE_SIZE - 3, "...", 3);
+        }
+        slot->time = spdlog::log_clock::now();
+        slot->level = level;
+        detail::publish(slot);
+    }
+
+    // Lets one call through per interval and counts the ones it turned away
+    class RateLimit {
+    public:
+        bool allow(std::chrono::nanoseconds interval, uint64_t &suppressed) {
+            int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+            int64_t next = _next.load(std::memory_order_relaxed);
+            if (now < next ||
+                !_next.compare_exchange_strong(next, now + interval.count(), std::memory_order_relaxed)) {
+                _suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+
+    private:
+        std::atomic<int64_t> _next{0};
+        std::atomic<uint64_t> _suppressed{0};
+    };
+}
+
+template<typename... Args>
+void trace(spdlog::format_string_t<Args...> format, Args &&...args) {
+    logging::log(spdlog::level::trace, format, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+void debug(spdlog::format_string_t<Args...> format, Args &&...args) {
+    logging::log(spdlog::level::debug, format, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+void info(spdlog::format_string_t<Args...> format, Args &&...args) {
+    logging::log(spdlog::level::info, format, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+void warn(spdlog::format_string_t<Args...> format, Args &&...args) {
+    logging::log(spdlog::level::warn, format, std::forward<Args>(args)...);
+}
+
+#define LOG_RATE_LIMITED(level, ...)                                                                              \
+    do {                                                                                                          \
+        static logging::RateLimit logRateLimit;                                                                   \
+        uint64_t logSuppressed = 0;                                                                               \
+        if (logRateLimit.allow(logging::FRAME_LOG_INTERVAL, logSuppressed)) {                                     \
+            logging::log(level, __VA_ARGS__);                                                                     \
+            if (logSuppressed != 0) {                                                                             \
+                logging::log(level, "\t ({} more like the above since it was last logged)", logSuppressed);       \
+            }                                                                                                     \
+        }                                                                                                         \
+    } while (0)
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define LOG_TRACE(...) logging::log(spdlog::level::trace, __VA_ARGS__)
+#define LOG_FRAME_TRACE(...) LOG_RATE_LIMITED(spdlog::level::trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) (void) 0
+#define LOG_FRAME_TRACE(...) (void) 0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logging::log(spdlog::level::debug, __VA_ARGS__)
+#define LOG_FRAME_DEBUG(...) LOG_RATE_LIMITED(spdlog::level::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) (void) 0
+#define LOG_FRAME_DEBUG(...) (void) 0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define LOG_INFO(...) logging::log(spdlog::level::info, __VA_ARGS__)
+#define LOG_FRAME_INFO(...) LOG_RATE_LIMITED(spdlog::level::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) (void) 0
+#define LOG_FRAME_INFO(...) (void) 0
+#endif
+
+#define LOG_WARN(...) logging::log(spdlog::level::warn, __VA_ARGS__)
+#define LOG_FRAME_WARN(...) LOG_RATE_LIMITED(spdlog::level::warn, __VA_ARGS__)
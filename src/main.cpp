@@ -1,15 +1,57 @@
 #include "log.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
 #include "example/helloworld.hpp"
 
-int main() {
+int main(int argc, char **argv) {
+    logging::AsyncScope asyncLogging;                         // Declared first, the app logs while it is destroyed
     HelloWorldApplication app;
+    for (int i = 1; i < argc; ++i) {
+        // No window or surface, renders offscreen. Works on CPU drivers such as lavapipe
+        if (strcmp(argv[i], "--headless") == 0) {
+            app._headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            app._frameLimit = std::strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            app._framesInFlight = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+            app._pipelineCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--shader-pack") == 0 && i + 1 < argc) {
+            app._shaderPackPath = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            app._profiler._tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            app._drawCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--gpu-culling") == 0) {
+            app._useGpuCulling = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            app._frameCapture._path = argv[++i];
+        } else if (strcmp(argv[i], "--capture-every-frame") == 0) {
+            app._frameCapture._waitWhenFull = true;
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            app._texturePaths.emplace_back(argv[++i]);
+        } else if (strcmp(argv[i], "--offscreen-passes") == 0) {
+            app._offscreenPasses = true;
+        } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            app._meshPath = argv[++i];
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            spdlog::set_level(spdlog::level::from_str(argv[++i]));
+        } else if (strcmp(argv[i], "--host-allocator") == 0) {
+            app._hostAllocator._enabled = true;
+        } else if (strcmp(argv[i], "--present-policy") == 0 && i + 1 < argc) {
+            if (!PresentPacer::parse(argv[++i], app._presentPacer._policy)) {
+                warn("Unknown present policy {}, using {}", argv[i], PresentPacer::name(app._presentPacer._policy));
+            }
+        }
+    }
     try {
         app.run();
     } catch (const std::exception& e) {
+        logging::stop();                                      // What was logged before the error comes first
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,110 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+#ifdef _WIN32
+        std::swap(_file, other._file);
+        std::swap(_mapping, other._mapping);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    _file = file;
+    _mapping = mapping;
+    _data = static_cast<const unsigned char *>(view);
+    _size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+        CloseHandle(_mapping);
+        CloseHandle(_file);
+    }
+    _data = nullptr;
+    _size = 0;
+    _file = nullptr;
+    _mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    _data = static_cast<const unsigned char *>(mapping);
+    _size = static_cast<size_t>(fileStat.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data) {
+        munmap(const_cast<unsigned char *>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
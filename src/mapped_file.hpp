@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Move-only, unmaps on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Returns false if the file can't be opened or mapped
+    bool open(const std::string &path);
+
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return _data != nullptr; }
+
+    [[nodiscard]] const unsigned char *data() const { return _data; }
+
+    [[nodiscard]] size_t size() const { return _size; }
+
+private:
+    const unsigned char *_data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void *_file = nullptr;
+    void *_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,119 @@
+#include "mesh.hpp"
+
+#include <cstddef>
+#include "base.hpp"
+#include "log.hpp"
+#include "mesh_file.hpp"
+
+std::vector<VkVertexInputBindingDescription> Vertex::bindingDescriptions() {
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof(Vertex);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return {binding};
+}
+
+std::vector<VkVertexInputAttributeDescription> Vertex::attributeDescriptions() {
+    std::vector<VkVertexInputAttributeDescription> attributes(2);
+    attributes[0].location = 0;
+    attributes[0].binding = 0;
+    attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[0].offset = offsetof(Vertex, position);
+    attributes[1].location = 1;
+    attributes[1].binding = 0;
+    attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[1].offset = offsetof(Vertex, color);
+    return attributes;
+}
+
+namespace {
+    void createBuffers(BaseApplication &app, Mesh &mesh, const void *vertices, VkDeviceSize vertexSize,
+                       const uint32_t *indices, VkDeviceSize indexSize) {
+        mesh.vertexBuffer = app._allocator.createBuffer(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, mesh.vertexAllocation);
+        mesh.indexBuffer = app._allocator.createBuffer(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, mesh.indexAllocation);
+        app._uploadQueue.uploadBuffer(mesh.vertexBuffer, 0, vertices, vertexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        app._uploadQueue.uploadBuffer(mesh.indexBuffer, 0, indices, indexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                      VK_ACCESS_INDEX_READ_BIT);
+    }
+}
+
+void Mesh::create(BaseApplication &app, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices) {
+    vertexCount = static_cast<uint32_t>(vertices.size());
+    indexCount = static_cast<uint32_t>(indices.size());
+    createBuffers(app, *this, vertices.data(), sizeof(Vertex) * vertices.size(), indices.data(),
+                  sizeof(uint32_t) * indices.size());
+    info("Success: Queued upload of mesh with {} vertices and {} indices", vertexCount, indexCount);
+}
+
+void Mesh::create(BaseApplication &app, const MeshFile &file) {
+    const MeshFileHeader &header = file.header();
+    vertexCount = header.vertexCount;
+    indexCount = header.indexCount;
+    // The streams sit back to back in the file, so the vertex buffer is one copy and each stream an offset into it
+    createBuffers(app, *this, file.vertexData(), header.vertexDataSize, file.indices(),
+                  sizeof(uint32_t) * header.indexCount);
+    streamOffsets.clear();
+    for (uint32_t i = 0; i < header.streamCount; ++i) {
+        streamOffsets.push_back(file.streams()[i].offset - header.vertexDataOffset);
+    }
+    meshletCount = header.meshletCount;
+    if (meshletCount != 0) {
+        meshletBuffer = app._allocator.createBuffer(header.meshletDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, meshletAllocation);
+        app._uploadQueue.uploadBuffer(meshletBuffer, 0, file.meshletData(), header.meshletDataSize,
+                                      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                      VK_ACCESS_SHADER_READ_BIT);
+        meshletVerticesOffset = header.meshletVerticesOffset - header.meshletDataOffset;
+        meshletTrianglesOffset = header.meshletTrianglesOffset - header.meshletDataOffset;
+    }
+    info("Success: Queued upload of mesh with {} vertices, {} indices and {} meshlets", vertexCount, indexCount,
+         meshletCount);
+}
+
+void Mesh::destroy(BaseApplication &app) {
+    if (vertexBuffer != VK_NULL_HANDLE) {
+        app._allocator.destroyBuffer(vertexBuffer, vertexAllocation);
+    }
+    if (indexBuffer != VK_NULL_HANDLE) {
+        app._allocator.destroyBuffer(indexBuffer, indexAllocation);
+    }
+    if (meshletBuffer != VK_NULL_HANDLE) {
+        app._allocator.destroyBuffer(meshletBuffer, meshletAllocation);
+    }
+    vertexBuffer = VK_NULL_HANDLE;
+    indexBuffer = VK_NULL_HANDLE;
+    meshletBuffer = VK_NULL_HANDLE;
+}
+
+void Mesh::retire(BaseApplication &app) {
+    app._deletionQueue.retireBuffer(vertexBuffer, vertexAllocation);
+    app._deletionQueue.retireBuffer(indexBuffer, indexAllocation);
+    app._deletionQueue.retireBuffer(meshletBuffer, meshletAllocation);
+    vertexBuffer = VK_NULL_HANDLE;
+    indexBuffer = VK_NULL_HANDLE;
+    meshletBuffer = VK_NULL_HANDLE;
+}
+
+void Mesh::bind(VkCommandBuffer commandBuffer) const {
+    if (streamOffsets.empty()) {
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+    } else {
+        std::array<VkBuffer, MeshFile::MAX_STREAMS> buffers;
+        buffers.fill(vertexBuffer);
+        vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(streamOffsets.size()), buffers.data(),
+                               streamOffsets.data());
+    }
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void Mesh::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount) const {
+    bind(commandBuffer);
+    vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
+}
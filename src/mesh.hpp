@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+
+class BaseApplication;
+class MeshFile;
+
+// Layout matches the inputs of shaders/002_mesh.vert.glsl
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 color;
+
+    static std::vector<VkVertexInputBindingDescription> bindingDescriptions();
+
+    static std::vector<VkVertexInputAttributeDescription> attributeDescriptions();
+};
+
+// Indexed geometry in device-local vertex/index buffers, filled through the app's upload queue
+struct Mesh {
+    VkBuffer vertexBuffer{};
+    Allocation vertexAllocation;
+    VkBuffer indexBuffer{};
+    Allocation indexAllocation;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    std::vector<VkDeviceSize> streamOffsets;                  // From a mesh file: one binding per vertex stream
+    // From a mesh file with meshlets: the meshlet table, then the meshlet vertices and triangles at these byte offsets
+    VkBuffer meshletBuffer{};
+    Allocation meshletAllocation;
+    uint32_t meshletCount = 0;
+    VkDeviceSize meshletVerticesOffset = 0;
+    VkDeviceSize meshletTrianglesOffset = 0;
+
+    // Only queues the uploads, the data is on the GPU once the upload queue's next flush completes
+    void create(BaseApplication &app, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
+
+    // Same, copying each section straight from the file's mapping into staging memory. Draw it with a pipeline built
+    // from the file's vertexBindings()/vertexAttributes(). The file can be closed once this returns.
+    void create(BaseApplication &app, const MeshFile &file);
+
+    void destroy(BaseApplication &app);
+
+    // Like destroy, but through the app's deletion queue, for meshes unloaded while frames are in flight
+    void retire(BaseApplication &app);
+
+    void bind(VkCommandBuffer commandBuffer) const;
+
+    // Binds and draws, bind once and call vkCmdDrawIndexed directly when drawing the same mesh many times
+    void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1) const;
+};
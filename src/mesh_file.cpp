@@ -0,0 +1,119 @@
+#include "mesh_file.hpp"
+
+#include <stdexcept>
+#include "log.hpp"
+
+// tools/convert_mesh.py packs these little endian without padding
+static_assert(sizeof(MeshFileHeader) == 136, "MeshFileHeader must match HEADER_FORMAT in convert_mesh.py");
+static_assert(sizeof(MeshFileStream) == 32, "MeshFileStream must match STREAM_FORMAT in convert_mesh.py");
+static_assert(sizeof(MeshFileMeshlet) == 48, "MeshFileMeshlet must match MESHLET_FORMAT in convert_mesh.py");
+
+bool MeshFile::open(const std::string &path) {
+    close();
+    if (!_file.open(path)) {
+        return false;
+    }
+    const unsigned char *data = _file.data();
+    uint64_t size = _file.size();
+    auto corrupt = [&](const char *reason) {
+        close();
+        throw std::runtime_error("Error: Mesh file " + path + " is corrupt or from another version (" + reason + ")");
+    };
+    // The mapping is page aligned, so the header and tables can be read in place
+    auto header = reinterpret_cast<const MeshFileHeader *>(data);
+    if (size < sizeof(MeshFileHeader) || header->magic != MAGIC || header->version != VERSION ||
+        header->fileSize != size) {
+        corrupt("header");
+    }
+    if (header->streamCount == 0 || header->streamCount > MAX_STREAMS ||
+        header->streamTableOffset % alignof(MeshFileStream) != 0 ||
+        header->streamTableOffset + uint64_t(header->streamCount) * sizeof(MeshFileStream) > size ||
+        header->vertexDataOffset + header->vertexDataSize > size) {
+        corrupt("stream table");
+    }
+    auto streams = reinterpret_cast<const MeshFileStream *>(data + header->streamTableOffset);
+    uint64_t vertexDataEnd = header->vertexDataOffset + header->vertexDataSize;
+    for (uint32_t i = 0; i < header->streamCount; ++i) {
+        const MeshFileStream &stream = streams[i];
+        uint32_t elementSize = formatSize(stream.format);
+        if (elementSize == 0 || stream.stride < elementSize || stream.offset % sizeof(uint32_t) != 0 ||
+            stream.offset < header->vertexDataOffset || stream.offset + stream.size > vertexDataEnd ||
+            stream.size != uint64_t(header->vertexCount) * stream.stride) {
+            corrupt("vertex stream");
+        }
+    }
+    if (header->indexCount % 3 != 0 || header->indexOffset % sizeof(uint32_t) != 0 ||
+        header->indexOffset + uint64_t(header->indexCount) * sizeof(uint32_t) > size) {
+        corrupt("indices");
+    }
+    if (header->meshletCount != 0) {
+        uint64_t meshletDataEnd = header->meshletDataOffset + header->meshletDataSize;
+        if (header->meshletDataOffset % alignof(MeshFileMeshlet) != 0 || meshletDataEnd > size ||
+            header->meshletDataOffset + uint64_t(header->meshletCount) * sizeof(MeshFileMeshlet) >
+            header->meshletVerticesOffset ||
+            header->meshletVerticesOffset % sizeof(uint32_t) != 0 ||
+            header->meshletVerticesOffset > header->meshletTrianglesOffset ||
+            header->meshletTrianglesOffset > meshletDataEnd) {
+            corrupt("meshlets");
+        }
+        // Check every meshlet once here so users can trust the offsets
+        uint64_t vertexCapacity = (header->meshletTrianglesOffset - header->meshletVerticesOffset) / sizeof(uint32_t);
+        uint64_t triangleCapacity = (meshletDataEnd - header->meshletTrianglesOffset) / 3;
+        auto meshlets = reinterpret_cast<const MeshFileMeshlet *>(data + header->meshletDataOffset);
+        for (uint32_t i = 0; i < header->meshletCount; ++i) {
+            const MeshFileMeshlet &meshlet = meshlets[i];
+            if (meshlet.vertexCount > MAX_MESHLET_VERTICES || meshlet.triangleCount > MAX_MESHLET_TRIANGLES ||
+                uint64_t(meshlet.vertexOffset) + meshlet.vertexCount > vertexCapacity ||
+                uint64_t(meshlet.triangleOffset) + meshlet.triangleCount > triangleCapacity) {
+                corrupt("meshlet");
+            }
+        }
+    }
+    _header = header;
+    _streams = streams;
+    info("Success: Mapped mesh file {} with {} vertices, {} indices and {} meshlets ({} bytes)", path,
+         header->vertexCount, header->indexCount, header->meshletCount, size);
+    return true;
+}
+
+void MeshFile::close() {
+    _file.close();
+    _header = nullptr;
+    _streams = nullptr;
+}
+
+std::vector<VkVertexInputBindingDescription> MeshFile::vertexBindings() const {
+    std::vector<VkVertexInputBindingDescription> bindings(_header->streamCount);
+    for (uint32_t i = 0; i < _header->streamCount; ++i) {
+        bindings[i].binding = i;
+        bindings[i].stride = _streams[i].stride;
+        bindings[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    }
+    return bindings;
+}
+
+std::vector<VkVertexInputAttributeDescription> MeshFile::vertexAttributes() const {
+    std::vector<VkVertexInputAttributeDescription> attributes(_header->streamCount);
+    for (uint32_t i = 0; i < _header->streamCount; ++i) {
+        attributes[i].location = static_cast<uint32_t>(_streams[i].semantic);
+        attributes[i].binding = i;
+        attributes[i].format = _streams[i].format;
+        attributes[i].offset = 0;
+    }
+    return attributes;
+}
+
+uint32_t MeshFile::formatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return 4;
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
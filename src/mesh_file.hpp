@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "mapped_file.hpp"
+
+// Layout written by tools/convert_mesh.py, every section aligned to ALIGNMENT:
+// header | stream table | vertex streams | indices | meshlet table | meshlet vertices | meshlet triangles
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;                                      // uint32_t triangle list
+    uint32_t streamCount;
+    uint32_t meshletCount;                                    // 0 when the file has no meshlets
+    uint64_t streamTableOffset;
+    uint64_t vertexDataOffset;                                // Every stream, back to back
+    uint64_t vertexDataSize;
+    uint64_t indexOffset;
+    uint64_t meshletDataOffset;                               // Meshlet table, vertices and triangles, back to back
+    uint64_t meshletDataSize;
+    uint64_t meshletVerticesOffset;                           // uint32_t mesh vertex index per meshlet vertex
+    uint64_t meshletTrianglesOffset;                          // Three uint8_t meshlet vertex indices per triangle
+    float boundsMin[3];
+    float boundsMax[3];
+    float center[3];                                          // Bounding sphere
+    float radius;
+    uint64_t fileSize;
+};
+
+// Vertex attribute locations of the streams, shaders/002_mesh.vert.glsl reads the first two
+enum class MeshSemantic : uint32_t {
+    Position = 0,
+    Color = 1,
+    Normal = 2,
+    TexCoord = 3,
+};
+
+struct MeshFileStream {
+    MeshSemantic semantic;
+    VkFormat format;
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Up to MAX_MESHLET_VERTICES vertices and MAX_MESHLET_TRIANGLES triangles of the mesh, for cluster culling and mesh
+// shaders. The offsets count elements of the meshlet vertex and triangle arrays.
+struct MeshFileMeshlet {
+    float center[3];                                          // Bounding sphere
+    float radius;
+    float coneAxis[3];                                        // Average triangle normal
+    float coneCutoff;                                         // Cosine of the widest angle from the axis to a normal,
+                                                              // -1 when the normals don't fit a cone
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// A converted mesh in one mmapped file. Nothing is parsed at runtime: the header and tables are read in place, and
+// Mesh::create copies the vertex, index and meshlet sections straight from the mapping into staging memory.
+class MeshFile {
+public:
+    static constexpr uint32_t MAGIC = 0x48534d4b;             // "KMSH"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t ALIGNMENT = 64;
+    static constexpr uint32_t MAX_STREAMS = 8;
+    static constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+    static constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+    // Returns false if the file is missing, throws if it exists but is malformed. Index values aren't checked, the
+    // converter is trusted with those.
+    bool open(const std::string &path);
+
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return _file.isOpen(); }
+
+    [[nodiscard]] const MeshFileHeader &header() const { return *_header; }
+
+    [[nodiscard]] const MeshFileStream *streams() const { return _streams; }
+
+    [[nodiscard]] const unsigned char *vertexData() const { return _file.data() + _header->vertexDataOffset; }
+
+    [[nodiscard]] const uint32_t *indices() const {
+        return reinterpret_cast<const uint32_t *>(_file.data() + _header->indexOffset);
+    }
+
+    // The meshlet table, followed by the meshlet vertices and triangles
+    [[nodiscard]] const unsigned char *meshletData() const { return _file.data() + _header->meshletDataOffset; }
+
+    [[nodiscard]] const MeshFileMeshlet *meshlets() const {
+        return reinterpret_cast<const MeshFileMeshlet *>(meshletData());
+    }
+
+    [[nodiscard]] const uint32_t *meshletVertices() const {
+        return reinterpret_cast<const uint32_t *>(_file.data() + _header->meshletVerticesOffset);
+    }
+
+    [[nodiscard]] const uint8_t *meshletTriangles() const { return _file.data() + _header->meshletTrianglesOffset; }
+
+    // One binding per stream, in stream order, with the stream's semantic as its location
+    [[nodiscard]] std::vector<VkVertexInputBindingDescription> vertexBindings() const;
+
+    [[nodiscard]] std::vector<VkVertexInputAttributeDescription> vertexAttributes() const;
+
+    // 0 for formats a stream can't have
+    static uint32_t formatSize(VkFormat format);
+
+private:
+    MappedFile _file;
+    const MeshFileHeader *_header = nullptr;
+    const MeshFileStream *_streams = nullptr;
+};
@@ -0,0 +1,69 @@
+#include "ownership_transfer.hpp"
+
+namespace {
+
+// The release ignores the destination access and the acquire the source access, everything else has to match
+void recordHalf(VkCommandBuffer commandBuffer, const std::vector<OwnershipTransfer> &transfers, bool release) {
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    for (const auto &transfer : transfers) {
+        bool layoutChange = transfer.image != VK_NULL_HANDLE && transfer.oldLayout != transfer.newLayout;
+        if (!transfer.crossesFamilies() && (release || !layoutChange)) {
+            continue;
+        }
+        uint32_t srcFamily = transfer.crossesFamilies() ? transfer.srcFamily : VK_QUEUE_FAMILY_IGNORED;
+        uint32_t dstFamily = transfer.crossesFamilies() ? transfer.dstFamily : VK_QUEUE_FAMILY_IGNORED;
+        VkAccessFlags srcAccess = release ? transfer.srcAccess : 0;
+        VkAccessFlags dstAccess = release ? 0 : transfer.dstAccess;
+        if (release) {
+            srcStages |= transfer.srcStage;
+            dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        } else {
+            // Callers wait on the semaphore at dstStage, starting the barrier there chains a layout change after it
+            srcStages |= transfer.dstStage;
+            dstStages |= transfer.dstStage;
+        }
+        if (transfer.image != VK_NULL_HANDLE) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.oldLayout = transfer.oldLayout;
+            barrier.newLayout = transfer.newLayout;
+            barrier.srcQueueFamilyIndex = srcFamily;
+            barrier.dstQueueFamilyIndex = dstFamily;
+            barrier.image = transfer.image;
+            barrier.subresourceRange = transfer.subresourceRange;
+            imageBarriers.push_back(barrier);
+        } else {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = srcFamily;
+            barrier.dstQueueFamilyIndex = dstFamily;
+            barrier.buffer = transfer.buffer;
+            barrier.offset = transfer.offset;
+            barrier.size = transfer.size;
+            bufferBarriers.push_back(barrier);
+        }
+    }
+    if (bufferBarriers.empty() && imageBarriers.empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+                         static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+                         static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+}
+
+void recordRelease(VkCommandBuffer commandBuffer, const std::vector<OwnershipTransfer> &transfers) {
+    recordHalf(commandBuffer, transfers, true);
+}
+
+void recordAcquire(VkCommandBuffer commandBuffer, const std::vector<OwnershipTransfer> &transfers) {
+    recordHalf(commandBuffer, transfers, false);
+}
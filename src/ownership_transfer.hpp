@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Moves a buffer range or an image from one queue family to another. The release half is recorded on a queue of the
+// source family, the acquire half on one of the destination family, and a semaphore between the two submits orders
+// them. For images the layout change happens as part of the transfer and has to be the same in both halves.
+struct OwnershipTransfer {
+    uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED;
+    VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;    // What wrote it on the source queue
+    VkAccessFlags srcAccess = 0;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT; // What reads it on the destination queue
+    VkAccessFlags dstAccess = 0;
+    VkBuffer buffer{};                                        // Either a buffer range...
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = VK_WHOLE_SIZE;
+    VkImage image{};                                          // ...or an image
+    VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0,
+                                             VK_REMAINING_ARRAY_LAYERS};
+    VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    // Same family on both sides: no release/acquire, only an image layout change if there is one
+    [[nodiscard]] bool crossesFamilies() const { return srcFamily != dstFamily; }
+};
+
+// Batches the release halves into one barrier, does nothing for transfers within a family
+void recordRelease(VkCommandBuffer commandBuffer, const std::vector<OwnershipTransfer> &transfers);
+
+// Batches the acquire halves into one barrier. Transfers within a family only get their layout change recorded here,
+// the semaphore wait already orders them after the source queue's work.
+void recordAcquire(VkCommandBuffer commandBuffer, const std::vector<OwnershipTransfer> &transfers);
@@ -1,36 +1,289 @@
 #include "pipeline.hpp"
 #include "base.hpp"
 #include "log.hpp"
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+
+uint64_t PipelineDescription::hash() const {
+    StateHasher hasher;
+    hasher.add(vertShader);
+    hasher.add(fragShader);
+    hasher.add(static_cast<uint32_t>(vertexBindings.size()));
+    for (const auto &binding : vertexBindings) {
+        hasher.add(binding.binding);
+        hasher.add(binding.stride);
+        hasher.add(static_cast<uint32_t>(binding.inputRate));
+    }
+    hasher.add(static_cast<uint32_t>(vertexAttributes.size()));
+    for (const auto &attribute : vertexAttributes) {
+        hasher.add(attribute.location);
+        hasher.add(attribute.binding);
+        hasher.add(static_cast<uint32_t>(attribute.format));
+        hasher.add(attribute.offset);
+    }
+    hasher.add(static_cast<uint32_t>(bindless));
+    hasher.add(static_cast<uint32_t>(specialization.size()));
+    for (const auto &constant : specialization) {
+        hasher.add(constant.id);
+        hasher.add(constant.value);
+    }
+    hasher.add(static_cast<uint32_t>(topology));
+    hasher.add(static_cast<uint32_t>(polygonMode));
+    hasher.add(static_cast<uint32_t>(cullMode));
+    hasher.add(static_cast<uint32_t>(frontFace));
+    hasher.add(static_cast<uint32_t>(alphaBlend));
+    return hasher.value();
+}
+
+bool PipelineDescription::operator==(const PipelineDescription &other) const {
+    auto sameBindings = [](const VkVertexInputBindingDescription &a, const VkVertexInputBindingDescription &b) {
+        return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+    };
+    auto sameAttributes = [](const VkVertexInputAttributeDescription &a, const VkVertexInputAttributeDescription &b) {
+        return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+    };
+    auto sameConstants = [](const SpecializationConstant &a, const SpecializationConstant &b) {
+        return a.id == b.id && a.value == b.value;
+    };
+    return vertShader == other.vertShader && fragShader == other.fragShader &&
+           std::equal(vertexBindings.begin(), vertexBindings.end(), other.vertexBindings.begin(),
+                      other.vertexBindings.end(), sameBindings) &&
+           std::equal(vertexAttributes.begin(), vertexAttributes.end(), other.vertexAttributes.begin(),
+                      other.vertexAttributes.end(), sameAttributes) &&
+           bindless == other.bindless &&
+           std::equal(specialization.begin(), specialization.end(), other.specialization.begin(),
+                      other.specialization.end(), sameConstants) &&
+           topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode &&
+           frontFace == other.frontFace && alphaBlend == other.alphaBlend;
+}
 
 void BasePipeline::addShader(const std::string &filename, bool isVert) {
+    UniqueShaderModule shaderModule(_app._device, loadShaderModule(_app, filename), _app._allocationCallbacks);
     if (isVert) {
-        _shaderModules.vertShaders.push_back(createShaderModule(_app, readFile(filename)));
+        _shaderModules.vertShaders.push_back(std::move(shaderModule));
     } else {
-        _shaderModules.fragShaders.push_back(createShaderModule(_app, readFile(filename)));
+        _shaderModules.fragShaders.push_back(std::move(shaderModule));
+    }
+}
+
+VkShaderModule BasePipeline::loadShaderModule(BaseApplication &app, const std::string &filename) {
+    ShaderBlob blob;
+    if (app._shaderPack.find(filename, blob)) {
+        return createShaderModule(app, blob.code, blob.size);
     }
+    std::vector<uint32_t> code = readSpirvFile(filename);
+    return createShaderModule(app, code.data(), code.size() * sizeof(uint32_t));
 }
 
-VkShaderModule BasePipeline::createShaderModule(BaseApplication &app, const std::vector<char> &code) {
+VkShaderModule BasePipeline::createShaderModule(BaseApplication &app, const uint32_t *code, size_t codeSize) {
     VkShaderModuleCreateInfo shaderModuleCreateInfo{};
     shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = code.size();
-    // This needs a uint32_t* rather than char *
-    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    shaderModuleCreateInfo.codeSize = codeSize;
+    // Both the pack and readSpirvFile keep the words 4 byte aligned
+    shaderModuleCreateInfo.pCode = code;
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(app._device, &shaderModuleCreateInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+    if (vkCreateShaderModule(app._device, &shaderModuleCreateInfo, app._allocationCallbacks, &shaderModule) !=
+        VK_SUCCESS) {
         throw std::runtime_error("failed to create shader module!");
     }
     return shaderModule;
 }
 
+void BasePipeline::createPipeline(VkRenderPass renderPass) {
+    if (_shaderModules.vertShaders.empty() || _shaderModules.fragShaders.empty()) {
+        throw std::runtime_error("Error: Pipeline needs a vertex and a fragment shader");
+    }
+    createPipeline(renderPass, _shaderModules.vertShaders[0].get(), _shaderModules.fragShaders[0].get());
+}
+
+PipelineStateInfo::PipelineStateInfo(const PipelineDescription &description, VkShaderModule vertShader,
+                                     VkShaderModule fragShader) {
+    specializationEntries.resize(description.specialization.size());
+    for (size_t i = 0; i < specializationEntries.size(); ++i) {
+        specializationEntries[i].constantID = description.specialization[i].id;
+        specializationEntries[i].offset = static_cast<uint32_t>(i * sizeof(SpecializationConstant) +
+                                                                offsetof(SpecializationConstant, value));
+        specializationEntries[i].size = sizeof(uint32_t);
+    }
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = description.specialization.size() * sizeof(SpecializationConstant);
+    specializationInfo.pData = description.specialization.data();
+
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShader;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShader;
+    shaderStages[1].pName = "main";
+    if (!description.specialization.empty()) {
+        shaderStages[0].pSpecializationInfo = &specializationInfo;
+        shaderStages[1].pSpecializationInfo = &specializationInfo;
+    }
+
+    // How to load stuff into the buffers in shaders, nothing when the vertices live in the shader
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+    vertexInput.pVertexBindingDescriptions = description.vertexBindings.data();
+    vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+    vertexInput.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+    // What kind of geometry
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = description.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are set when recording so the pipeline survives a swap chain resize
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+    dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = description.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = description.cullMode;
+    rasterizer.frontFace = description.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = description.alphaBlend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+}
+
+VkPipelineLayout BasePipeline::createPipelineLayout(BaseApplication &app, bool bindless) {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPushConstantRange pushConstantRange = BindlessTable::pushConstantRange();
+    if (bindless) {
+        if (!app._bindless.isReady()) {
+            throw std::runtime_error("Error: Pipeline wants the bindless table, which this device can't have");
+        }
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &app._bindless._setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    }
+    VkPipelineLayout pipelineLayout;
+    if (vkCreatePipelineLayout(app._device, &pipelineLayoutInfo, app._allocationCallbacks, &pipelineLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to create pipeline layout");
+    }
+    return pipelineLayout;
+}
+
+void BasePipeline::createLayout() {
+    _pipelineLayout.reset(_app._device, createPipelineLayout(_app, _description.bindless), _app._allocationCallbacks);
+}
+
+void BasePipeline::createPipeline(VkRenderPass renderPass, VkShaderModule vertShader, VkShaderModule fragShader) {
+    PipelineStateInfo state(_description, vertShader, fragShader);
+    createLayout();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = state.shaderStages;
+    pipelineInfo.pVertexInputState = &state.vertexInput;
+    pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    pipelineInfo.pViewportState = &state.viewportState;
+    pipelineInfo.pRasterizationState = &state.rasterizer;
+    pipelineInfo.pMultisampleState = &state.multisampling;
+    pipelineInfo.pColorBlendState = &state.colorBlending;
+    pipelineInfo.pDynamicState = &state.dynamicState;
+    pipelineInfo.layout = _pipelineLayout.get();
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(_app._device, _app._pipelineCache._cache, 1, &pipelineInfo, _app._allocationCallbacks,
+                                  &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to create graphics pipeline");
+    }
+    _pipeline.reset(_app._device, pipeline, _app._allocationCallbacks);
+    double createMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    _app._pipelineCache.recordCreation(createMs);
+    info("Success: Created graphics pipeline in {:.3f} ms", createMs);
+}
+
+std::vector<BasePipeline> BasePipeline::createPipelines(BaseApplication &app,
+                                                       const std::vector<PipelineDescription> &descriptions,
+                                                       VkRenderPass renderPass) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Variants usually share shaders, only read and compile each file once
+    std::vector<std::string> shaderFiles;
+    std::unordered_map<std::string, size_t> shaderIndices;
+    for (const auto &description : descriptions) {
+        for (const auto &filename : {description.vertShader, description.fragShader}) {
+            if (shaderIndices.emplace(filename, shaderFiles.size()).second) {
+                shaderFiles.push_back(filename);
+            }
+        }
+    }
+
+    // The modules are shared between pipelines and not needed after creation, so they stay here and are destroyed on
+    // the way out, also when creation throws halfway
+    std::vector<UniqueShaderModule> shaderModules(shaderFiles.size());
+    std::vector<BasePipeline> pipelines;
+    pipelines.reserve(descriptions.size());
+    for (size_t i = 0; i < descriptions.size(); ++i) {
+        pipelines.emplace_back(app);
+    }
+    app._threadPool.parallelFor(shaderFiles.size(), [&](size_t i) {
+        shaderModules[i].reset(app._device, loadShaderModule(app, shaderFiles[i]), app._allocationCallbacks);
+    });
+    app._threadPool.parallelFor(descriptions.size(), [&](size_t i) {
+        BasePipeline &pipeline = pipelines[i];
+        pipeline._description = descriptions[i];
+        pipeline.createPipeline(renderPass, shaderModules[shaderIndices.at(descriptions[i].vertShader)].get(),
+                                shaderModules[shaderIndices.at(descriptions[i].fragShader)].get());
+    });
+
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    info("Success: Created {} pipelines from {} shader modules in {:.3f} ms on {} threads", pipelines.size(),
+         shaderModules.size(), totalMs, app._threadPool.size() + 1);
+    return pipelines;
+}
 
 void BasePipeline::cleanup() {
     info("Clean up: Pipeline");
+    _pipeline.reset();
+    _pipelineLayout.reset();
     info("Clean up: Shaders");
-    for (auto vertShaderModule : _shaderModules.vertShaders) {
-        vkDestroyShaderModule(_app._device, vertShaderModule, nullptr);
-    }
-    for (auto fragShaderModule : _shaderModules.fragShaders) {
-        vkDestroyShaderModule(_app._device, fragShaderModule, nullptr);
-    }
+    _shaderModules = ShaderModules{};
+}
+
+void BasePipeline::retire() {
+    _app._deletionQueue.retire(std::move(_pipeline));
+    _app._deletionQueue.retire(std::move(_pipelineLayout));
+    // Modules are only read while creating pipelines, nothing in flight uses them
+    _shaderModules = ShaderModules{};
 }
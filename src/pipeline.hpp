@@ -1,25 +1,160 @@
 #pragma once
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.hpp>
+#include "hash.hpp"
 #include "helpers.hpp"
+#include "vk_handle.hpp"
 
 class BaseApplication;
 
+// FNV-1a 64, fed field by field so struct padding never gets in
+class StateHasher {
+public:
+    void add(const void *data, size_t size) { _value = fnv1a(data, size, _value); }
+
+    void add(uint32_t value) { add(&value, sizeof(value)); }
+
+    void add(const std::string &text) {
+        add(static_cast<uint32_t>(text.size()));
+        add(text.data(), text.size());
+    }
+
+    [[nodiscard]] uint64_t value() const { return _value; }
+
+private:
+    uint64_t _value = FNV1A_OFFSET_BASIS;
+};
+
+// A 32 bit specialization constant, floats and bools go in as their bits
+struct SpecializationConstant {
+    uint32_t id;
+    uint32_t value;
+};
+
+// Everything a graphics pipeline is built from. Equal descriptions give identical pipelines, which is what lets
+// PipelineStateCache hand out one pipeline for all of them.
+struct PipelineDescription {
+    std::string vertShader;
+    std::string fragShader;
+    // Empty for shaders that generate their own vertices
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    // Set 0 is the app's bindless table and the push constants are its range, see BindlessTable
+    bool bindless = false;
+    // Given to both stages, a stage ignores ids it doesn't declare
+    std::vector<SpecializationConstant> specialization;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    bool alphaBlend = false;                                  // Blend by source alpha instead of replacing the target
+
+    // FNV-1a 64 over every field one by one, so it is the same on every run and platform. Shaders count by file name.
+    [[nodiscard]] uint64_t hash() const;
+
+    bool operator==(const PipelineDescription &other) const;
+
+    struct Hasher {
+        size_t operator()(const PipelineDescription &description) const {
+            return static_cast<size_t>(description.hash());
+        }
+    };
+};
+
+// A description together with the render pass it is made for, as PipelineStateCache::renderPassKey() of it. Render
+// passes with the same key are compatible, so pipelines with equal keys can stand in for each other.
+struct PipelineKey {
+    PipelineDescription description;
+    uint64_t renderPass = 0;
+
+    bool operator==(const PipelineKey &other) const {
+        return renderPass == other.renderPass && description == other.description;
+    }
+
+    struct Hasher {
+        size_t operator()(const PipelineKey &key) const {
+            StateHasher hasher;
+            uint64_t description = key.description.hash();
+            hasher.add(&description, sizeof(description));
+            hasher.add(&key.renderPass, sizeof(key.renderPass));
+            return static_cast<size_t>(hasher.value());
+        }
+    };
+};
+
+// The create info structs a description turns into, filled in once so full pipelines and the pipeline library
+// parts describe the same state. Points into the description and itself, so it can't be copied or moved.
+struct PipelineStateInfo {
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    VkSpecializationInfo specializationInfo{};
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};        // Vertex, fragment
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkPipelineViewportStateCreateInfo viewportState{};
+    VkDynamicState dynamicStates[2]{};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+
+    // Either module may be VK_NULL_HANDLE for a library part without that stage
+    PipelineStateInfo(const PipelineDescription &description, VkShaderModule vertShader, VkShaderModule fragShader);
+    PipelineStateInfo(const PipelineStateInfo &) = delete;
+    PipelineStateInfo &operator=(const PipelineStateInfo &) = delete;
+};
+
 struct ShaderModules {
-    std::vector<VkShaderModule> vertShaders;
-    std::vector<VkShaderModule> fragShaders;
+    std::vector<UniqueShaderModule> vertShaders;
+    std::vector<UniqueShaderModule> fragShaders;
 };
 
+// Owns its pipeline, layout and shader modules, so it can be moved but not copied
 class BasePipeline {
 public:
     ShaderModules _shaderModules;
     BaseApplication& _app;
+    UniquePipelineLayout _pipelineLayout;
+    UniquePipeline _pipeline;
+    PipelineDescription _description;                         // State it is built with, addShader() overrides the names
 
     explicit BasePipeline(BaseApplication& app) : _app(app) {}
+    BasePipeline(BasePipeline&& other) noexcept = default;
+    BasePipeline(const BasePipeline&) = delete;
+    BasePipeline& operator=(const BasePipeline&) = delete;
+
+    // Destroys everything right away, only when no frame in flight uses the pipeline. Otherwise hand the handles
+    // to the app's deletion queue, see retire().
     void cleanup();
+
+    // Queues the pipeline and its layout for destruction once the frames in flight are done with them
+    void retire();
+
     void addShader(const std::string& filename, bool isVert);
+    // Builds the graphics pipeline from the first vert/frag shader and _description, viewport and scissor are dynamic
+    void createPipeline(VkRenderPass renderPass);
+    // Just the layout for _description, for pipelines linked from PipelineLibraries
+    void createLayout();
+
+    // Creates every described pipeline at once on the app's thread pool: the unique shader modules first, then the
+    // pipelines, all through the shared pipeline cache. The modules are destroyed once the pipelines exist, so the
+    // returned pipelines have no shader modules of their own.
+    static std::vector<BasePipeline> createPipelines(BaseApplication &app,
+                                                     const std::vector<PipelineDescription> &descriptions,
+                                                     VkRenderPass renderPass);
+
+    // Takes the shader from the app's mmapped shader pack when it's in there, otherwise reads the .spv file
+    static VkShaderModule loadShaderModule(BaseApplication &app, const std::string &filename);
+
+    // Set 0 is the bindless table when `bindless`, otherwise the layout is empty. Layouts made with the same
+    // `bindless` are identically defined, so pipeline library parts and the pipelines linked from them can each
+    // have their own.
+    static VkPipelineLayout createPipelineLayout(BaseApplication &app, bool bindless);
 
 private:
-    static VkShaderModule createShaderModule(BaseApplication &app, const std::vector<char>& code);
+    static VkShaderModule createShaderModule(BaseApplication &app, const uint32_t *code, size_t codeSize);
+
+    void createPipeline(VkRenderPass renderPass, VkShaderModule vertShader, VkShaderModule fragShader);
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,157 @@
+#include "pipeline_cache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "base.hpp"
+#include "hash.hpp"
+#include "log.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+void PipelineCache::load(const std::string &path) {
+    auto start = std::chrono::steady_clock::now();
+    _path = path;
+
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        auto fileSize = static_cast<size_t>(file.tellg());
+        PipelineCacheFileHeader header{};
+        if (fileSize >= sizeof(header)) {
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(&header), sizeof(header));
+            if (header.dataSize == fileSize - sizeof(header)) {
+                data.resize(header.dataSize);
+                file.read(data.data(), static_cast<std::streamsize>(data.size()));
+            }
+        }
+        if (!validate(header, data)) {
+            info("\t Pipeline cache {} is stale or corrupt, starting empty", path);
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheCreateInfo{};
+    cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheCreateInfo.initialDataSize = data.size();
+    cacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(_app._device, &cacheCreateInfo, _app._allocationCallbacks, &_cache) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create pipeline cache");
+    }
+
+    _hit = !data.empty();
+    _loadedBytes = data.size();
+    _loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    info("Success: Created pipeline cache ({} | {} bytes from {} in {:.3f} ms)", _hit ? "hit" : "miss",
+         _loadedBytes, path, _loadMs);
+}
+
+void PipelineCache::save() {
+    if (_cache == VK_NULL_HANDLE || _path.empty()) {
+        return;
+    }
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(_app._device, _cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+        return;
+    }
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(_app._device, _cache, &dataSize, data.data()) != VK_SUCCESS) {
+        warn("Could not read back pipeline cache data, not saving it");
+        return;
+    }
+    data.resize(dataSize);
+
+    const VkPhysicalDeviceProperties &properties = _app._deviceProperties;
+    PipelineCacheFileHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = hash(data.data(), data.size());
+
+    std::string tmpPath = _path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        warn("Could not open {} to save the pipeline cache", tmpPath);
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(data.data(), 1, data.size(), file) == data.size() &&
+                   fflush(file) == 0;
+    // Make sure the bytes are on disk before the rename makes them visible under the real name
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    fclose(file);
+
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(tmpPath, _path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(tmpPath, error);
+        warn("Could not save the pipeline cache to {}", _path);
+        return;
+    }
+    info("Success: Saved {} bytes of pipeline cache to {}", data.size(), _path);
+}
+
+void PipelineCache::cleanup() {
+    info("Clean up: Pipeline cache");
+    report();
+    vkDestroyPipelineCache(_app._device, _cache, _app._allocationCallbacks);
+    _cache = VK_NULL_HANDLE;
+}
+
+void PipelineCache::recordCreation(double milliseconds) {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    ++_pipelinesCreated;
+    _pipelineCreateMs += milliseconds;
+}
+
+void PipelineCache::report() const {
+    info("Pipeline cache: {} | load {:.3f} ms | {} pipelines created in {:.3f} ms", _hit ? "hit" : "miss", _loadMs,
+         _pipelinesCreated, _pipelineCreateMs);
+}
+
+bool PipelineCache::validate(const PipelineCacheFileHeader &header, const std::vector<char> &data) const {
+    const VkPhysicalDeviceProperties &properties = _app._deviceProperties;
+    if (header.magic != MAGIC || header.version != VERSION || data.empty() || header.dataSize != data.size()) {
+        return false;
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+        header.driverVersion != properties.driverVersion ||
+        memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        return false;
+    }
+    if (header.dataHash != hash(data.data(), data.size())) {
+        return false;
+    }
+    // The driver's own header should agree with ours
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) {
+        return false;
+    }
+    memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    return driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           driverHeader.vendorID == properties.vendorID && driverHeader.deviceID == properties.deviceID &&
+           memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+uint64_t PipelineCache::hash(const char *data, size_t size) {
+    // Enough to catch truncation and bit rot
+    return fnv1a(data, size);
+}
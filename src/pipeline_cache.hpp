@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class BaseApplication;
+
+// On-disk header in front of the driver's cache blob. The driver checks its own header too, but some drivers
+// crash on stale data, so we never hand it anything that doesn't match the device and driver exactly.
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+class PipelineCache {
+public:
+    static constexpr uint32_t MAGIC = 0x4350504b;             // "KPPC"
+    static constexpr uint32_t VERSION = 1;
+
+    BaseApplication &_app;
+    VkPipelineCache _cache{};
+    std::string _path;
+    bool _hit = false;                                        // Loaded valid data for this device/driver
+    double _loadMs = 0.0;
+    size_t _loadedBytes = 0;
+    uint32_t _pipelinesCreated = 0;
+    double _pipelineCreateMs = 0.0;                           // Summed over threads when created in parallel
+    std::mutex _statsMutex;
+
+    explicit PipelineCache(BaseApplication &app) : _app(app) {}
+
+    // Creates the VkPipelineCache, seeded from `path` when it was written for this exact device and driver
+    void load(const std::string &path);
+
+    // Writes to a temporary file then renames it over the old one, so a crash never leaves a torn cache behind
+    void save();
+
+    void cleanup();
+
+    // Pipelines report how long they took so warm/cold startups can be compared, safe to call from any thread
+    void recordCreation(double milliseconds);
+
+    void report() const;
+
+private:
+    [[nodiscard]] bool validate(const PipelineCacheFileHeader &header, const std::vector<char> &data) const;
+
+    static uint64_t hash(const char *data, size_t size);
+};
@@ -0,0 +1,208 @@
+#include "pipeline_library.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include "base.hpp"
+#include "log.hpp"
+
+bool PipelineLibraries::isSupported() const {
+    return _app._pipelineLibrarySupported;
+}
+
+PipelineKey PipelineLibraries::partOf(Part part, const PipelineKey &key) {
+    const PipelineDescription &description = key.description;
+    PipelineKey partKey;
+    PipelineDescription &fields = partKey.description;
+    switch (part) {
+        case Part::VertexInput:
+            fields.vertexBindings = description.vertexBindings;
+            fields.vertexAttributes = description.vertexAttributes;
+            fields.topology = description.topology;
+            // The only part that doesn't need the render pass
+            return partKey;
+        case Part::PreRasterization:
+            fields.vertShader = description.vertShader;
+            fields.specialization = description.specialization;
+            fields.bindless = description.bindless;
+            fields.polygonMode = description.polygonMode;
+            fields.cullMode = description.cullMode;
+            fields.frontFace = description.frontFace;
+            break;
+        case Part::FragmentShader:
+            fields.fragShader = description.fragShader;
+            fields.specialization = description.specialization;
+            fields.bindless = description.bindless;
+            break;
+        case Part::FragmentOutput:
+            fields.alphaBlend = description.alphaBlend;
+            break;
+    }
+    partKey.renderPass = key.renderPass;
+    return partKey;
+}
+
+VkPipelineLayout PipelineLibraries::layout(bool bindless) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    UniquePipelineLayout &layout = _layouts[bindless ? 1 : 0];
+    if (!layout) {
+        layout.reset(_app._device, BasePipeline::createPipelineLayout(_app, bindless), _app._allocationCallbacks);
+    }
+    return layout.get();
+}
+
+void PipelineLibraries::buildParts(const std::vector<PipelineDescription> &descriptions, VkRenderPass renderPass,
+                                   uint64_t renderPassKey) {
+    std::vector<std::pair<Part, PipelineKey>> missing;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto &description : descriptions) {
+            PipelineKey key{description, renderPassKey};
+            for (uint32_t i = 0; i < PART_COUNT; ++i) {
+                std::pair<Part, PipelineKey> part(static_cast<Part>(i), partOf(static_cast<Part>(i), key));
+                if (_parts[i].count(part.second) == 0 && std::find(missing.begin(), missing.end(), part) ==
+                                                         missing.end()) {
+                    missing.push_back(std::move(part));
+                }
+            }
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+
+    // Held here until they're in the map, so a part that throws doesn't leak the ones built already
+    std::vector<UniquePipeline> built(missing.size());
+    _app._threadPool.parallelFor(missing.size(), [&](size_t i) {
+        built[i].reset(_app._device, buildPart(missing[i].first, missing[i].second.description, renderPass),
+                       _app._allocationCallbacks);
+    });
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        UniquePipeline &slot = _parts[static_cast<uint32_t>(missing[i].first)][missing[i].second];
+        // Another thread may have built the same part meanwhile, then ours goes with `built`
+        if (!slot) {
+            slot = std::move(built[i]);
+            ++_builtCount;
+        }
+    }
+}
+
+VkPipeline PipelineLibraries::buildPart(Part part, const PipelineDescription &key, VkRenderPass renderPass) {
+    // The part's own shader stage is the only module it needs, and only while building
+    UniqueShaderModule shaderModule;
+    if (part == Part::PreRasterization || part == Part::FragmentShader) {
+        const std::string &filename = part == Part::PreRasterization ? key.vertShader : key.fragShader;
+        shaderModule.reset(_app._device, BasePipeline::loadShaderModule(_app, filename), _app._allocationCallbacks);
+    }
+    PipelineStateInfo state(key, part == Part::PreRasterization ? shaderModule.get() : VK_NULL_HANDLE,
+                            part == Part::FragmentShader ? shaderModule.get() : VK_NULL_HANDLE);
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    // Retained so the optimized link can still optimize across the parts
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+                         VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    switch (part) {
+        case Part::VertexInput:
+            libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+            pipelineInfo.pVertexInputState = &state.vertexInput;
+            pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+            break;
+        case Part::PreRasterization:
+            libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+            pipelineInfo.stageCount = 1;
+            pipelineInfo.pStages = &state.shaderStages[0];
+            pipelineInfo.pViewportState = &state.viewportState;
+            pipelineInfo.pRasterizationState = &state.rasterizer;
+            // Viewport and scissor are the only dynamic states, both belong to this part
+            pipelineInfo.pDynamicState = &state.dynamicState;
+            pipelineInfo.layout = layout(key.bindless);
+            pipelineInfo.renderPass = renderPass;
+            break;
+        case Part::FragmentShader:
+            libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+            pipelineInfo.stageCount = 1;
+            pipelineInfo.pStages = &state.shaderStages[1];
+            pipelineInfo.pMultisampleState = &state.multisampling;
+            pipelineInfo.layout = layout(key.bindless);
+            pipelineInfo.renderPass = renderPass;
+            break;
+        case Part::FragmentOutput:
+            libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+            pipelineInfo.pMultisampleState = &state.multisampling;
+            pipelineInfo.pColorBlendState = &state.colorBlending;
+            pipelineInfo.renderPass = renderPass;
+            break;
+    }
+    pipelineInfo.subpass = 0;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(_app._device, _app._pipelineCache._cache, 1, &pipelineInfo, _app._allocationCallbacks,
+                                  &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to create pipeline library part " +
+                                 std::to_string(static_cast<uint32_t>(part)));
+    }
+    return pipeline;
+}
+
+bool PipelineLibraries::hasParts(const PipelineKey &key) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (uint32_t i = 0; i < PART_COUNT; ++i) {
+        if (_parts[i].count(partOf(static_cast<Part>(i), key)) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+UniquePipeline PipelineLibraries::link(const PipelineKey &key, VkPipelineLayout layout, bool optimize) {
+    VkPipeline libraries[PART_COUNT];
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (uint32_t i = 0; i < PART_COUNT; ++i) {
+            auto found = _parts[i].find(partOf(static_cast<Part>(i), key));
+            if (found == _parts[i].end()) {
+                throw std::runtime_error("Error: Pipeline library parts for " + key.description.vertShader + " and " +
+                                         key.description.fragShader + " are missing");
+            }
+            libraries[i] = found->second.get();
+        }
+    }
+
+    VkPipelineLibraryCreateInfoKHR libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    libraryInfo.libraryCount = PART_COUNT;
+    libraryInfo.pLibraries = libraries;
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(_app._device, _app._pipelineCache._cache, 1, &pipelineInfo, _app._allocationCallbacks,
+                                  &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to link graphics pipeline");
+    }
+    return UniquePipeline(_app._device, pipeline, _app._allocationCallbacks);
+}
+
+void PipelineLibraries::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &parts : _parts) {
+        parts.clear();
+    }
+}
+
+void PipelineLibraries::cleanup() {
+    info("Clean up: Pipeline libraries");
+    clear();
+    for (auto &layout : _layouts) {
+        layout.reset();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "pipeline.hpp"
+#include "vk_handle.hpp"
+
+class BaseApplication;
+
+// Graphics pipelines in the four parts VK_EXT_graphics_pipeline_library splits them into: vertex input,
+// pre-rasterization (the vertex shader), fragment shader and fragment output. Each part is built once and shared by
+// every description that agrees on its state, and all but the vertex input by render passes with the same
+// PipelineStateCache::renderPassKey(). Once a description's four parts exist, linking them into a pipeline
+// takes microseconds where a full pipeline compiles for milliseconds. The parts keep their link time optimization
+// info, so the same parts can later be linked again into a pipeline that runs as fast as a full one.
+//
+// Only when _app._pipelineLibrarySupported, PipelineStateCache falls back to full pipelines otherwise.
+class PipelineLibraries {
+public:
+    enum class Part : uint32_t {
+        VertexInput,
+        PreRasterization,
+        FragmentShader,
+        FragmentOutput,
+    };
+    static constexpr uint32_t PART_COUNT = 4;
+
+    BaseApplication &_app;
+
+    explicit PipelineLibraries(BaseApplication &app) : _app(app) {}
+
+    [[nodiscard]] bool isSupported() const;
+
+    // Builds the parts the descriptions need that don't exist yet across the thread pool, each distinct one once.
+    // `renderPassKey` is the key of `renderPass`. Throws if one can't be built.
+    void buildParts(const std::vector<PipelineDescription> &descriptions, VkRenderPass renderPass,
+                    uint64_t renderPassKey);
+
+    [[nodiscard]] bool hasParts(const PipelineKey &key) const;
+
+    // Links the key's parts, which must exist, into a pipeline with `layout`, made for the same description.
+    // Fast linking unless `optimize`, which gives a link time optimized pipeline that takes about as long as a full
+    // one to create.
+    UniquePipeline link(const PipelineKey &key, VkPipelineLayout layout, bool optimize);
+
+    // Destroys the parts, for when the render pass they were built for is replaced. Parts are only ever linked, never
+    // bound, so frames in flight don't use them. Not while anything links.
+    void clear();
+
+    void cleanup();
+
+    [[nodiscard]] uint64_t builtCount() const { return _builtCount.load(); }
+
+private:
+    // The key with only the fields the part is built from, the rest left default, so descriptions that agree on
+    // those fields share the part. The render pass counts for every part but the vertex input.
+    static PipelineKey partOf(Part part, const PipelineKey &key);
+
+    VkPipeline buildPart(Part part, const PipelineDescription &key, VkRenderPass renderPass);
+
+    VkPipelineLayout layout(bool bindless);
+
+    std::unordered_map<PipelineKey, UniquePipeline, PipelineKey::Hasher> _parts[PART_COUNT];
+    UniquePipelineLayout _layouts[2];                         // Plain and bindless, made on first use
+    mutable std::mutex _mutex;
+    std::atomic<uint64_t> _builtCount{0};
+};
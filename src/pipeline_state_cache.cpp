@@ -0,0 +1,343 @@
+#include "pipeline_state_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+void PipelineStateCache::addRenderPass(VkRenderPass renderPass, const VkRenderPassCreateInfo &createInfo) {
+    uint64_t key = renderPassKey(createInfo, 0);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _renderPasses[renderPass] = key;
+}
+
+void PipelineStateCache::removeRenderPass(VkRenderPass renderPass) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _renderPasses.erase(renderPass);
+}
+
+uint64_t PipelineStateCache::renderPassKey(const VkRenderPassCreateInfo &createInfo, uint32_t subpass) {
+    StateHasher hasher;
+    auto addReferences = [&hasher](uint32_t count, const VkAttachmentReference *references) {
+        hasher.add(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            hasher.add(references[i].attachment);
+        }
+    };
+    hasher.add(createInfo.flags);
+    hasher.add(createInfo.attachmentCount);
+    for (uint32_t i = 0; i < createInfo.attachmentCount; ++i) {
+        const VkAttachmentDescription &attachment = createInfo.pAttachments[i];
+        hasher.add(attachment.flags);
+        hasher.add(static_cast<uint32_t>(attachment.format));
+        hasher.add(static_cast<uint32_t>(attachment.samples));
+    }
+    hasher.add(createInfo.subpassCount);
+    for (uint32_t i = 0; i < createInfo.subpassCount; ++i) {
+        const VkSubpassDescription &description = createInfo.pSubpasses[i];
+        hasher.add(description.flags);
+        hasher.add(static_cast<uint32_t>(description.pipelineBindPoint));
+        addReferences(description.inputAttachmentCount, description.pInputAttachments);
+        addReferences(description.colorAttachmentCount, description.pColorAttachments);
+        addReferences(description.pResolveAttachments ? description.colorAttachmentCount : 0,
+                      description.pResolveAttachments);
+        addReferences(description.pDepthStencilAttachment ? 1 : 0, description.pDepthStencilAttachment);
+        hasher.add(description.preserveAttachmentCount);
+        hasher.add(description.pPreserveAttachments, description.preserveAttachmentCount * sizeof(uint32_t));
+    }
+    hasher.add(createInfo.dependencyCount);
+    for (uint32_t i = 0; i < createInfo.dependencyCount; ++i) {
+        const VkSubpassDependency &dependency = createInfo.pDependencies[i];
+        hasher.add(dependency.srcSubpass);
+        hasher.add(dependency.dstSubpass);
+        hasher.add(dependency.srcStageMask);
+        hasher.add(dependency.dstStageMask);
+        hasher.add(dependency.srcAccessMask);
+        hasher.add(dependency.dstAccessMask);
+        hasher.add(dependency.dependencyFlags);
+    }
+    hasher.add(subpass);
+    return hasher.value();
+}
+
+uint64_t PipelineStateCache::keyOf(VkRenderPass renderPass) const {
+    auto found = _renderPasses.find(renderPass);
+    if (found == _renderPasses.end()) {
+        throw std::runtime_error("Error: Pipelines asked for a render pass that wasn't added to the pipeline cache");
+    }
+    return found->second;
+}
+
+std::vector<const BasePipeline *> PipelineStateCache::prepare(const std::vector<PipelineDescription> &descriptions,
+                                                              VkRenderPass renderPass) {
+    std::vector<PipelineDescription> missing;
+    uint64_t passKey;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        passKey = keyOf(renderPass);
+        for (const auto &description : descriptions) {
+            if (_entries.count({description, passKey}) == 0 &&
+                std::find(missing.begin(), missing.end(), description) == missing.end()) {
+                missing.push_back(description);
+            }
+        }
+    }
+    // One batch, so shader modules or library parts shared between the new pipelines are only built once too
+    bool linked = _libraries.isSupported();
+    std::vector<BasePipeline> created;
+    if (!missing.empty()) {
+        created = linked ? linkPipelines(missing, renderPass, passKey)
+                         : BasePipeline::createPipelines(_app, missing, renderPass);
+    }
+    // Pipelines find() started creating may be among the ones asked for
+    waitForCreations();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        std::unique_ptr<Entry> &slot = _entries[{missing[i], passKey}];
+        if (slot && !slot->failed.load()) {
+            // A find() on another thread got there first, and no frame has seen this one
+            created[i].cleanup();
+            continue;
+        }
+        // Nothing runs for a failed entry any more, so it can be replaced
+        slot = std::make_unique<Entry>();
+        slot->pipeline = std::make_unique<BasePipeline>(std::move(created[i]));
+        slot->renderPass = passKey;
+        slot->ready.store(true, std::memory_order_release);
+        ++_created;
+        if (linked) {
+            queueOptimization(slot.get());
+        }
+    }
+    _hits += descriptions.size() - missing.size();
+
+    std::vector<const BasePipeline *> pipelines;
+    for (const auto &description : descriptions) {
+        PipelineKey key{description, passKey};
+        auto found = _entries.find(key);
+        while (found != _entries.end() && !found->second->ready.load(std::memory_order_acquire) &&
+               !found->second->failed.load()) {
+            // Started by a find() on another thread since
+            lock.unlock();
+            waitForCreations();
+            lock.lock();
+            // Should it have failed, a find() meanwhile may have dropped it
+            found = _entries.find(key);
+        }
+        if (found == _entries.end() || !found->second->ready.load(std::memory_order_acquire)) {
+            throw std::runtime_error("Error: Could not create the pipeline for " + description.vertShader + " and " +
+                                     description.fragShader);
+        }
+        pipelines.push_back(found->second->pipeline.get());
+    }
+    info("Success: Prepared {} pipelines, {} created and {} already there with the same state", descriptions.size(),
+         missing.size(), descriptions.size() - missing.size());
+    return pipelines;
+}
+
+const BasePipeline *PipelineStateCache::find(const PipelineDescription &description, VkRenderPass renderPass) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    PipelineKey key{description, keyOf(renderPass)};
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        if (found->second->ready.load(std::memory_order_acquire)) {
+            ++_hits;
+            return found->second->pipeline.get();
+        }
+        if (!found->second->failed.load()) {
+            ++_pendingLookups;
+            return nullptr;
+        }
+        // Its job is done with it and no pointer to it was handed out, so this lookup starts over
+        _entries.erase(found);
+    }
+
+    auto inserted = _entries.emplace(key, std::make_unique<Entry>()).first;
+    Entry *entry = inserted->second.get();
+    entry->renderPass = key.renderPass;
+    bool linked = _libraries.isSupported();
+    if (linked && _libraries.hasParts(key)) {
+        // Only a link away, which is quicker than a trip through the thread pool
+        try {
+            entry->pipeline = std::make_unique<BasePipeline>(fastLink(key));
+            ++_created;
+            entry->ready.store(true, std::memory_order_release);
+            queueOptimization(entry);
+            return entry->pipeline.get();
+        } catch (const std::exception &e) {
+            _entries.erase(inserted);
+            ++_failed;
+            // Tried again on every lookup, which may come every frame
+            LOG_FRAME_WARN("Could not link the pipeline for {} and {}: {}", description.vertShader,
+                           description.fragShader, e.what());
+            return nullptr;
+        }
+    }
+
+    // Finished creations are dropped here, so the list only holds the ones running
+    _creations.erase(std::remove_if(_creations.begin(), _creations.end(), [](const std::future<void> &creation) {
+        return creation.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), _creations.end());
+    _creations.push_back(_app._threadPool.submit([this, entry, key, renderPass, linked]() {
+        const PipelineDescription &description = key.description;
+        try {
+            std::unique_ptr<BasePipeline> pipeline;
+            if (linked) {
+                _libraries.buildParts({description}, renderPass, key.renderPass);
+                pipeline = std::make_unique<BasePipeline>(fastLink(key));
+            } else {
+                pipeline = std::make_unique<BasePipeline>(_app);
+                pipeline->_description = description;
+                pipeline->addShader(description.vertShader, true);
+                pipeline->addShader(description.fragShader, false);
+                pipeline->createPipeline(renderPass);
+                // Modules are only read while creating the pipeline
+                pipeline->_shaderModules = ShaderModules{};
+            }
+            entry->pipeline = std::move(pipeline);
+            ++_created;
+            entry->ready.store(true, std::memory_order_release);
+            if (linked) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                queueOptimization(entry);
+            }
+        } catch (const std::exception &e) {
+            ++_failed;
+            LOG_FRAME_WARN("Could not create the pipeline for {} and {}: {}", description.vertShader,
+                           description.fragShader, e.what());
+            // Last, find() may erase the entry once it sees this
+            entry->failed.store(true);
+        }
+    }));
+    ++_pendingLookups;
+    return nullptr;
+}
+
+void PipelineStateCache::beginFrame() {
+    std::vector<std::pair<Entry *, UniquePipeline>> optimized;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        optimized.swap(_optimized);
+    }
+    for (auto &[entry, pipeline] : optimized) {
+        // Frames in flight may still draw with the fast linked one
+        _app._deletionQueue.retire(std::move(entry->pipeline->_pipeline));
+        entry->pipeline->_pipeline = std::move(pipeline);
+        ++_swapped;
+    }
+}
+
+BasePipeline PipelineStateCache::fastLink(const PipelineKey &key) {
+    auto start = std::chrono::steady_clock::now();
+    BasePipeline pipeline(_app);
+    pipeline._description = key.description;
+    // Identically defined to the layouts the parts were built with, which is all linking asks for
+    pipeline.createLayout();
+    pipeline._pipeline = _libraries.link(key, pipeline._pipelineLayout.get(), false);
+    _fastLinkNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    ++_fastLinked;
+    return pipeline;
+}
+
+std::vector<BasePipeline> PipelineStateCache::linkPipelines(const std::vector<PipelineDescription> &descriptions,
+                                                            VkRenderPass renderPass, uint64_t renderPassKey) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t partsBefore = _libraries.builtCount();
+    _libraries.buildParts(descriptions, renderPass, renderPassKey);
+    std::vector<BasePipeline> pipelines;
+    pipelines.reserve(descriptions.size());
+    for (const auto &description : descriptions) {
+        pipelines.push_back(fastLink({description, renderPassKey}));
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    info("Success: Linked {} pipelines from {} new library parts in {:.3f} ms on {} threads", pipelines.size(),
+         _libraries.builtCount() - partsBefore, totalMs, _app._threadPool.size() + 1);
+    return pipelines;
+}
+
+void PipelineStateCache::queueOptimization(Entry *entry) {
+    _optimizations.erase(std::remove_if(_optimizations.begin(), _optimizations.end(),
+                                        [](const std::future<void> &optimization) {
+        return optimization.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), _optimizations.end());
+    _optimizations.push_back(_app._threadPool.submit([this, entry]() {
+        const BasePipeline &pipeline = *entry->pipeline;
+        try {
+            UniquePipeline optimized = _libraries.link({pipeline._description, entry->renderPass},
+                                                       pipeline._pipelineLayout.get(), true);
+            std::lock_guard<std::mutex> lock(_mutex);
+            _optimized.emplace_back(entry, std::move(optimized));
+        } catch (const std::exception &e) {
+            // The fast linked pipeline stays, it just draws a little slower
+            warn("Could not optimize the pipeline for {} and {}: {}", pipeline._description.vertShader,
+                 pipeline._description.fragShader, e.what());
+        }
+    }));
+}
+
+void PipelineStateCache::clear() {
+    // Creations queue optimizations, so they go first. Both need the library parts.
+    waitForCreations();
+    waitFor(_optimizations);
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &entry : _entries) {
+        if (entry.second->pipeline) {
+            entry.second->pipeline->retire();
+        }
+    }
+    _entries.clear();
+    for (auto &optimized : _optimized) {
+        _app._deletionQueue.retire(std::move(optimized.second));
+    }
+    _optimized.clear();
+    _libraries.clear();
+}
+
+void PipelineStateCache::cleanup() {
+    waitForCreations();
+    waitFor(_optimizations);
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &entry : _entries) {
+        if (entry.second->pipeline) {
+            entry.second->pipeline->cleanup();
+        }
+    }
+    _entries.clear();
+    _renderPasses.clear();
+    _optimized.clear();
+    _libraries.cleanup();
+}
+
+void PipelineStateCache::report() const {
+    size_t cached = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        cached = _entries.size();
+    }
+    info("Pipeline states: {} cached, {} created, {} failed, {} lookups served from the cache, {} while still "
+         "creating", cached, _created.load(), _failed.load(), _hits.load(), _pendingLookups.load());
+    if (_libraries.isSupported() && _fastLinked.load() != 0) {
+        info("\t {} fast linked from {} library parts in {:.1f} us on average, {} swapped for the optimized version",
+             _fastLinked.load(), _libraries.builtCount(), double(_fastLinkNs.load()) / 1000.0 / _fastLinked.load(),
+             _swapped);
+    }
+}
+
+void PipelineStateCache::waitFor(std::vector<std::future<void>> &jobs) {
+    while (true) {
+        std::vector<std::future<void>> running;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            running.swap(jobs);
+        }
+        if (running.empty()) {
+            return;
+        }
+        for (auto &job : running) {
+            job.wait();
+        }
+    }
+}
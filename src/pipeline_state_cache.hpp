@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "pipeline.hpp"
+#include "pipeline_library.hpp"
+#include "vk_handle.hpp"
+
+class BaseApplication;
+
+// Every graphics pipeline the app has made this run, keyed by its PipelineDescription and the render pass it is made
+// for, so materials that come down to the same state share one VkPipeline instead of compiling it again.
+// PipelineCache is the layer below: it keeps the driver's compiled code across runs, this keeps the pipelines
+// themselves.
+//
+// Where the device has graphics pipeline libraries, a new pipeline is fast linked from PipelineLibraries parts and
+// the app draws with it right away. A link time optimized version is made on the thread pool meanwhile and swapped in
+// by beginFrame(). Without them every pipeline is created in full.
+//
+// Render passes count by what makes them compatible rather than by handle, so a render pass that is recreated the same
+// way keeps its pipelines. Whoever creates a render pass that pipelines are made for registers it with
+// addRenderPass(), since a VkRenderPass can't be asked about its attachments.
+//
+// Pipelines stay cached until clear() or cleanup(), so the pointers handed out stay valid until then.
+class PipelineStateCache {
+public:
+    BaseApplication &_app;
+    PipelineLibraries _libraries;
+
+    explicit PipelineStateCache(BaseApplication &app) : _app(app), _libraries(app) {}
+
+    // Pipelines are always made for subpass 0
+    void addRenderPass(VkRenderPass renderPass, const VkRenderPassCreateInfo &createInfo);
+
+    // Before the render pass is retired
+    void removeRenderPass(VkRenderPass renderPass);
+
+    // Everything render pass compatibility compares: each attachment's format and sample count, the attachments
+    // each subpass uses as input, color, resolve and depth/stencil, and the dependencies. Load/store ops and layouts
+    // are left out, pipelines don't depend on them.
+    static uint64_t renderPassKey(const VkRenderPassCreateInfo &createInfo, uint32_t subpass);
+
+    // Creates what isn't cached yet across the thread pool, each distinct description once, and waits for it. For
+    // pipelines a frame can't do without, such as at startup. Throws if one can't be created. The render pass must
+    // have been added, for this and find().
+    std::vector<const BasePipeline *> prepare(const std::vector<PipelineDescription> &descriptions,
+                                              VkRenderPass renderPass);
+
+    // Never blocks: the cached pipeline, or nullptr while it is still being created. A miss starts creating it on
+    // the thread pool, unless its library parts are all there: then it is fast linked on the spot and returned.
+    // A creation that failed is forgotten, so the next lookup tries again. Safe from any thread, also while command
+    // buffers are recorded.
+    const BasePipeline *find(const PipelineDescription &description, VkRenderPass renderPass);
+
+    // Swaps the optimized pipelines finished since the last frame in for their fast linked ones, which go to the
+    // deletion queue. Before the frame records anything, as the handles change under the pointers handed out.
+    void beginFrame();
+
+    // Waits for the creations still running and retires every pipeline through the deletion queue, for when the
+    // render pass they were made for is replaced
+    void clear();
+
+    // Only once the device is idle
+    void cleanup();
+
+    void report() const;
+
+private:
+    struct Entry {
+        std::unique_ptr<BasePipeline> pipeline;
+        uint64_t renderPass = 0;                              // Key of the render pass, for the optimized link
+        std::atomic<bool> ready{false};
+        std::atomic<bool> failed{false};                      // Creation threw, see the log
+    };
+
+    // With _mutex held, throws for a render pass that wasn't added
+    uint64_t keyOf(VkRenderPass renderPass) const;
+
+    // Fast links what `find()` and `prepare()` need right now, the parts must exist
+    BasePipeline fastLink(const PipelineKey &key);
+
+    std::vector<BasePipeline> linkPipelines(const std::vector<PipelineDescription> &descriptions,
+                                            VkRenderPass renderPass, uint64_t renderPassKey);
+
+    // Starts the link time optimized link of the entry's pipeline. With _mutex held.
+    void queueOptimization(Entry *entry);
+
+    // Also what the jobs waited for queue meanwhile
+    void waitFor(std::vector<std::future<void>> &jobs);
+
+    void waitForCreations() { waitFor(_creations); }
+
+    std::unordered_map<PipelineKey, std::unique_ptr<Entry>, PipelineKey::Hasher> _entries;
+    std::unordered_map<VkRenderPass, uint64_t> _renderPasses; // By renderPassKey()
+    mutable std::mutex _mutex;
+    std::vector<std::future<void>> _creations;
+    std::vector<std::future<void>> _optimizations;
+    std::vector<std::pair<Entry *, UniquePipeline>> _optimized; // Done, for beginFrame() to swap in
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _created{0};
+    std::atomic<uint64_t> _pendingLookups{0};                 // find() calls that got nullptr while creating
+    std::atomic<uint64_t> _failed{0};                         // Creations that threw
+    std::atomic<uint64_t> _fastLinked{0};
+    std::atomic<uint64_t> _fastLinkNs{0};                     // Summed over _fastLinked
+    uint64_t _swapped = 0;                                    // Fast linked pipelines replaced by optimized ones
+};
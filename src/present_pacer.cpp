@@ -0,0 +1,107 @@
+#include "present_pacer.hpp"
+
+#include <thread>
+#include "base.hpp"
+#include "log.hpp"
+
+namespace {
+
+// Upper bound on one pacing wait, so a present that never completes (hidden window) can't hang the loop
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100ull * 1000 * 1000;
+
+// Mailbox replaces queued images instead of waiting for vblank, immediate may tear, FIFO is the vsync fallback.
+// Lowest latency renders one frame at a time and starts it once the previous one is on screen. Throughput queues as
+// much as FIFO allows. Power saving runs at a capped rate with the fewest images.
+const PresentPolicySettings POLICY_SETTINGS[] = {
+        {{VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR}, 1, 1, 0, 0.0},
+        {{VK_PRESENT_MODE_FIFO_KHR}, 2, 3, UINT32_MAX, 0.0},
+        {{VK_PRESENT_MODE_FIFO_KHR}, 0, 2, 1, 30.0},
+};
+
+const char *POLICY_NAMES[] = {"lowest-latency", "vsync-throughput", "power-saving"};
+
+}
+
+void PresentPacer::init() {
+    if (_presentWaitSupported) {
+        _waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+                vkGetDeviceProcAddr(_app._device, "vkWaitForPresentKHR"));
+        _presentWaitSupported = _waitForPresent != nullptr;
+    }
+    const PresentPolicySettings &policy = settings();
+    info("Success: Present policy {} ({} frames in flight, {}, latency measured {})", name(_policy),
+         _app._framesInFlight, policy.maxFps > 0.0 ? "frame rate capped" : "no frame rate cap",
+         _presentWaitSupported ? "to display" : "to the present call");
+}
+
+const PresentPolicySettings &PresentPacer::settings() const {
+    return POLICY_SETTINGS[static_cast<int>(_policy)];
+}
+
+void PresentPacer::pace() {
+    const PresentPolicySettings &policy = settings();
+    if (_presentWaitSupported) {
+        collectPresents(policy.maxQueuedPresents, PRESENT_WAIT_TIMEOUT_NS);
+    }
+    if (policy.maxFps > 0.0) {
+        auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / policy.maxFps));
+        std::this_thread::sleep_until(_lastFrameStart + period);
+    }
+    _lastFrameStart = Clock::now();
+}
+
+void PresentPacer::markInput() {
+    _input = Clock::now();
+}
+
+void PresentPacer::preparePresent(VkPresentInfoKHR &presentInfo, VkPresentIdKHR &presentIdInfo) {
+    if (!_presentWaitSupported) {
+        _latency.addSample(std::chrono::duration<double, std::milli>(Clock::now() - _input).count());
+        return;
+    }
+    _presentId = _nextId++;
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.pNext = presentInfo.pNext;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &_presentId;
+    presentInfo.pNext = &presentIdInfo;
+    _pending.push_back({_presentId, _input});
+}
+
+void PresentPacer::swapChainRecreated() {
+    _pending.clear();
+}
+
+void PresentPacer::report() const {
+    _latency.report(_presentWaitSupported ? "Input to present (on display)" : "Input to present (present call)");
+}
+
+const char *PresentPacer::name(PresentPolicy policy) {
+    return POLICY_NAMES[static_cast<int>(policy)];
+}
+
+bool PresentPacer::parse(const std::string &name, PresentPolicy &policy) {
+    for (int i = 0; i < 3; ++i) {
+        if (name == POLICY_NAMES[i]) {
+            policy = static_cast<PresentPolicy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PresentPacer::collectPresents(size_t maxQueued, uint64_t timeoutNs) {
+    while (!_pending.empty()) {
+        uint64_t timeout = _pending.size() > maxQueued ? timeoutNs : 0;
+        VkResult result = _waitForPresent(_app._device, _app._swapChain, _pending.front().id, timeout);
+        if (result == VK_TIMEOUT) {
+            break;
+        }
+        // Out of date or surface lost: the present is gone either way and the swap chain is about to be replaced
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+            auto latency = Clock::now() - _pending.front().input;
+            _latency.addSample(std::chrono::duration<double, std::milli>(latency).count());
+        }
+        _pending.pop_front();
+    }
+}
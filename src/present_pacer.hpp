@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "frame.hpp"
+
+class BaseApplication;
+
+enum class PresentPolicy {
+    LowestLatency,                                            // Interactive: input is sampled as late as possible
+    VsyncThroughput,                                          // Batch: keep the GPU fed, never tear
+    PowerSaving,                                              // Vsync at a capped rate, CPU and GPU idle in between
+};
+
+struct PresentPolicySettings {
+    std::vector<VkPresentModeKHR> presentModes;               // In order of preference, FIFO is always there
+    uint32_t extraImages;                                     // Swap chain images on top of the surface's minimum
+    uint32_t framesInFlight;                                  // Used unless the app sets _framesInFlight itself
+    uint32_t maxQueuedPresents;                               // A frame starts once at most this many await display
+    double maxFps;                                            // CPU frame rate cap, 0: none
+};
+
+// Applies the app's present policy: the swap chain takes its present mode and image count from here, and the main
+// loop calls pace() before sampling input to hold the CPU back as the policy wants. With VK_KHR_present_id and
+// VK_KHR_present_wait every present gets an id, waiting on the id tells when the image actually reached the display,
+// and input-to-present latency is measured up to that point. Without them the pacing only uses the frame rate cap
+// and latency is measured up to the vkQueuePresentKHR call, which leaves out the time spent queued for display.
+class PresentPacer {
+public:
+    BaseApplication &_app;
+    PresentPolicy _policy = PresentPolicy::VsyncThroughput;
+    bool _presentWaitSupported = false;                       // present_id and present_wait are both enabled
+    FrameTimer _latency;                                      // Input sampled to image presented, in ms
+
+    explicit PresentPacer(BaseApplication &app) : _app(app) {}
+
+    // Loads vkWaitForPresentKHR when the extensions are enabled
+    void init();
+
+    [[nodiscard]] const PresentPolicySettings &settings() const;
+
+    // Blocks until the policy allows the next frame to start. Call before polling input.
+    void pace();
+
+    // Right after input was polled, the start of the latency measurement
+    void markInput();
+
+    // Call right before vkQueuePresentKHR, chains the present id into `presentInfo` when present wait is on.
+    // `presentIdInfo` has to stay alive until the present call.
+    void preparePresent(VkPresentInfoKHR &presentInfo, VkPresentIdKHR &presentIdInfo);
+
+    // Presents still pending belong to the retired swap chain, their ids can't be waited on any more
+    void swapChainRecreated();
+
+    void report() const;
+
+    static const char *name(PresentPolicy policy);
+
+    // Accepts "lowest-latency", "vsync-throughput" and "power-saving"
+    static bool parse(const std::string &name, PresentPolicy &policy);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingPresent {
+        uint64_t id;
+        Clock::time_point input;
+    };
+
+    // Waits up to `timeoutNs` each for the oldest presents until at most `maxQueued` are left, then records every
+    // other one that has already completed
+    void collectPresents(size_t maxQueued, uint64_t timeoutNs);
+
+    PFN_vkWaitForPresentKHR _waitForPresent = nullptr;
+    std::deque<PendingPresent> _pending;
+    uint64_t _nextId = 1;                                     // Ids only have to grow within one swap chain
+    uint64_t _presentId = 0;                                  // Of the present being prepared
+    Clock::time_point _input{};
+    Clock::time_point _lastFrameStart{};
+};
@@ -0,0 +1,216 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include "base.hpp"
+#include "log.hpp"
+
+void Profiler::init() {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(_app._physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(_app._physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t validBits = queueFamilies[_app._indices.graphicsFamily.value()].timestampValidBits;
+    _timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    _timestampPeriodNs = _app._deviceProperties.limits.timestampPeriod;
+
+    for (uint32_t i = 0; i < _app._framesInFlight; ++i) {
+        _frames.push_back(std::make_unique<FrameQueries>());
+        if (_timestampMask == 0) {
+            continue;
+        }
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = MAX_GPU_QUERIES;
+        if (vkCreateQueryPool(_app._device, &queryPoolInfo, _app._allocationCallbacks, &_frames.back()->queryPool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create timestamp query pool");
+        }
+    }
+    if (_timestampMask == 0) {
+        info("\t Graphics queue has no timestamps, profiling CPU scopes only");
+    } else {
+        info("Success: GPU profiler ready with {} valid timestamp bits and a {:.3f} ns period", validBits,
+             _timestampPeriodNs);
+    }
+}
+
+void Profiler::cleanup() {
+    info("Clean up: Profiler");
+    if (!_tracePath.empty()) {
+        writeTrace(_tracePath);
+    }
+    for (auto &frame : _frames) {
+        vkDestroyQueryPool(_app._device, frame->queryPool, _app._allocationCallbacks);
+    }
+    _frames.clear();
+}
+
+void Profiler::beginFrame(uint32_t frameSlot) {
+    _currentSlot = frameSlot;
+    if (_frames.empty()) {
+        return;
+    }
+    FrameQueries &frame = *_frames[frameSlot];
+    if (!frame.pending) {
+        return;
+    }
+    frame.pending = false;
+    uint32_t queryCount = std::min(frame.nextQuery.load(), MAX_GPU_QUERIES);
+    frame.nextQuery = 0;
+    if (queryCount == 0) {
+        return;
+    }
+
+    // The slot's fence has signalled, so this doesn't wait. Each query comes with its availability after its value.
+    std::vector<uint64_t> results(queryCount * 2);
+    vkGetQueryPoolResults(_app._device, frame.queryPool, 0, queryCount, results.size() * sizeof(uint64_t),
+                          results.data(), 2 * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    auto available = [&results](uint32_t query) { return results[query * 2 + 1] != 0; };
+    auto ticks = [&results](uint32_t query) { return results[query * 2]; };
+
+    // The trace places the frame's earliest timestamp at its submit time. The GPU may start a little later, but the
+    // scopes stay correct relative to each other.
+    uint64_t frameStart = UINT64_MAX;
+    for (const auto &scope : frame.scopes) {
+        if (available(scope.beginQuery)) {
+            frameStart = std::min(frameStart, ticks(scope.beginQuery));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &scope : frame.scopes) {
+        if (!available(scope.beginQuery) || !available(scope.beginQuery + 1)) {
+            continue;
+        }
+        uint64_t begin = ticks(scope.beginQuery);
+        uint64_t elapsed = (ticks(scope.beginQuery + 1) - begin) & _timestampMask;
+        double durationUs = static_cast<double>(elapsed) * _timestampPeriodNs / 1000.0;
+        addSample(std::string("gpu:") + scope.name, durationUs / 1000.0);
+        double offsetUs = static_cast<double>((begin - frameStart) & _timestampMask) * _timestampPeriodNs / 1000.0;
+        addTraceEvent({scope.name, frame.submitUs + offsetUs, durationUs, UINT32_MAX});
+    }
+    frame.scopes.clear();
+}
+
+void Profiler::resetQueries(VkCommandBuffer commandBuffer) {
+    if (_timestampMask == 0) {
+        return;
+    }
+    FrameQueries &frame = *_frames[_currentSlot];
+    vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_GPU_QUERIES);
+    frame.pending = true;
+}
+
+void Profiler::markSubmit() {
+    if (!_frames.empty()) {
+        _frames[_currentSlot]->submitUs =
+                std::chrono::duration<double, std::micro>(Clock::now() - _epoch).count();
+    }
+}
+
+uint32_t Profiler::beginGpuScope(VkCommandBuffer commandBuffer, const char *name) {
+    if (_timestampMask == 0) {
+        return UINT32_MAX;
+    }
+    FrameQueries &frame = *_frames[_currentSlot];
+    uint32_t query = frame.nextQuery.fetch_add(2);
+    if (query + 2 > MAX_GPU_QUERIES) {
+        return UINT32_MAX;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, query);
+    std::lock_guard<std::mutex> lock(_mutex);
+    frame.scopes.push_back({name, query});
+    return query;
+}
+
+void Profiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    if (scope == UINT32_MAX) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _frames[_currentSlot]->queryPool,
+                        scope + 1);
+}
+
+void Profiler::recordCpuScope(const char *name, Clock::time_point start, Clock::time_point end) {
+    double startUs = std::chrono::duration<double, std::micro>(start - _epoch).count();
+    double durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+    std::lock_guard<std::mutex> lock(_mutex);
+    addSample(name, durationUs / 1000.0);
+    addTraceEvent({name, startUs, durationUs, threadIndex()});
+}
+
+FrameStats Profiler::scopeStats(const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto stats = _stats.find(name);
+    return stats != _stats.end() ? stats->second.stats() : FrameStats{};
+}
+
+void Profiler::report() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &stats : _stats) {
+        stats.second.report(stats.first.c_str());
+    }
+}
+
+bool Profiler::writeTrace(const std::string &path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        warn("Could not write trace to {}", path);
+        return false;
+    }
+    // pid 1 holds a track per CPU thread, pid 2 the GPU queue
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    for (const auto &thread : _threads) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                      "\"args\":{\"name\":\"thread %u\"}}", thread.second, thread.second);
+    }
+    for (const auto &event : _traceEvents) {
+        bool gpu = event.thread == UINT32_MAX;
+        fprintf(file, ",\n{\"name\":\"");
+        // Names are identifiers in practice, keep the JSON valid anyway
+        for (const char *c = event.name; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', file);
+            }
+            fputc(*c, file);
+        }
+        fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                gpu ? "gpu" : "cpu", event.startUs, event.durationUs, gpu ? 2 : 1, gpu ? 0 : event.thread);
+    }
+    fprintf(file, "\n]}\n");
+    bool written = fclose(file) == 0;
+    if (written) {
+        info("Success: Wrote {} trace events to {}", _traceEvents.size(), path);
+    }
+    return written;
+}
+
+// The helpers below expect _mutex to be held
+
+void Profiler::addSample(const std::string &name, double ms) {
+    _stats.try_emplace(name, STAT_SAMPLES).first->second.addSample(ms);
+}
+
+void Profiler::addTraceEvent(const TraceEvent &event) {
+    if (_tracePath.empty()) {
+        return;
+    }
+    if (_traceEvents.size() >= MAX_TRACE_EVENTS) {
+        if (!_traceFull) {
+            warn("Trace is full after {} events, only stats are collected from here", MAX_TRACE_EVENTS);
+            _traceFull = true;
+        }
+        return;
+    }
+    _traceEvents.push_back(event);
+}
+
+uint32_t Profiler::threadIndex() {
+    return _threads.try_emplace(std::this_thread::get_id(), static_cast<uint32_t>(_threads.size())).first->second;
+}
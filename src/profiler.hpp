@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "frame.hpp"
+
+class BaseApplication;
+
+// Named CPU and GPU scopes. GPU scopes are timestamp query pairs, one query pool per frame slot, read back when the
+// slot comes round again so nothing ever waits on the GPU for them. Every scope feeds live per-name stats, and with a
+// trace path set the scopes are also written as a Chrome trace_event file (chrome://tracing, Perfetto) at cleanup.
+// Scope names must outlive the profiler, string literals are the intended use.
+class Profiler {
+public:
+    static constexpr uint32_t MAX_GPU_QUERIES = 512;          // Per frame slot, two per scope
+    static constexpr size_t MAX_TRACE_EVENTS = 4000000;       // Stops collecting past this, stats keep going
+    static constexpr size_t STAT_SAMPLES = 1000;              // Rolling window for the per-scope stats
+
+    BaseApplication &_app;
+    std::string _tracePath;                                   // Empty: no trace file
+
+    explicit Profiler(BaseApplication &app) : _app(app), _epoch(Clock::now()) {}
+
+    // Needs the device and the number of frames in flight
+    void init();
+
+    // Writes the trace file if there is one
+    void cleanup();
+
+    // Call once the slot's fence has signalled: collects the slot's GPU scopes from its previous frame
+    void beginFrame(uint32_t frameSlot);
+
+    // At the start of the frame's primary command buffer, outside any render pass
+    void resetQueries(VkCommandBuffer commandBuffer);
+
+    // Right after the frame's submit, lines the GPU timeline up with the CPU one in the trace
+    void markSubmit();
+
+    // Safe to call from several threads recording into different command buffers of the same frame.
+    // Returns the scope to hand to endGpuScope, UINT32_MAX when GPU profiling is off or the slot ran out of queries.
+    uint32_t beginGpuScope(VkCommandBuffer commandBuffer, const char *name);
+
+    void endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    void recordCpuScope(const char *name, std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end);
+
+    // Live stats of one scope, GPU scopes are named "gpu:<name>"
+    [[nodiscard]] FrameStats scopeStats(const std::string &name);
+
+    // Logs every scope's stats
+    void report();
+
+    bool writeTrace(const std::string &path);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct GpuScopeRecord {
+        const char *name;
+        uint32_t beginQuery;
+    };
+
+    struct FrameQueries {
+        VkQueryPool queryPool{};
+        std::atomic<uint32_t> nextQuery{0};
+        std::vector<GpuScopeRecord> scopes;
+        double submitUs = 0.0;                                // CPU time of the submit, for the trace
+        bool pending = false;
+    };
+
+    struct TraceEvent {
+        const char *name;
+        double startUs;
+        double durationUs;
+        uint32_t thread;                                      // UINT32_MAX for the GPU track
+    };
+
+    void addSample(const std::string &name, double ms);
+
+    void addTraceEvent(const TraceEvent &event);
+
+    uint32_t threadIndex();
+
+    Clock::time_point _epoch;
+    double _timestampPeriodNs = 1.0;
+    uint64_t _timestampMask = 0;                              // 0 when the graphics queue can't write timestamps
+    std::vector<std::unique_ptr<FrameQueries>> _frames;
+    uint32_t _currentSlot = 0;
+    std::map<std::string, FrameTimer> _stats;
+    std::vector<TraceEvent> _traceEvents;
+    bool _traceFull = false;
+    std::unordered_map<std::thread::id, uint32_t> _threads;
+    std::mutex _mutex;
+};
+
+// Times the enclosing block on the CPU
+class CpuScope {
+public:
+    CpuScope(Profiler &profiler, const char *name)
+            : _profiler(profiler), _name(name), _start(std::chrono::steady_clock::now()) {}
+
+    ~CpuScope() { _profiler.recordCpuScope(_name, _start, std::chrono::steady_clock::now()); }
+
+    CpuScope(const CpuScope &) = delete;
+
+    CpuScope &operator=(const CpuScope &) = delete;
+
+private:
+    Profiler &_profiler;
+    const char *_name;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Times the commands recorded into `commandBuffer` while the block is open
+class GpuScope {
+public:
+    GpuScope(Profiler &profiler, VkCommandBuffer commandBuffer, const char *name)
+            : _profiler(profiler), _commandBuffer(commandBuffer),
+              _scope(profiler.beginGpuScope(commandBuffer, name)) {}
+
+    ~GpuScope() { _profiler.endGpuScope(_commandBuffer, _scope); }
+
+    GpuScope(const GpuScope &) = delete;
+
+    GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+    Profiler &_profiler;
+    VkCommandBuffer _commandBuffer;
+    uint32_t _scope;
+};
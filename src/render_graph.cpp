@@ -0,0 +1,724 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+namespace {
+
+struct UsageTraits {
+    VkPipelineStageFlags stages;
+    VkAccessFlags readAccess;
+    VkAccessFlags writeAccess;
+    VkImageLayout layout;                                     // Undefined for buffer-only usages
+    VkImageUsageFlags imageUsage;
+};
+
+// Indexed by GraphUsage
+const UsageTraits USAGE_TRAITS[] = {
+        {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+        {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT},
+        {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+         VK_IMAGE_USAGE_SAMPLED_BIT},
+        {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+         VK_IMAGE_USAGE_SAMPLED_BIT},
+        {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_GENERAL,
+         VK_IMAGE_USAGE_STORAGE_BIT},
+        {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+         VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT},
+        {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+         VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
+        {VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+         VK_IMAGE_USAGE_TRANSFER_DST_BIT},
+        {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0},
+        {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, 0,
+         VK_IMAGE_LAYOUT_UNDEFINED, 0},
+};
+
+const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                   VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                                   VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+const UsageTraits &traits(GraphUsage usage) {
+    return USAGE_TRAITS[static_cast<size_t>(usage)];
+}
+
+VkImageAspectFlags aspectMask(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+    return firstA <= lastB && firstB <= lastA;
+}
+
+}
+
+void RenderGraph::reset() {
+    DeletionQueue &deletionQueue = _app._deletionQueue;
+    for (auto &pass : _passes) {
+        if (pass.renderPass) {
+            _app._pipelineStates.removeRenderPass(pass.renderPass.get());
+        }
+        deletionQueue.retire(std::move(pass.renderPass));
+        for (auto &framebuffer : pass.framebuffers) {
+            deletionQueue.retire(std::move(framebuffer.second));
+        }
+    }
+    for (auto &image : _images) {
+        deletionQueue.retire(std::move(image.ownedView));
+        deletionQueue.retire(std::move(image.ownedImage));
+    }
+    // Queued after the images bound to them, the queue destroys in order
+    for (auto &group : _aliasGroups) {
+        if (group.allocation.memory != VK_NULL_HANDLE) {
+            deletionQueue.push([this, allocation = group.allocation]() mutable { _app._allocator.free(allocation); });
+        }
+    }
+    _passes.clear();
+    _order.clear();
+    _images.clear();
+    _buffers.clear();
+    _aliasGroups.clear();
+    _final = Pass{};
+}
+
+void RenderGraph::cleanup() {
+    info("Clean up: Render graph");
+    reset();
+}
+
+uint32_t RenderGraph::createImage(const std::string &name, const GraphImageDesc &desc) {
+    _images.emplace_back();
+    Image &image = _images.back();
+    image.name = name;
+    image.desc = desc;
+    return static_cast<uint32_t>(_images.size() - 1);
+}
+
+uint32_t RenderGraph::importImage(const std::string &name, VkImage image, VkImageView view,
+                                  const GraphImageDesc &desc, const GraphResourceState &initial,
+                                  const GraphResourceState *final) {
+    uint32_t index = createImage(name, desc);
+    Image &imported = _images[index];
+    imported.imported = true;
+    imported.image = image;
+    imported.view = view;
+    imported.initial = initial;
+    if (final != nullptr) {
+        imported.hasFinal = true;
+        imported.final = *final;
+    }
+    return index;
+}
+
+uint32_t RenderGraph::importBuffer(const std::string &name, VkBuffer buffer, const GraphResourceState &initial,
+                                   const GraphResourceState *final) {
+    _buffers.emplace_back();
+    Buffer &imported = _buffers.back();
+    imported.name = name;
+    imported.buffer = buffer;
+    imported.initial = initial;
+    if (final != nullptr) {
+        imported.hasFinal = true;
+        imported.final = *final;
+    }
+    return static_cast<uint32_t>(_buffers.size() - 1);
+}
+
+void RenderGraph::updateImport(uint32_t image, VkImage vkImage, VkImageView view) {
+    _images[image].image = vkImage;
+    _images[image].view = view;
+}
+
+void RenderGraph::addPass(const std::string &name, const Setup &setup, Execute execute) {
+    _passes.emplace_back();
+    Pass &pass = _passes.back();
+    pass.name = name;
+    PassBuilder builder(pass);
+    setup(builder);
+    pass.execute = std::move(execute);
+}
+
+void RenderGraph::compile() {
+    if (_passes.empty()) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    cullPasses();
+    orderPasses();
+    for (uint32_t position = 0; position < _order.size(); ++position) {
+        for (const auto &access : _passes[_order[position]].accesses) {
+            if (access.image) {
+                Image &image = _images[access.resource];
+                image.firstUse = std::min(image.firstUse, position);
+                image.lastUse = position;
+                image.usage |= traits(access.usage).imageUsage;
+            }
+        }
+    }
+    createTransientImages();
+    for (uint32_t position = 0; position < _order.size(); ++position) {
+        Pass &pass = _passes[_order[position]];
+        if (!pass.colorAttachments.empty() || pass.depthAttachment.image != INVALID) {
+            createRenderPass(pass, position);
+        }
+    }
+    planBarriers();
+    double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_FRAME_INFO("Success: Compiled render graph with {} passes ({} culled) in {:.3f} ms", _order.size(),
+                   _passes.size() - _order.size(), compileMs);
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+    GpuScope scope(_app._profiler, commandBuffer, "render graph");
+    for (uint32_t index : _order) {
+        Pass &pass = _passes[index];
+        recordBarriers(commandBuffer, pass);
+        if (!pass.renderPass) {
+            pass.execute(commandBuffer);
+            continue;
+        }
+        std::vector<VkClearValue> clearValues;
+        for (const auto &attachment : pass.colorAttachments) {
+            clearValues.push_back(attachment.clear);
+        }
+        if (pass.depthAttachment.image != INVALID) {
+            clearValues.push_back(pass.depthAttachment.clear);
+        }
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.renderPass.get();
+        renderPassInfo.framebuffer = framebuffer(pass);
+        renderPassInfo.renderArea.extent = pass.extent;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        pass.execute(commandBuffer);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+    recordBarriers(commandBuffer, _final);
+}
+
+VkRenderPass RenderGraph::renderPass(const std::string &pass) const {
+    for (const auto &candidate : _passes) {
+        if (candidate.name == pass) {
+            return candidate.renderPass.get();
+        }
+    }
+    return VK_NULL_HANDLE;
+}
+
+void RenderGraph::cullPasses() {
+    // Walking backwards, a pass stays if it has side effects or writes something a later live pass reads. A pass
+    // that overwrites a resource without reading it ends the need for whatever was written to it before.
+    std::vector<bool> neededImages(_images.size(), false);
+    for (size_t i = _passes.size(); i-- > 0;) {
+        Pass &pass = _passes[i];
+        pass.alive = pass.sideEffect;
+        for (const auto &access : pass.accesses) {
+            // Buffers are always imported
+            if (access.write && (!access.image || _images[access.resource].imported || neededImages[access.resource])) {
+                pass.alive = true;
+            }
+        }
+        if (!pass.alive) {
+            continue;
+        }
+        for (const auto &access : pass.accesses) {
+            if (access.image && access.write) {
+                neededImages[access.resource] = false;
+            }
+        }
+        for (const auto &access : pass.accesses) {
+            if (access.image && !access.write) {
+                neededImages[access.resource] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::orderPasses() {
+    std::vector<uint32_t> alive;
+    for (uint32_t i = 0; i < _passes.size(); ++i) {
+        if (_passes[i].alive) {
+            alive.push_back(i);
+        }
+    }
+    // Two passes depend on each other when they touch the same resource and at least one of them writes it, the
+    // one declared first has to go first
+    auto conflicts = [](const Pass &first, const Pass &second) {
+        for (const auto &a : first.accesses) {
+            for (const auto &b : second.accesses) {
+                if (a.image == b.image && a.resource == b.resource && (a.write || b.write)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    std::vector<std::vector<size_t>> dependencies(alive.size());
+    for (size_t j = 0; j < alive.size(); ++j) {
+        for (size_t i = 0; i < j; ++i) {
+            if (conflicts(_passes[alive[i]], _passes[alive[j]])) {
+                dependencies[j].push_back(i);
+            }
+        }
+    }
+
+    // Topological order. Of the passes that are ready, the one whose inputs were finished the longest ago goes first,
+    // which moves producers and consumers apart so the barriers between them have less to wait for.
+    std::vector<int> position(alive.size(), -1);
+    _order.clear();
+    while (_order.size() < alive.size()) {
+        size_t best = alive.size();
+        int bestKey = 0;
+        for (size_t j = 0; j < alive.size(); ++j) {
+            if (position[j] >= 0) {
+                continue;
+            }
+            bool ready = true;
+            int key = -1;
+            for (size_t i : dependencies[j]) {
+                if (position[i] < 0) {
+                    ready = false;
+                    break;
+                }
+                key = std::max(key, position[i]);
+            }
+            if (ready && (best == alive.size() || key < bestKey)) {
+                best = j;
+                bestKey = key;
+            }
+        }
+        position[best] = static_cast<int>(_order.size());
+        _order.push_back(alive[best]);
+    }
+}
+
+void RenderGraph::createTransientImages() {
+    VkDevice device = _app._device;
+    std::vector<uint32_t> transient;
+    std::vector<VkMemoryRequirements> requirements(_images.size());
+    for (uint32_t i = 0; i < _images.size(); ++i) {
+        Image &image = _images[i];
+        if (image.imported || image.firstUse == INVALID) {
+            continue;
+        }
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = image.desc.format;
+        imageInfo.extent = {image.desc.extent.width, image.desc.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = image.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage vkImage;
+        if (vkCreateImage(device, &imageInfo, _app._allocationCallbacks, &vkImage) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create render graph image " + image.name);
+        }
+        image.ownedImage.reset(device, vkImage, _app._allocationCallbacks);
+        image.image = vkImage;
+        vkGetImageMemoryRequirements(device, vkImage, &requirements[i]);
+        transient.push_back(i);
+    }
+
+    // Greedy, biggest first: an image joins the first group whose memory types fit and whose images are all dead
+    // by the time it is first used, or alive only after it was last used
+    std::sort(transient.begin(), transient.end(), [&](uint32_t a, uint32_t b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    VkDeviceSize separateBytes = 0;
+    for (uint32_t i : transient) {
+        const Image &image = _images[i];
+        separateBytes += requirements[i].size;
+        AliasGroup *target = nullptr;
+        for (auto &group : _aliasGroups) {
+            bool fits = (group.requirements.memoryTypeBits & requirements[i].memoryTypeBits) != 0;
+            for (size_t k = 0; fits && k < group.images.size(); ++k) {
+                const Image &other = _images[group.images[k]];
+                fits = !overlaps(image.firstUse, image.lastUse, other.firstUse, other.lastUse);
+            }
+            if (fits) {
+                target = &group;
+                break;
+            }
+        }
+        if (target == nullptr) {
+            _aliasGroups.emplace_back();
+            target = &_aliasGroups.back();
+            target->requirements = requirements[i];
+        }
+        target->images.push_back(i);
+        target->requirements.size = std::max(target->requirements.size, requirements[i].size);
+        target->requirements.alignment = std::max(target->requirements.alignment, requirements[i].alignment);
+        target->requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+    }
+
+    VkDeviceSize aliasedBytes = 0;
+    for (auto &group : _aliasGroups) {
+        std::sort(group.images.begin(), group.images.end(), [&](uint32_t a, uint32_t b) {
+            return _images[a].firstUse < _images[b].firstUse;
+        });
+        group.allocation = _app._allocator.allocate(group.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                                                    ResourceKind::Optimal);
+        aliasedBytes += group.requirements.size;
+        for (uint32_t i : group.images) {
+            Image &image = _images[i];
+            if (vkBindImageMemory(device, image.image, group.allocation.memory, group.allocation.offset) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Error: Could not bind memory to render graph image " + image.name);
+            }
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = image.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = image.desc.format;
+            viewInfo.subresourceRange = {aspectMask(image.desc.format), 0, 1, 0, 1};
+            VkImageView view;
+            if (vkCreateImageView(device, &viewInfo, _app._allocationCallbacks, &view) != VK_SUCCESS) {
+                throw std::runtime_error("Error: Could not create view of render graph image " + image.name);
+            }
+            image.ownedView.reset(device, view, _app._allocationCallbacks);
+            image.view = view;
+        }
+    }
+    if (!transient.empty()) {
+        LOG_FRAME_INFO("Success: {} transient images in {} allocations, {:.1f} MB instead of {:.1f} MB",
+                       transient.size(), _aliasGroups.size(), aliasedBytes / (1024.0 * 1024.0),
+                       separateBytes / (1024.0 * 1024.0));
+    }
+}
+
+void RenderGraph::createRenderPass(Pass &pass, uint32_t position) {
+    std::vector<VkAttachmentDescription> attachments;
+    auto describe = [&](const Attachment &attachment, VkImageLayout layout) {
+        const Image &image = _images[attachment.image];
+        VkAttachmentDescription description{};
+        description.format = image.desc.format;
+        description.samples = VK_SAMPLE_COUNT_1_BIT;
+        switch (attachment.load) {
+            case AttachmentLoad::Clear:
+                description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                break;
+            case AttachmentLoad::Load:
+                description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                break;
+            case AttachmentLoad::DontCare:
+                description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                break;
+        }
+        // Nothing after this pass reads a transient image, the tiles don't need to be written back
+        description.storeOp = !image.imported && image.lastUse == position ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                                                                           : VK_ATTACHMENT_STORE_OP_STORE;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // The barriers in front of the pass do the transitions
+        description.initialLayout = layout;
+        description.finalLayout = layout;
+        attachments.push_back(description);
+        if (pass.extent.width == 0) {
+            pass.extent = image.desc.extent;
+        } else if (pass.extent.width != image.desc.extent.width || pass.extent.height != image.desc.extent.height) {
+            throw std::runtime_error("Error: Render graph pass " + pass.name + " has attachments of different sizes");
+        }
+        return VkAttachmentReference{static_cast<uint32_t>(attachments.size() - 1), layout};
+    };
+
+    std::vector<VkAttachmentReference> colorReferences;
+    for (const auto &attachment : pass.colorAttachments) {
+        colorReferences.push_back(describe(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+    }
+    VkAttachmentReference depthReference{};
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+    subpass.pColorAttachments = colorReferences.data();
+    if (pass.depthAttachment.image != INVALID) {
+        depthReference = describe(pass.depthAttachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        subpass.pDepthStencilAttachment = &depthReference;
+    }
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    VkRenderPass renderPass;
+    if (vkCreateRenderPass(_app._device, &renderPassInfo, _app._allocationCallbacks, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create render pass for render graph pass " + pass.name);
+    }
+    pass.renderPass.reset(_app._device, renderPass, _app._allocationCallbacks);
+    // So pipelines can be made for the pass
+    _app._pipelineStates.addRenderPass(renderPass, renderPassInfo);
+}
+
+RenderGraph::Usage RenderGraph::passUsage(const Pass &pass, uint32_t resource, bool image) const {
+    Usage usage;
+    for (const auto &access : pass.accesses) {
+        if (access.image != image || access.resource != resource) {
+            continue;
+        }
+        const UsageTraits &usageTraits = traits(access.usage);
+        if (usage.used && image && usage.layout != usageTraits.layout) {
+            throw std::runtime_error("Error: Render graph pass " + pass.name + " needs " + _images[resource].name +
+                                     " in two layouts at once");
+        }
+        usage.stages |= usageTraits.stages;
+        usage.access |= access.write ? usageTraits.writeAccess : usageTraits.readAccess;
+        usage.layout = usageTraits.layout;
+        usage.write |= access.write;
+        usage.used = true;
+    }
+    return usage;
+}
+
+void RenderGraph::planBarriers() {
+    // A transient image finds undefined contents at its first use, but it has to wait for whoever had the memory
+    // before: the previous image of its alias group, or for the group's first image, the group's last one in the
+    // previous frame
+    std::vector<Usage> lastUsage(_images.size());
+    for (uint32_t i = 0; i < _images.size(); ++i) {
+        if (_images[i].lastUse != INVALID) {
+            lastUsage[i] = passUsage(_passes[_order[_images[i].lastUse]], i, true);
+        }
+    }
+    for (const auto &group : _aliasGroups) {
+        for (size_t k = 0; k < group.images.size(); ++k) {
+            uint32_t previous = group.images[(k + group.images.size() - 1) % group.images.size()];
+            TrackedState &tracked = _images[group.images[k]].tracked;
+            tracked = TrackedState{};
+            tracked.writeStages = lastUsage[previous].stages;
+            tracked.writeAccess = lastUsage[previous].access & WRITE_ACCESS;
+        }
+    }
+    // Imports start out as the app left them, only pending writes need making available
+    auto importState = [](const GraphResourceState &initial) {
+        TrackedState tracked;
+        tracked.layout = initial.layout;
+        if ((initial.access & WRITE_ACCESS) != 0) {
+            tracked.writeStages = initial.stages;
+            tracked.writeAccess = initial.access & WRITE_ACCESS;
+        } else {
+            tracked.readStages = initial.stages;
+            tracked.readAccess = initial.access;
+        }
+        return tracked;
+    };
+    for (auto &image : _images) {
+        if (image.imported) {
+            image.tracked = importState(image.initial);
+        }
+    }
+    for (auto &buffer : _buffers) {
+        buffer.tracked = importState(buffer.initial);
+    }
+
+    for (uint32_t index : _order) {
+        Pass &pass = _passes[index];
+        std::vector<std::pair<bool, uint32_t>> resources;
+        for (const auto &access : pass.accesses) {
+            if (std::find(resources.begin(), resources.end(), std::make_pair(access.image, access.resource)) ==
+                resources.end()) {
+                resources.emplace_back(access.image, access.resource);
+            }
+        }
+        for (const auto &resource : resources) {
+            addBarrier(pass, resource.second, resource.first, passUsage(pass, resource.second, resource.first));
+        }
+    }
+
+    auto finalUsage = [](const GraphResourceState &final) {
+        Usage usage;
+        usage.stages = final.stages;
+        usage.access = final.access;
+        usage.layout = final.layout;
+        usage.used = true;
+        return usage;
+    };
+    for (uint32_t i = 0; i < _images.size(); ++i) {
+        if (_images[i].imported && _images[i].hasFinal) {
+            addBarrier(_final, i, true, finalUsage(_images[i].final));
+        }
+    }
+    for (uint32_t i = 0; i < _buffers.size(); ++i) {
+        if (_buffers[i].hasFinal) {
+            addBarrier(_final, i, false, finalUsage(_buffers[i].final));
+        }
+    }
+}
+
+void RenderGraph::addBarrier(Pass &pass, uint32_t resource, bool image, const Usage &usage) {
+    TrackedState &state = image ? _images[resource].tracked : _buffers[resource].tracked;
+    VkImageLayout oldLayout = state.layout;
+    bool transition = image && oldLayout != usage.layout;
+    VkPipelineStageFlags srcStages = 0;
+    VkAccessFlags srcAccess = 0;
+    bool needed = false;
+    if (transition || usage.write) {
+        // Writes before have to be available, and reads before done before anything overwrites what they read
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        needed = transition || srcStages != 0;
+        state.layout = usage.layout;
+        if (usage.write) {
+            state.writeStages = usage.stages;
+            state.writeAccess = usage.access & WRITE_ACCESS;
+            state.readStages = 0;
+            state.readAccess = 0;
+        } else {
+            // Only the layout transition wrote, and this barrier makes it visible to the pass already
+            state.writeStages = usage.stages;
+            state.writeAccess = 0;
+            state.readStages = usage.stages;
+            state.readAccess = usage.access;
+        }
+    } else {
+        // Reads after reads only need a barrier when the last write isn't visible to these stages yet
+        bool covered = (usage.stages & ~state.readStages) == 0 && (usage.access & ~state.readAccess) == 0;
+        if (state.writeStages != 0 && !covered) {
+            srcStages = state.writeStages;
+            srcAccess = state.writeAccess;
+            needed = true;
+        }
+        state.readStages |= usage.stages;
+        state.readAccess |= usage.access;
+    }
+    if (!needed) {
+        return;
+    }
+
+    pass.srcStages |= srcStages != 0 ? srcStages : VkPipelineStageFlags(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    pass.dstStages |= usage.stages;
+    if (image) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = usage.access;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = usage.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = {aspectMask(_images[resource].desc.format), 0, VK_REMAINING_MIP_LEVELS, 0,
+                                    VK_REMAINING_ARRAY_LAYERS};
+        pass.imageBarriers.push_back(barrier);
+        pass.barrierImages.push_back(resource);
+    } else {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = usage.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        pass.bufferBarriers.push_back(barrier);
+        pass.barrierBuffers.push_back(resource);
+    }
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, Pass &pass) {
+    if (pass.imageBarriers.empty() && pass.bufferBarriers.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < pass.imageBarriers.size(); ++i) {
+        pass.imageBarriers[i].image = _images[pass.barrierImages[i]].image;
+    }
+    for (size_t i = 0; i < pass.bufferBarriers.size(); ++i) {
+        pass.bufferBarriers[i].buffer = _buffers[pass.barrierBuffers[i]].buffer;
+    }
+    vkCmdPipelineBarrier(commandBuffer, pass.srcStages, pass.dstStages, 0, 0, nullptr,
+                         static_cast<uint32_t>(pass.bufferBarriers.size()), pass.bufferBarriers.data(),
+                         static_cast<uint32_t>(pass.imageBarriers.size()), pass.imageBarriers.data());
+}
+
+VkFramebuffer RenderGraph::framebuffer(Pass &pass) {
+    // Imported views may change every frame, so there is one framebuffer per combination seen
+    std::vector<VkImageView> views;
+    for (const auto &attachment : pass.colorAttachments) {
+        views.push_back(_images[attachment.image].view);
+    }
+    if (pass.depthAttachment.image != INVALID) {
+        views.push_back(_images[pass.depthAttachment.image].view);
+    }
+    auto found = pass.framebuffers.find(views);
+    if (found != pass.framebuffers.end()) {
+        return found->second.get();
+    }
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass.get();
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = pass.extent.width;
+    framebufferInfo.height = pass.extent.height;
+    framebufferInfo.layers = 1;
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(_app._device, &framebufferInfo, _app._allocationCallbacks, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create framebuffer for render graph pass " + pass.name);
+    }
+    pass.framebuffers.emplace(std::move(views),
+                              UniqueFramebuffer(_app._device, framebuffer, _app._allocationCallbacks));
+    return framebuffer;
+}
+
+void RenderGraph::PassBuilder::read(uint32_t image, GraphUsage usage) {
+    _pass.accesses.push_back({image, true, usage, false});
+}
+
+void RenderGraph::PassBuilder::write(uint32_t image, GraphUsage usage) {
+    _pass.accesses.push_back({image, true, usage, true});
+}
+
+void RenderGraph::PassBuilder::readBuffer(uint32_t buffer, GraphUsage usage) {
+    _pass.accesses.push_back({buffer, false, usage, false});
+}
+
+void RenderGraph::PassBuilder::writeBuffer(uint32_t buffer, GraphUsage usage) {
+    _pass.accesses.push_back({buffer, false, usage, true});
+}
+
+void RenderGraph::PassBuilder::colorAttachment(uint32_t image, AttachmentLoad load, VkClearColorValue clear) {
+    if (load == AttachmentLoad::Load) {
+        read(image, GraphUsage::ColorAttachment);
+    }
+    write(image, GraphUsage::ColorAttachment);
+    VkClearValue clearValue{};
+    clearValue.color = clear;
+    _pass.colorAttachments.push_back({image, load, clearValue});
+}
+
+void RenderGraph::PassBuilder::depthAttachment(uint32_t image, AttachmentLoad load, float clearDepth) {
+    if (load == AttachmentLoad::Load) {
+        read(image, GraphUsage::DepthAttachment);
+    }
+    write(image, GraphUsage::DepthAttachment);
+    VkClearValue clearValue{};
+    clearValue.depthStencil = {clearDepth, 0};
+    _pass.depthAttachment = {image, load, clearValue};
+}
+
+void RenderGraph::PassBuilder::sideEffect() {
+    _pass.sideEffect = true;
+}
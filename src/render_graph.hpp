@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+#include "vk_handle.hpp"
+
+class BaseApplication;
+
+// How a pass touches a resource. Each usage implies the pipeline stages, access mask and image layout.
+enum class GraphUsage {
+    ColorAttachment,
+    DepthAttachment,
+    SampledFragment,
+    SampledCompute,
+    StorageRead,                                              // Compute shader, images in the general layout
+    StorageWrite,
+    TransferSrc,
+    TransferDst,
+    IndirectRead,                                             // Buffers only
+    VertexRead,                                               // Vertex or index buffer, buffers only
+};
+
+enum class AttachmentLoad {
+    Clear,
+    Load,                                                     // Keeps what earlier passes wrote, counts as a read
+    DontCare,
+};
+
+// Where a resource stands outside the graph: how it is when the graph starts, or how it should be left at the end
+struct GraphResourceState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags access = 0;
+};
+
+struct GraphImageDesc {
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    VkExtent2D extent{};
+};
+
+// Passes declare what they read and write, the graph works out the rest when compiled: the order, which passes
+// nothing depends on (culled), one batched vkCmdPipelineBarrier in front of each pass with only the layout transitions
+// and memory dependencies it needs, and a render pass with framebuffer for passes with attachments.
+//
+// Transient images only live within one execution. They are created by the graph, which gives images whose first and
+// last use don't overlap the same memory. Imported images and buffers belong to the app, which says what state they
+// are in when the graph starts and, optionally, what state to leave them in. Passes writing imported resources, or
+// declared with sideEffect(), are what keeps the others alive.
+//
+// The structure is fixed once compiled and executed every frame. Rebuild it (reset, add, compile) when it changes,
+// e.g. on resize. Old resources go through the app's deletion queue.
+class RenderGraph {
+public:
+    static constexpr uint32_t INVALID = UINT32_MAX;
+
+    class PassBuilder;
+
+    using Setup = std::function<void(PassBuilder &)>;
+    using Execute = std::function<void(VkCommandBuffer)>;
+
+    BaseApplication &_app;
+
+    explicit RenderGraph(BaseApplication &app) : _app(app) {}
+
+    // Retires everything the last compile created and forgets all passes and resources
+    void reset();
+
+    void cleanup();
+
+    uint32_t createImage(const std::string &name, const GraphImageDesc &desc);
+
+    uint32_t importImage(const std::string &name, VkImage image, VkImageView view, const GraphImageDesc &desc,
+                         const GraphResourceState &initial, const GraphResourceState *final = nullptr);
+
+    uint32_t importBuffer(const std::string &name, VkBuffer buffer, const GraphResourceState &initial,
+                          const GraphResourceState *final = nullptr);
+
+    // For imported images that change every frame. The new image has to be in the same initial state.
+    void updateImport(uint32_t image, VkImage vkImage, VkImageView view);
+
+    // `setup` runs right away and declares the pass's resources. `execute` records it, inside the pass's render pass
+    // when it has attachments, viewport and scissor still to be set.
+    void addPass(const std::string &name, const Setup &setup, Execute execute);
+
+    // Orders and culls the passes, creates the transient images and render passes, plans the barriers
+    void compile();
+
+    // Records every live pass with its barriers
+    void execute(VkCommandBuffer commandBuffer);
+
+    [[nodiscard]] bool empty() const { return _order.empty(); }
+
+    // Valid between compile and the next reset, for recording secondary command buffers of a pass
+    [[nodiscard]] VkRenderPass renderPass(const std::string &pass) const;
+
+    [[nodiscard]] VkImageView imageView(uint32_t image) const { return _images[image].view; }
+
+    // Same as imageView(), for passes that copy or blit
+    [[nodiscard]] VkImage image(uint32_t image) const { return _images[image].image; }
+
+private:
+    struct Access {
+        uint32_t resource;
+        bool image;
+        GraphUsage usage;
+        bool write;
+    };
+
+    struct Attachment {
+        uint32_t image;
+        AttachmentLoad load;
+        VkClearValue clear;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Access> accesses;
+        std::vector<Attachment> colorAttachments;
+        Attachment depthAttachment{INVALID, AttachmentLoad::DontCare, {}};
+        bool sideEffect = false;
+        Execute execute;
+        bool alive = false;
+        // Filled by compile
+        std::vector<VkImageMemoryBarrier> imageBarriers;      // .image filled in at execution, imports may change
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<uint32_t> barrierImages;
+        std::vector<uint32_t> barrierBuffers;
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        UniqueRenderPass renderPass;
+        std::map<std::vector<VkImageView>, UniqueFramebuffer> framebuffers;
+        VkExtent2D extent{};
+    };
+
+    // Everything one pass does to one resource, merged over its accesses
+    struct Usage {
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool write = false;
+        bool used = false;
+    };
+
+    // What is known about a resource while the barriers are planned
+    struct TrackedState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;                  // Reads since the last write that are already synced
+        VkAccessFlags readAccess = 0;
+    };
+
+    struct Image {
+        std::string name;
+        GraphImageDesc desc;
+        bool imported = false;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        GraphResourceState initial;
+        bool hasFinal = false;
+        GraphResourceState final;
+        VkImageUsageFlags usage = 0;
+        uint32_t firstUse = INVALID;                          // Positions in _order
+        uint32_t lastUse = INVALID;
+        UniqueImageView ownedView;
+        UniqueImage ownedImage;
+        TrackedState tracked;
+    };
+
+    struct Buffer {
+        std::string name;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        GraphResourceState initial;
+        bool hasFinal = false;
+        GraphResourceState final;
+        TrackedState tracked;
+    };
+
+    // Transient images that share one allocation, no two of them alive at once
+    struct AliasGroup {
+        std::vector<uint32_t> images;                         // By first use
+        VkMemoryRequirements requirements{};
+        Allocation allocation;
+    };
+
+    void orderPasses();
+
+    void cullPasses();
+
+    void createTransientImages();
+
+    void createRenderPass(Pass &pass, uint32_t position);
+
+    void planBarriers();
+
+    [[nodiscard]] Usage passUsage(const Pass &pass, uint32_t resource, bool image) const;
+
+    void addBarrier(Pass &pass, uint32_t resource, bool image, const Usage &usage);
+
+    void recordBarriers(VkCommandBuffer commandBuffer, Pass &pass);
+
+    VkFramebuffer framebuffer(Pass &pass);
+
+    std::vector<Pass> _passes;
+    std::vector<uint32_t> _order;                             // Live passes in execution order
+    std::vector<Image> _images;
+    std::vector<Buffer> _buffers;
+    std::vector<AliasGroup> _aliasGroups;
+    Pass _final;                                              // Only its barriers, moving imports to their final state
+};
+
+class RenderGraph::PassBuilder {
+public:
+    void read(uint32_t image, GraphUsage usage);
+
+    void write(uint32_t image, GraphUsage usage);
+
+    void readBuffer(uint32_t buffer, GraphUsage usage);
+
+    void writeBuffer(uint32_t buffer, GraphUsage usage);
+
+    void colorAttachment(uint32_t image, AttachmentLoad load = AttachmentLoad::Clear, VkClearColorValue clear = {});
+
+    void depthAttachment(uint32_t image, AttachmentLoad load = AttachmentLoad::Clear, float clearDepth = 1.0f);
+
+    // Keeps the pass even when nothing in the graph reads what it writes
+    void sideEffect();
+
+private:
+    friend class RenderGraph;
+
+    explicit PassBuilder(Pass &pass) : _pass(pass) {}
+
+    Pass &_pass;
+};
@@ -0,0 +1,312 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "thread_pool.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_CULL_SSE 1
+#endif
+
+Frustum Frustum::fromViewProjection(const glm::mat4 &viewProjection) {
+    // Gribb/Hartmann: each plane is the last row of the matrix plus or minus another row. glm is column major, and
+    // Vulkan's near plane is z >= 0, so it's the third row on its own.
+    auto row = [&viewProjection](int i) {
+        return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    };
+    glm::vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+    glm::vec4 planes[6] = {w + x, w - x, w + y, w - y, z, w - z};
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i) {
+        float length = std::sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+        frustum.planes[i] = length > 0.0f ? planes[i] / length : planes[i];
+    }
+    return frustum;
+}
+
+void Scene::Vec3Array::resize(size_t count, float value) {
+    x.resize(count, value);
+    y.resize(count, value);
+    z.resize(count, value);
+}
+
+void Scene::QuatArray::resize(size_t count) {
+    x.resize(count, 0.0f);
+    y.resize(count, 0.0f);
+    z.resize(count, 0.0f);
+    w.resize(count, 1.0f);
+}
+
+void Scene::SphereArray::resize(size_t count, float value) {
+    x.resize(count, 0.0f);
+    y.resize(count, 0.0f);
+    z.resize(count, 0.0f);
+    radius.resize(count, value);
+}
+
+void Scene::reserve(size_t count) {
+    for (auto *array : {&_localPositions.x, &_localPositions.y, &_localPositions.z, &_localRotations.x,
+                        &_localRotations.y, &_localRotations.z, &_localRotations.w, &_localScales, &_localBounds.x,
+                        &_localBounds.y, &_localBounds.z, &_localBounds.radius, &_worldPositions.x,
+                        &_worldPositions.y, &_worldPositions.z, &_worldRotations.x, &_worldRotations.y,
+                        &_worldRotations.z, &_worldRotations.w, &_worldScales, &_worldBounds.x, &_worldBounds.y,
+                        &_worldBounds.z, &_worldBounds.radius}) {
+        array->reserve(count);
+    }
+    _parents.reserve(count);
+    _meshes.reserve(count);
+    _materials.reserve(count);
+    _dirty.reserve(count);
+}
+
+uint32_t Scene::create(uint32_t parent) {
+    auto object = static_cast<uint32_t>(size());
+    if (parent != NO_PARENT && parent >= object) {
+        throw std::runtime_error("Error: Scene object parent " + std::to_string(parent) + " doesn't exist");
+    }
+    size_t count = size_t(object) + 1;
+    _localPositions.resize(count, 0.0f);
+    _localRotations.resize(count);
+    _localScales.resize(count, 1.0f);
+    _localBounds.resize(count, -1.0f);
+    _worldPositions.resize(count, 0.0f);
+    _worldRotations.resize(count);
+    _worldScales.resize(count, 1.0f);
+    _worldBounds.resize(count, -std::numeric_limits<float>::infinity());
+    _parents.push_back(parent);
+    _meshes.push_back(0);
+    _materials.push_back(0);
+    _dirty.push_back(0);
+    markDirty(object);
+    return object;
+}
+
+void Scene::markDirty(uint32_t object) {
+    // Nothing dirty has _firstDirty at size(), which also counts the object just created
+    _dirty[object] = 1;
+    _firstDirty = std::min<size_t>(_firstDirty, object);
+}
+
+void Scene::setLocalTransform(uint32_t object, const glm::vec3 &position, const glm::quat &rotation, float scale) {
+    _localPositions.x[object] = position.x;
+    _localPositions.y[object] = position.y;
+    _localPositions.z[object] = position.z;
+    _localRotations.x[object] = rotation.x;
+    _localRotations.y[object] = rotation.y;
+    _localRotations.z[object] = rotation.z;
+    _localRotations.w[object] = rotation.w;
+    _localScales[object] = scale;
+    markDirty(object);
+}
+
+void Scene::setLocalPosition(uint32_t object, const glm::vec3 &position) {
+    _localPositions.x[object] = position.x;
+    _localPositions.y[object] = position.y;
+    _localPositions.z[object] = position.z;
+    markDirty(object);
+}
+
+void Scene::setBounds(uint32_t object, const glm::vec3 &center, float radius) {
+    _localBounds.x[object] = center.x;
+    _localBounds.y[object] = center.y;
+    _localBounds.z[object] = center.z;
+    _localBounds.radius[object] = radius;
+    markDirty(object);
+}
+
+void Scene::setMesh(uint32_t object, uint32_t mesh, uint32_t material) {
+    // Neither moves anything, so nothing gets dirty
+    _meshes[object] = mesh;
+    _materials[object] = material;
+}
+
+size_t Scene::updateTransforms() {
+    size_t count = size();
+    size_t updated = 0;
+    // Parents come first, so by the time an object is reached its parent's flag says whether the parent moved. An
+    // updated object sets its own flag for its children in turn, and the flags are cleared at the end.
+    for (size_t i = _firstDirty; i < count; ++i) {
+        uint32_t parent = _parents[i];
+        if (!_dirty[i] && (parent == NO_PARENT || !_dirty[parent])) {
+            continue;
+        }
+        _dirty[i] = 1;
+        ++updated;
+
+        float px = _localPositions.x[i], py = _localPositions.y[i], pz = _localPositions.z[i];
+        float qx = _localRotations.x[i], qy = _localRotations.y[i], qz = _localRotations.z[i];
+        float qw = _localRotations.w[i];
+        float scale = _localScales[i];
+        if (parent != NO_PARENT) {
+            // world = parent * local: the parent's scale and rotation apply to the local position first
+            float ps = _worldScales[parent];
+            float rx = _worldRotations.x[parent], ry = _worldRotations.y[parent], rz = _worldRotations.z[parent];
+            float rw = _worldRotations.w[parent];
+            float vx = px * ps, vy = py * ps, vz = pz * ps;
+            // v + 2w(r x v) + 2(r x (r x v))
+            float tx = 2.0f * (ry * vz - rz * vy), ty = 2.0f * (rz * vx - rx * vz), tz = 2.0f * (rx * vy - ry * vx);
+            px = _worldPositions.x[parent] + vx + rw * tx + (ry * tz - rz * ty);
+            py = _worldPositions.y[parent] + vy + rw * ty + (rz * tx - rx * tz);
+            pz = _worldPositions.z[parent] + vz + rw * tz + (rx * ty - ry * tx);
+            float wx = rw * qx + rx * qw + ry * qz - rz * qy;
+            float wy = rw * qy - rx * qz + ry * qw + rz * qx;
+            float wz = rw * qz + rx * qy - ry * qx + rz * qw;
+            float ww = rw * qw - rx * qx - ry * qy - rz * qz;
+            qx = wx, qy = wy, qz = wz, qw = ww;
+            scale *= ps;
+        }
+        _worldPositions.x[i] = px;
+        _worldPositions.y[i] = py;
+        _worldPositions.z[i] = pz;
+        _worldRotations.x[i] = qx;
+        _worldRotations.y[i] = qy;
+        _worldRotations.z[i] = qz;
+        _worldRotations.w[i] = qw;
+        _worldScales[i] = scale;
+
+        float radius = _localBounds.radius[i];
+        if (radius < 0.0f) {
+            _worldBounds.radius[i] = -std::numeric_limits<float>::infinity();
+            continue;
+        }
+        float vx = _localBounds.x[i] * scale, vy = _localBounds.y[i] * scale, vz = _localBounds.z[i] * scale;
+        float tx = 2.0f * (qy * vz - qz * vy), ty = 2.0f * (qz * vx - qx * vz), tz = 2.0f * (qx * vy - qy * vx);
+        _worldBounds.x[i] = px + vx + qw * tx + (qy * tz - qz * ty);
+        _worldBounds.y[i] = py + vy + qw * ty + (qz * tx - qx * tz);
+        _worldBounds.z[i] = pz + vz + qw * tz + (qx * ty - qy * tx);
+        _worldBounds.radius[i] = radius * std::abs(scale);
+    }
+    if (_firstDirty < count) {
+        std::memset(&_dirty[_firstDirty], 0, count - _firstDirty);
+    }
+    _firstDirty = count;
+    return updated;
+}
+
+size_t Scene::cullRange(const Frustum &frustum, size_t begin, size_t end, uint32_t *visible) const {
+    // Ids are written unconditionally and the count only moves for the ones inside, so there is no branch per
+    // object. `visible` has room for every object of the range.
+    size_t count = 0;
+    size_t i = begin;
+#ifdef SCENE_CULL_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&_worldBounds.x[i]);
+        __m128 y = _mm_loadu_ps(&_worldBounds.y[i]);
+        __m128 z = _mm_loadu_ps(&_worldBounds.z[i]);
+        __m128 radius = _mm_loadu_ps(&_worldBounds.radius[i]);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+                                         _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+        }
+        int mask = _mm_movemask_ps(inside);
+        auto id = static_cast<uint32_t>(i);
+        visible[count] = id;
+        count += mask & 1;
+        visible[count] = id + 1;
+        count += (mask >> 1) & 1;
+        visible[count] = id + 2;
+        count += (mask >> 2) & 1;
+        visible[count] = id + 3;
+        count += (mask >> 3) & 1;
+    }
+#endif
+    for (; i < end; ++i) {
+        float x = _worldBounds.x[i], y = _worldBounds.y[i], z = _worldBounds.z[i];
+        float radius = _worldBounds.radius[i];
+        bool inside = true;
+        for (const auto &plane : frustum.planes) {
+            inside &= plane.x * x + plane.y * y + plane.z * z + plane.w + radius >= 0.0f;
+        }
+        visible[count] = static_cast<uint32_t>(i);
+        count += inside ? 1 : 0;
+    }
+    return count;
+}
+
+void Scene::cull(const glm::mat4 &viewProjection, ThreadPool &threadPool, std::vector<uint32_t> &visible) {
+    Frustum frustum = Frustum::fromViewProjection(viewProjection);
+    size_t count = size();
+    size_t chunkCount = (count + CULL_CHUNK - 1) / CULL_CHUNK;
+    if (_chunkVisible.size() < chunkCount) {
+        _chunkVisible.resize(chunkCount);
+    }
+    _chunkCounts.assign(chunkCount, 0);
+    threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+        size_t begin = chunk * CULL_CHUNK;
+        size_t end = std::min(begin + CULL_CHUNK, count);
+        std::vector<uint32_t> &ids = _chunkVisible[chunk];
+        // One slot to spare for the last unconditional write
+        if (ids.size() < end - begin + 1) {
+            ids.resize(CULL_CHUNK + 1);
+        }
+        _chunkCounts[chunk] = cullRange(frustum, begin, end, ids.data());
+    });
+
+    // Chunks are appended in order, so the ids stay sorted
+    size_t offset = visible.size();
+    size_t total = offset;
+    for (size_t chunkVisible : _chunkCounts) {
+        total += chunkVisible;
+    }
+    visible.resize(total);
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        std::copy_n(_chunkVisible[chunk].data(), _chunkCounts[chunk], visible.data() + offset);
+        offset += _chunkCounts[chunk];
+    }
+}
+
+void Scene::clear() {
+    _localPositions = {};
+    _localRotations = {};
+    _localScales.clear();
+    _localBounds = {};
+    _worldPositions = {};
+    _worldRotations = {};
+    _worldScales.clear();
+    _worldBounds = {};
+    _parents.clear();
+    _meshes.clear();
+    _materials.clear();
+    _dirty.clear();
+    _firstDirty = 0;
+}
+
+glm::mat4 Scene::worldMatrix(uint32_t object) const {
+    float x = _worldRotations.x[object], y = _worldRotations.y[object], z = _worldRotations.z[object];
+    float w = _worldRotations.w[object];
+    float scale = _worldScales[object];
+    glm::mat4 matrix(1.0f);
+    matrix[0][0] = (1.0f - 2.0f * (y * y + z * z)) * scale;
+    matrix[0][1] = 2.0f * (x * y + w * z) * scale;
+    matrix[0][2] = 2.0f * (x * z - w * y) * scale;
+    matrix[1][0] = 2.0f * (x * y - w * z) * scale;
+    matrix[1][1] = (1.0f - 2.0f * (x * x + z * z)) * scale;
+    matrix[1][2] = 2.0f * (y * z + w * x) * scale;
+    matrix[2][0] = 2.0f * (x * z + w * y) * scale;
+    matrix[2][1] = 2.0f * (y * z - w * x) * scale;
+    matrix[2][2] = (1.0f - 2.0f * (x * x + y * y)) * scale;
+    matrix[3][0] = _worldPositions.x[object];
+    matrix[3][1] = _worldPositions.y[object];
+    matrix[3][2] = _worldPositions.z[object];
+    return matrix;
+}
+
+glm::vec4 Scene::worldBounds(uint32_t object) const {
+    return glm::vec4(_worldBounds.x[object], _worldBounds.y[object], _worldBounds.z[object],
+                     _worldBounds.radius[object]);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class ThreadPool;
+
+// Normalized planes of a view-projection matrix (Vulkan clip space, depth 0..1), pointing inwards: left, right,
+// bottom, top, near, far. A point p is inside a plane when x * p.x + y * p.y + z * p.z + w >= 0.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromViewProjection(const glm::mat4 &viewProjection);
+};
+
+// Scene objects as arrays of plain floats and ids rather than a graph of nodes: one array per component of the local
+// and world transforms, the bounding spheres, mesh and material ids and the dirty flags, all indexed by object id.
+// Updates and culling stream through the arrays they need and nothing else. glm only shows up in the arguments.
+//
+// A parent is always created before its children, so walking the ids in order visits every parent first and
+// transforms propagate in one pass without a stack. Objects live until clear(), ids are never reused.
+//
+// Transforms are translation, rotation and a uniform scale, which compose into the same again and keep bounding
+// spheres spheres.
+class Scene {
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+    static constexpr uint32_t CULL_CHUNK = 16384;             // Objects per thread pool task when culling
+
+    void reserve(size_t count);
+
+    // Identity transform, no bounds and mesh/material 0. The parent must exist already.
+    uint32_t create(uint32_t parent = NO_PARENT);
+
+    // Relative to the parent, `rotation` must be normalized
+    void setLocalTransform(uint32_t object, const glm::vec3 &position, const glm::quat &rotation, float scale);
+
+    void setLocalPosition(uint32_t object, const glm::vec3 &position);
+
+    // Sphere in the object's local space. Objects without bounds are only transform nodes and never visible.
+    void setBounds(uint32_t object, const glm::vec3 &center, float radius);
+
+    void setMesh(uint32_t object, uint32_t mesh, uint32_t material);
+
+    // Recomputes the world transform and bounds of every object that was changed and of everything below it, and
+    // returns how many that were. Only the dirty flags from the first changed id on are scanned.
+    size_t updateTransforms();
+
+    // Appends the ids of the objects whose world bounds touch the frustum to `visible`, in id order. Chunks of
+    // CULL_CHUNK objects go to the thread pool, 4 spheres at a time through SSE where the compiler targets it.
+    // Call updateTransforms() first, culling reads the world bounds as they are.
+    void cull(const glm::mat4 &viewProjection, ThreadPool &threadPool, std::vector<uint32_t> &visible);
+
+    void clear();
+
+    [[nodiscard]] size_t size() const { return _parents.size(); }
+
+    [[nodiscard]] uint32_t parent(uint32_t object) const { return _parents[object]; }
+
+    [[nodiscard]] uint32_t mesh(uint32_t object) const { return _meshes[object]; }
+
+    [[nodiscard]] uint32_t material(uint32_t object) const { return _materials[object]; }
+
+    // As of the last updateTransforms()
+    [[nodiscard]] glm::mat4 worldMatrix(uint32_t object) const;
+
+    // xyz center, w radius, as of the last updateTransforms()
+    [[nodiscard]] glm::vec4 worldBounds(uint32_t object) const;
+
+private:
+    struct Vec3Array {
+        std::vector<float> x, y, z;
+
+        void resize(size_t count, float value);
+    };
+
+    struct QuatArray {
+        std::vector<float> x, y, z, w;
+
+        void resize(size_t count);
+    };
+
+    struct SphereArray {
+        std::vector<float> x, y, z, radius;
+
+        void resize(size_t count, float value);
+    };
+
+    void markDirty(uint32_t object);
+
+    size_t cullRange(const Frustum &frustum, size_t begin, size_t end, uint32_t *visible) const;
+
+    Vec3Array _localPositions;
+    QuatArray _localRotations;
+    std::vector<float> _localScales;
+    SphereArray _localBounds;                                 // Negative radius: no bounds
+    Vec3Array _worldPositions;
+    QuatArray _worldRotations;
+    std::vector<float> _worldScales;
+    SphereArray _worldBounds;                                 // No bounds get a radius of -infinity, never visible
+    std::vector<uint32_t> _parents;
+    std::vector<uint32_t> _meshes;
+    std::vector<uint32_t> _materials;
+    std::vector<uint8_t> _dirty;                              // Local state changed since the last update
+    size_t _firstDirty = 0;                                   // size() when nothing is dirty
+    std::vector<std::vector<uint32_t>> _chunkVisible;         // Per cull chunk, kept so culling doesn't allocate
+    std::vector<size_t> _chunkCounts;
+};
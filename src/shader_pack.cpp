@@ -0,0 +1,77 @@
+#include "shader_pack.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include "hash.hpp"
+#include "log.hpp"
+
+bool ShaderPack::open(const std::string &path) {
+    close();
+    if (!_file.open(path)) {
+        return false;
+    }
+    const unsigned char *data = _file.data();
+    size_t size = _file.size();
+    // The mapping is page aligned, so the header and table can be read in place
+    auto header = reinterpret_cast<const ShaderPackHeader *>(data);
+    if (size < sizeof(ShaderPackHeader) || header->magic != MAGIC || header->version != VERSION ||
+        header->fileSize != size || header->tableSize == 0 || (header->tableSize & (header->tableSize - 1)) != 0 ||
+        header->tableOffset % alignof(ShaderPackEntry) != 0 ||
+        header->tableOffset + uint64_t(header->tableSize) * sizeof(ShaderPackEntry) > size) {
+        close();
+        throw std::runtime_error("Error: Shader pack " + path + " is corrupt or from another version");
+    }
+    auto table = reinterpret_cast<const ShaderPackEntry *>(data + header->tableOffset);
+    // Check every entry once here so lookups can trust the offsets
+    for (uint32_t i = 0; i < header->tableSize; ++i) {
+        const ShaderPackEntry &entry = table[i];
+        if (entry.nameHash == 0) {
+            continue;
+        }
+        if (uint64_t(entry.nameOffset) + entry.nameLength > size || entry.dataOffset + entry.dataSize > size ||
+            entry.dataOffset % sizeof(uint32_t) != 0 || entry.dataSize % sizeof(uint32_t) != 0) {
+            close();
+            throw std::runtime_error("Error: Shader pack " + path + " has an entry outside the file");
+        }
+    }
+    _header = header;
+    _table = table;
+    info("Success: Mapped shader pack {} with {} shaders ({} bytes)", path, header->entryCount, size);
+    return true;
+}
+
+void ShaderPack::close() {
+    _file.close();
+    _header = nullptr;
+    _table = nullptr;
+}
+
+bool ShaderPack::find(const std::string &name, ShaderBlob &blob) const {
+    if (!isOpen()) {
+        return false;
+    }
+    size_t separator = name.find_last_of("/\\");
+    const char *fileName = name.c_str() + (separator == std::string::npos ? 0 : separator + 1);
+    size_t fileNameLength = strlen(fileName);
+
+    uint64_t hash = hashName(fileName, fileNameLength);
+    uint32_t mask = _header->tableSize - 1;
+    for (uint32_t probe = 0, slot = hash & mask; probe < _header->tableSize; ++probe, slot = (slot + 1) & mask) {
+        const ShaderPackEntry &entry = _table[slot];
+        if (entry.nameHash == 0) {
+            return false;
+        }
+        if (entry.nameHash == hash && entry.nameLength == fileNameLength &&
+            memcmp(_file.data() + entry.nameOffset, fileName, fileNameLength) == 0) {
+            blob.code = reinterpret_cast<const uint32_t *>(_file.data() + entry.dataOffset);
+            blob.size = entry.dataSize;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t ShaderPack::hashName(const char *name, size_t length) {
+    uint64_t value = fnv1a(name, length);
+    return value ? value : 1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "mapped_file.hpp"
+
+// Layout written by shaders/compile_shaders.py:
+// header | hash table (tableSize entries) | names | spir-v blobs, each aligned to ALIGNMENT
+struct ShaderPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t tableSize;                                       // Power of two, open addressing with linear probing
+    uint64_t tableOffset;
+    uint64_t fileSize;
+};
+
+struct ShaderPackEntry {
+    uint64_t nameHash;                                        // FNV-1a 64 of the name, 0 marks an empty slot
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+struct ShaderBlob {
+    const uint32_t *code = nullptr;
+    size_t size = 0;                                          // In bytes, as vkCreateShaderModule wants it
+};
+
+// Every SPIR-V blob in one mmapped file. Lookups hash the name into the table and hand back a pointer straight into
+// the mapping, so creating a shader module needs no open, seek, read or copy.
+class ShaderPack {
+public:
+    static constexpr uint32_t MAGIC = 0x4b50534b;             // "KSPK"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t ALIGNMENT = 64;
+
+    // Returns false if the file is missing, throws if it exists but is malformed
+    bool open(const std::string &path);
+
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return _file.isOpen(); }
+
+    // Looks a shader up by file name, any leading directory is ignored
+    bool find(const std::string &name, ShaderBlob &blob) const;
+
+    static uint64_t hashName(const char *name, size_t length);
+
+private:
+    MappedFile _file;
+    const ShaderPackHeader *_header = nullptr;
+    const ShaderPackEntry *_table = nullptr;
+};
@@ -0,0 +1,565 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+namespace {
+    // Wherever bindless textures may be sampled
+    constexpr VkPipelineStageFlags SAMPLE_STAGES = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t baseMip, uint32_t levels, VkImageLayout oldLayout,
+                                      VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseMip, levels, 0, 1};
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        return barrier;
+    }
+
+    uint32_t mipSize(uint32_t size, uint32_t mip) {
+        return std::max(size >> mip, 1u);
+    }
+}
+
+void TextureStreamer::init() {
+    // Mips are made with linear blits, which not every format can do
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_app._physicalDevice, FORMAT, &formatProperties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                  VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((formatProperties.optimalTilingFeatures & needed) != needed) {
+        throw std::runtime_error("Error: Texture format can't be blitted and filtered on this device");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    VkSampler sampler;
+    if (vkCreateSampler(_app._device, &samplerInfo, _app._allocationCallbacks, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create texture sampler");
+    }
+    _sampler.reset(_app._device, sampler, _app._allocationCallbacks);
+
+    _textures = std::make_unique<Texture[]>(MAX_TEXTURES);
+    _staging.create(_app._allocator, STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _app._framesInFlight);
+    // Filled by the first record(), before anything can sample it
+    _placeholder = createImage(1, 1, 1, _placeholderAllocation);
+    _placeholderView = createView(_placeholder, 1);
+    _heapIndex = _app._allocator.memoryProperties().memoryTypes[_placeholderAllocation.memoryType].heapIndex;
+    _placeholderSlot = _app._bindless.addTexture(_placeholderView.get(), _sampler.get());
+    info("Success: Texture streamer ready with a {:.1f} MB budget on heap {} ({})", budget() / (1024.0 * 1024.0),
+         _heapIndex, _app._memoryBudgetSupported ? "VK_EXT_memory_budget" : "heap size");
+}
+
+void TextureStreamer::cleanup() {
+    info("Clean up: Texture streamer");
+    for (auto &decode : _decodes) {
+        decode.wait();
+    }
+    _decodes.clear();
+    _decoded.clear();
+    _uploads.clear();
+    _evictions.clear();
+    uint32_t count = _textureCount.load();
+    for (uint32_t i = 0; i < count; ++i) {
+        Texture &texture = _textures[i];
+        texture.view.reset();
+        if (texture.image != VK_NULL_HANDLE) {
+            _app._allocator.destroyImage(texture.image, texture.allocation);
+        }
+    }
+    _textures.reset();
+    _textureCount = 0;
+    _placeholderView.reset();
+    _app._allocator.destroyImage(_placeholder, _placeholderAllocation);
+    _placeholderSlot = INVALID;
+    _sampler.reset();
+    _staging.destroy();
+}
+
+uint32_t TextureStreamer::load(const std::string &path) {
+    std::lock_guard<std::mutex> lock(_loadMutex);
+    uint32_t texture = _textureCount.load(std::memory_order_relaxed);
+    if (texture >= MAX_TEXTURES) {
+        throw std::runtime_error("Error: Out of streamed texture ids");
+    }
+    _textures[texture].path = path;
+    // beginFrame picks it up and starts with the tail
+    _textureCount.store(texture + 1, std::memory_order_release);
+    return texture;
+}
+
+uint32_t TextureStreamer::request(uint32_t textureIndex, float pixels) {
+    if (textureIndex >= _textureCount.load(std::memory_order_acquire)) {
+        return _placeholderSlot;
+    }
+    Texture &texture = _textures[textureIndex];
+    // Positive floats order like their bit patterns, so the max can be kept in an integer
+    uint32_t bits;
+    std::memcpy(&bits, &pixels, sizeof(bits));
+    uint32_t current = texture.coverage.load(std::memory_order_relaxed);
+    while (pixels > 0.0f && bits > current &&
+           !texture.coverage.compare_exchange_weak(current, bits, std::memory_order_relaxed)) {
+    }
+    texture.lastUsed.store(_frameNumber.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint32_t slot = texture.slot.load(std::memory_order_acquire);
+    return slot == INVALID ? _placeholderSlot : slot;
+}
+
+void TextureStreamer::beginFrame(uint32_t frameSlot, uint64_t frameNumber) {
+    _frameSlot = frameSlot;
+    _frameNumber.store(frameNumber, std::memory_order_relaxed);
+    _staging.beginFrame(frameSlot);
+    _decodes.erase(std::remove_if(_decodes.begin(), _decodes.end(), [](const std::future<void> &decode) {
+        return decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), _decodes.end());
+
+    std::vector<Decoded> decoded;
+    {
+        std::lock_guard<std::mutex> lock(_decodedMutex);
+        decoded.swap(_decoded);
+    }
+    for (auto &result : decoded) {
+        Texture &texture = _textures[result.texture];
+        if (result.error.empty() && texture.mipCount != 0 &&
+            (result.width != texture.width || result.height != texture.height)) {
+            result.error = "the size changed on disk";
+        }
+        if (!result.error.empty()) {
+            warn("Could not stream texture {}: {}", texture.path, result.error);
+            if (result.mip != INVALID && texture.residentMip != INVALID) {
+                _pendingBytes -= chainBytes(texture.width, texture.height, result.mip) -
+                                 chainBytes(texture.width, texture.height, texture.residentMip);
+            }
+            texture.failed = true;
+            texture.busy = false;
+            continue;
+        }
+        if (texture.mipCount == 0) {
+            texture.width = result.width;
+            texture.height = result.height;
+            texture.mipCount = mipCount(result.width, result.height);
+        }
+        _uploads.push_back(std::move(result));
+    }
+
+    // Last frame's requests become the levels each texture wants, unused ones only want their tail
+    uint32_t count = _textureCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; ++i) {
+        Texture &texture = _textures[i];
+        uint32_t bits = texture.coverage.exchange(0, std::memory_order_relaxed);
+        if (texture.mipCount == 0) {
+            continue;
+        }
+        float pixels;
+        std::memcpy(&pixels, &bits, sizeof(pixels));
+        uint32_t wanted = tailMip(texture.width, texture.height);
+        if (pixels > 0.0f) {
+            float ratio = float(std::max(texture.width, texture.height)) / pixels;
+            auto mip = ratio <= 1.0f ? 0u : static_cast<uint32_t>(std::floor(std::log2(ratio)));
+            wanted = std::clamp(mip, finestMip(texture.width, texture.height), wanted);
+        }
+        texture.wantedMip = wanted;
+        // Done streaming up, the full size copy can go. It is decoded again if the texture is wanted sharper later.
+        if (!texture.busy && texture.residentMip != INVALID && wanted >= texture.residentMip) {
+            texture.source.reset();
+        }
+    }
+
+    VkDeviceSize limit = budget();
+    evict(limit);
+    stream(limit);
+}
+
+void TextureStreamer::record(VkCommandBuffer commandBuffer) {
+    if (!_placeholderUploaded) {
+        ImageData white{1, 1, {255, 255, 255, 255}};
+        RingAllocation staging;
+        if (_staging.allocate(white.byteSize(), 16, staging)) {
+            std::memcpy(staging.mapped, white.pixels.data(), white.byteSize());
+            recordUpload(commandBuffer, white, _placeholder, 1, staging);
+            _placeholderUploaded = true;
+        }
+    }
+
+    VkDeviceSize staged = 0;
+    size_t uploaded = 0;
+    for (; uploaded < _uploads.size(); ++uploaded) {
+        Decoded &upload = _uploads[uploaded];
+        const ImageData &level = *upload.level;
+        if (staged != 0 && staged + level.byteSize() > _uploadBytesPerFrame) {
+            break;
+        }
+        // Otherwise the ring is still full of uploads from frames in flight, those are done in a frame or two
+        RingAllocation staging;
+        if (!_staging.allocate(level.byteSize(), 16, staging)) {
+            break;
+        }
+        std::memcpy(staging.mapped, level.pixels.data(), level.byteSize());
+        staged += level.byteSize();
+
+        Texture &texture = _textures[upload.texture];
+        uint32_t levels = texture.mipCount - upload.mip;
+        Allocation allocation;
+        VkImage image = createImage(level.width, level.height, levels, allocation);
+        recordUpload(commandBuffer, level, image, levels, staging);
+        if (texture.residentMip != INVALID) {
+            _pendingBytes -= chainBytes(texture.width, texture.height, upload.mip) -
+                             chainBytes(texture.width, texture.height, texture.residentMip);
+        }
+        replaceImage(texture, image, allocation, upload.mip);
+        texture.busy = false;
+    }
+    _uploads.erase(_uploads.begin(), _uploads.begin() + static_cast<std::ptrdiff_t>(uploaded));
+    _uploadedBytes += staged;
+
+    for (const auto &eviction : _evictions) {
+        Texture &texture = _textures[eviction.texture];
+        uint32_t levels = texture.mipCount - eviction.mip;
+        uint32_t skipped = eviction.mip - texture.residentMip;
+        Allocation allocation;
+        VkImage image = createImage(mipSize(texture.width, eviction.mip), mipSize(texture.height, eviction.mip), levels,
+                                    allocation);
+        // Earlier frames may still be sampling the old image, the barrier waits for them on this queue
+        VkImageMemoryBarrier toTransfer[2] = {
+                imageBarrier(texture.image, 0, levels + skipped, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0, VK_ACCESS_TRANSFER_READ_BIT),
+                imageBarrier(image, 0, levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                             VK_ACCESS_TRANSFER_WRITE_BIT),
+        };
+        vkCmdPipelineBarrier(commandBuffer, SAMPLE_STAGES, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                             2, toTransfer);
+        std::vector<VkImageCopy> copies(levels);
+        for (uint32_t i = 0; i < levels; ++i) {
+            copies[i].srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, skipped + i, 0, 1};
+            copies[i].dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+            copies[i].extent = {mipSize(texture.width, eviction.mip + i), mipSize(texture.height, eviction.mip + i), 1};
+        }
+        vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, copies.data());
+        VkImageMemoryBarrier toShader = imageBarrier(image, 0, levels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                     VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, SAMPLE_STAGES, 0, 0, nullptr, 0, nullptr,
+                             1, &toShader);
+        replaceImage(texture, image, allocation, eviction.mip);
+        texture.busy = false;
+        ++_evictionCount;
+    }
+    _evictions.clear();
+    _staging.endFrame(_frameSlot);
+}
+
+VkDeviceSize TextureStreamer::budget() const {
+    VkDeviceSize heapBudget;
+    VkDeviceSize heapUsage;
+    if (_app._memoryBudgetSupported) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+        memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(_app._physicalDevice, &memoryProperties);
+        heapBudget = budgetProperties.heapBudget[_heapIndex];
+        heapUsage = budgetProperties.heapUsage[_heapIndex];
+    } else {
+        // All that is known then is the heap's size and what the textures take
+        heapBudget = _app._allocator.memoryProperties().memoryHeaps[_heapIndex].size;
+        heapUsage = _residentBytes;
+    }
+    // What the rest of the app and other processes use isn't ours to take
+    VkDeviceSize others = heapUsage > _residentBytes ? heapUsage - _residentBytes : 0;
+    VkDeviceSize available = heapBudget > others ? heapBudget - others : 0;
+    auto limit = static_cast<VkDeviceSize>(double(available) * _budgetFraction);
+    return _maxBytes != 0 ? std::min(limit, _maxBytes) : limit;
+}
+
+void TextureStreamer::report() const {
+    info("Texture streaming: {} textures | {:.1f} MB resident of a {:.1f} MB budget | {:.1f} MB uploaded | "
+         "{} evictions", _textureCount.load(), _residentBytes / (1024.0 * 1024.0), budget() / (1024.0 * 1024.0),
+         _uploadedBytes / (1024.0 * 1024.0), _evictionCount);
+}
+
+void TextureStreamer::decode(uint32_t textureIndex, uint32_t mip) {
+    Texture &texture = _textures[textureIndex];
+    Decoded result;
+    result.texture = textureIndex;
+    result.mip = mip;
+    if (!texture.source) {
+        auto source = std::make_shared<ImageData>();
+        if (!loadImageFile(texture.path, *source, result.error)) {
+            std::lock_guard<std::mutex> lock(_decodedMutex);
+            _decoded.push_back(std::move(result));
+            return;
+        }
+        texture.source = std::move(source);
+    }
+    result.width = texture.source->width;
+    result.height = texture.source->height;
+    if (mip == INVALID) {
+        result.mip = tailMip(result.width, result.height);
+    }
+    std::shared_ptr<const ImageData> level = texture.source;
+    for (uint32_t i = 0; i < result.mip; ++i) {
+        level = std::make_shared<const ImageData>(downsampleImage(*level));
+    }
+    result.level = std::move(level);
+    std::lock_guard<std::mutex> lock(_decodedMutex);
+    _decoded.push_back(std::move(result));
+}
+
+void TextureStreamer::scheduleDecode(uint32_t texture, uint32_t mip) {
+    _textures[texture].busy = true;
+    _decodes.push_back(_app._threadPool.submit([this, texture, mip] { decode(texture, mip); }));
+}
+
+void TextureStreamer::evict(VkDeviceSize limit) {
+    // Evictions queued but not recorded yet count as done
+    VkDeviceSize projected = _residentBytes;
+    for (const auto &eviction : _evictions) {
+        const Texture &texture = _textures[eviction.texture];
+        projected -= std::min(projected, chainBytes(texture.width, texture.height, texture.residentMip) -
+                                         chainBytes(texture.width, texture.height, eviction.mip));
+    }
+    if (projected <= limit) {
+        return;
+    }
+    uint32_t count = _textureCount.load(std::memory_order_acquire);
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Texture &texture = _textures[i];
+        if (!texture.busy && texture.residentMip != INVALID &&
+            texture.residentMip < tailMip(texture.width, texture.height)) {
+            candidates.push_back(i);
+        }
+    }
+    // Levels nobody asked for go first, then the ones unused the longest, then the biggest
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        const Texture &textureA = _textures[a];
+        const Texture &textureB = _textures[b];
+        bool unwantedA = textureA.wantedMip > textureA.residentMip;
+        bool unwantedB = textureB.wantedMip > textureB.residentMip;
+        if (unwantedA != unwantedB) {
+            return unwantedA;
+        }
+        uint64_t usedA = textureA.lastUsed.load(std::memory_order_relaxed);
+        uint64_t usedB = textureB.lastUsed.load(std::memory_order_relaxed);
+        if (usedA != usedB) {
+            return usedA < usedB;
+        }
+        return chainBytes(textureA.width, textureA.height, textureA.residentMip) >
+               chainBytes(textureB.width, textureB.height, textureB.residentMip);
+    });
+    // One level per texture and frame, the next frame goes on if it isn't enough
+    for (uint32_t candidate : candidates) {
+        if (projected <= limit) {
+            break;
+        }
+        Texture &texture = _textures[candidate];
+        uint32_t mip = texture.residentMip + 1;
+        projected -= std::min(projected, chainBytes(texture.width, texture.height, texture.residentMip) -
+                                         chainBytes(texture.width, texture.height, mip));
+        texture.busy = true;
+        _evictions.push_back({candidate, mip});
+    }
+}
+
+void TextureStreamer::stream(VkDeviceSize limit) {
+    uint32_t count = _textureCount.load(std::memory_order_acquire);
+    // Tails first, they are small and until then the texture is the placeholder
+    for (uint32_t i = 0; i < count && _decodes.size() < MAX_DECODES_IN_FLIGHT; ++i) {
+        const Texture &texture = _textures[i];
+        if (!texture.busy && !texture.failed && texture.residentMip == INVALID) {
+            scheduleDecode(i, INVALID);
+        }
+    }
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Texture &texture = _textures[i];
+        if (!texture.busy && !texture.failed && texture.residentMip != INVALID &&
+            texture.wantedMip < texture.residentMip) {
+            candidates.push_back(i);
+        }
+    }
+    // Textures used last frame first, then the ones furthest from what they want
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        const Texture &textureA = _textures[a];
+        const Texture &textureB = _textures[b];
+        uint64_t usedA = textureA.lastUsed.load(std::memory_order_relaxed);
+        uint64_t usedB = textureB.lastUsed.load(std::memory_order_relaxed);
+        if (usedA != usedB) {
+            return usedA > usedB;
+        }
+        return textureA.residentMip - textureA.wantedMip > textureB.residentMip - textureB.wantedMip;
+    });
+    // Growing stops short of the limit, so a texture evicted to get under it doesn't come straight back
+    VkDeviceSize growLimit = limit - limit / 10;
+    for (uint32_t candidate : candidates) {
+        if (_decodes.size() >= MAX_DECODES_IN_FLIGHT) {
+            break;
+        }
+        const Texture &texture = _textures[candidate];
+        uint32_t mip = texture.residentMip - 1;
+        VkDeviceSize growth = chainBytes(texture.width, texture.height, mip) -
+                              chainBytes(texture.width, texture.height, texture.residentMip);
+        if (_residentBytes + _pendingBytes + growth > growLimit) {
+            continue;
+        }
+        _pendingBytes += growth;
+        scheduleDecode(candidate, mip);
+    }
+}
+
+VkImage TextureStreamer::createImage(uint32_t width, uint32_t height, uint32_t levels, Allocation &allocation) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = FORMAT;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // Transfer source for the blits and for copying levels out when evicting
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return _app._allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocation);
+}
+
+UniqueImageView TextureStreamer::createView(VkImage image, uint32_t levels) {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = FORMAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    VkImageView view;
+    if (vkCreateImageView(_app._device, &viewInfo, _app._allocationCallbacks, &view) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create texture image view");
+    }
+    return UniqueImageView(_app._device, view, _app._allocationCallbacks);
+}
+
+void TextureStreamer::recordUpload(VkCommandBuffer commandBuffer, const ImageData &level, VkImage image,
+                                   uint32_t levels, const RingAllocation &staging) {
+    VkImageMemoryBarrier barrier = imageBarrier(image, 0, levels, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                                VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+    VkBufferImageCopy region{};
+    region.bufferOffset = staging.offset;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {level.width, level.height, 1};
+    vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // Each level is blitted from the one above it, which has to be finished and readable first
+    auto width = static_cast<int32_t>(level.width);
+    auto height = static_cast<int32_t>(level.height);
+    for (uint32_t i = 1; i < levels; ++i) {
+        barrier = imageBarrier(image, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                               VK_ACCESS_TRANSFER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &barrier);
+        int32_t nextWidth = std::max(width / 2, 1);
+        int32_t nextHeight = std::max(height / 2, 1);
+        VkImageBlit blit{};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+        blit.srcOffsets[1] = {width, height, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    // Every level but the last was a blit source
+    VkImageMemoryBarrier toShader[2];
+    uint32_t barrierCount = 0;
+    if (levels > 1) {
+        toShader[barrierCount++] = imageBarrier(image, 0, levels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0,
+                                                VK_ACCESS_SHADER_READ_BIT);
+    }
+    toShader[barrierCount++] = imageBarrier(image, levels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                            VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, SAMPLE_STAGES, 0, 0, nullptr, 0, nullptr,
+                         barrierCount, toShader);
+}
+
+void TextureStreamer::replaceImage(Texture &texture, VkImage image, const Allocation &allocation, uint32_t mip) {
+    UniqueImageView view = createView(image, texture.mipCount - mip);
+    // Frames in flight keep reading the old slot, so the new image can't go into it
+    uint32_t slot = _app._bindless.addTexture(view.get(), _sampler.get());
+    uint32_t oldSlot = texture.slot.exchange(slot, std::memory_order_acq_rel);
+    if (oldSlot != INVALID) {
+        _app._bindless.releaseTexture(oldSlot);
+    }
+    _app._deletionQueue.retire(std::move(texture.view));
+    if (texture.image != VK_NULL_HANDLE) {
+        _residentBytes -= texture.allocation.size;
+        _app._deletionQueue.retireImage(texture.image, texture.allocation);
+    }
+    texture.image = image;
+    texture.allocation = allocation;
+    texture.view = std::move(view);
+    texture.residentMip = mip;
+    _residentBytes += allocation.size;
+}
+
+uint32_t TextureStreamer::mipCount(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+        ++count;
+    }
+    return count;
+}
+
+uint32_t TextureStreamer::tailMip(uint32_t width, uint32_t height) {
+    uint32_t mip = 0;
+    for (uint32_t size = std::max(width, height); size > TAIL_SIZE; size /= 2) {
+        ++mip;
+    }
+    return mip;
+}
+
+uint32_t TextureStreamer::finestMip(uint32_t width, uint32_t height) {
+    uint32_t mip = 0;
+    uint32_t tail = tailMip(width, height);
+    while (mip < tail && VkDeviceSize(mipSize(width, mip)) * mipSize(height, mip) * 4 > STAGING_SIZE / 2) {
+        ++mip;
+    }
+    return mip;
+}
+
+VkDeviceSize TextureStreamer::chainBytes(uint32_t width, uint32_t height, uint32_t mip) {
+    VkDeviceSize bytes = 0;
+    for (uint32_t level = mip; level < mipCount(width, height); ++level) {
+        bytes += VkDeviceSize(mipSize(width, level)) * mipSize(height, level) * 4;
+    }
+    return bytes;
+}
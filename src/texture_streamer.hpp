@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+#include "image_file.hpp"
+#include "vk_handle.hpp"
+
+class BaseApplication;
+
+// Streams textures from image files into the bindless table without the render thread ever waiting on a file.
+// Files are decoded on the thread pool. The render thread copies each decoded level into a staging ring, and the
+// frame's command buffer uploads it and blits the coarser levels from it.
+//
+// A texture first gets its mip tail (TAIL_SIZE and smaller), then one finer level at a time while the app keeps
+// requesting it at a size that needs it, so it sharpens from the lowest resolution up. Each step is a new image with
+// one more level, swapped in under a new bindless slot. The old image and slot are released once frames in flight
+// are done with them. When resident textures go over the budget, levels are evicted from the ones that need them
+// least the same way, copying the remaining levels on the GPU.
+//
+// The budget is a share of what VK_EXT_memory_budget says the heap has left for us, or of the heap size without it.
+class TextureStreamer {
+public:
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    static constexpr uint32_t INVALID = UINT32_MAX;
+    static constexpr uint32_t TAIL_SIZE = 64;                 // Levels this size and below: loaded first, kept
+    static constexpr VkDeviceSize STAGING_SIZE = 64ull * 1024 * 1024;
+    static constexpr uint32_t MAX_DECODES_IN_FLIGHT = 8;
+    static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+    BaseApplication &_app;
+    VkDeviceSize _uploadBytesPerFrame = 16ull * 1024 * 1024;  // Staged per frame at most, the first upload may go over
+    VkDeviceSize _maxBytes = 0;                               // Cap on resident bytes on top of the budget, 0 for none
+    float _budgetFraction = 0.8f;                             // Of the heap budget left after everything else
+
+    explicit TextureStreamer(BaseApplication &app) : _app(app) {}
+
+    // Needs the bindless table and _framesInFlight
+    void init();
+
+    // Waits for the decodes still running, only once the device is idle
+    void cleanup();
+
+    [[nodiscard]] bool isReady() const { return _placeholderSlot != INVALID; }
+
+    // Starts streaming the file in and returns the texture's id right away. Safe from any thread.
+    uint32_t load(const std::string &path);
+
+    // Usage feedback: this frame draws `texture` about `pixels` screen pixels across its longer side. Returns the
+    // bindless slot to sample this frame, a 1x1 placeholder until the tail is in. Safe from any thread, also while
+    // command buffers are recorded.
+    uint32_t request(uint32_t texture, float pixels);
+
+    // After the frame slot's fence wait: takes what the workers decoded, turns last frame's requests into wanted
+    // levels, evicts when over the budget and starts decodes for the levels that fit
+    void beginFrame(uint32_t frameSlot, uint64_t frameNumber);
+
+    // Records this frame's uploads, mip blits and evictions, before anything samples the textures
+    void record(VkCommandBuffer commandBuffer);
+
+    // Bytes the resident textures may take right now
+    [[nodiscard]] VkDeviceSize budget() const;
+
+    [[nodiscard]] VkDeviceSize residentBytes() const { return _residentBytes; }
+
+    void report() const;
+
+private:
+    struct Texture {
+        std::string path;
+        std::atomic<uint32_t> slot{INVALID};
+        std::atomic<uint32_t> coverage{0};                    // Bits of the largest float requested this frame
+        std::atomic<uint64_t> lastUsed{0};
+        std::shared_ptr<const ImageData> source;              // Full size, kept while it streams up. Workers only
+                                                              // touch it while `busy`, the render thread otherwise.
+        // Render thread only
+        bool busy = false;                                    // A decode, upload or eviction is under way
+        bool failed = false;
+        uint32_t width = 0;                                   // Known once the tail is decoded
+        uint32_t height = 0;
+        uint32_t mipCount = 0;
+        uint32_t residentMip = INVALID;                       // Finest level resident, INVALID before the tail
+        uint32_t wantedMip = INVALID;
+        VkImage image = VK_NULL_HANDLE;                       // Holds levels residentMip and coarser
+        Allocation allocation;
+        UniqueImageView view;
+    };
+
+    // One level decoded on a worker, with the texture's full size
+    struct Decoded {
+        uint32_t texture = 0;
+        uint32_t mip = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::shared_ptr<const ImageData> level;
+        std::string error;                                    // Set when the file couldn't be decoded
+    };
+
+    struct Eviction {
+        uint32_t texture;
+        uint32_t mip;                                         // The new finest level
+    };
+
+    // Runs on a worker. INVALID for `mip` decodes the tail.
+    void decode(uint32_t texture, uint32_t mip);
+
+    void scheduleDecode(uint32_t texture, uint32_t mip);
+
+    void evict(VkDeviceSize limit);
+
+    void stream(VkDeviceSize limit);
+
+    VkImage createImage(uint32_t width, uint32_t height, uint32_t levels, Allocation &allocation);
+
+    UniqueImageView createView(VkImage image, uint32_t levels);
+
+    // Records the upload of `level` into level 0 of `image` and blits the rest of its `levels` from it
+    void recordUpload(VkCommandBuffer commandBuffer, const ImageData &level, VkImage image, uint32_t levels,
+                      const RingAllocation &staging);
+
+    // Swaps the texture over to `image`, which holds levels `mip` and coarser
+    void replaceImage(Texture &texture, VkImage image, const Allocation &allocation, uint32_t mip);
+
+    static uint32_t mipCount(uint32_t width, uint32_t height);
+
+    static uint32_t tailMip(uint32_t width, uint32_t height);
+
+    // Finest level whose upload fits half the staging ring
+    static uint32_t finestMip(uint32_t width, uint32_t height);
+
+    // Every level from `mip` down, as resident
+    static VkDeviceSize chainBytes(uint32_t width, uint32_t height, uint32_t mip);
+
+    std::unique_ptr<Texture[]> _textures;
+    std::atomic<uint32_t> _textureCount{0};
+    std::mutex _loadMutex;
+    std::vector<Decoded> _decoded;                            // From the workers, taken by beginFrame
+    std::mutex _decodedMutex;
+    std::vector<std::future<void>> _decodes;
+    std::vector<Decoded> _uploads;                            // Waiting for record(), in order
+    std::vector<Eviction> _evictions;
+    RingBuffer _staging;
+    UniqueSampler _sampler;
+    VkImage _placeholder = VK_NULL_HANDLE;
+    Allocation _placeholderAllocation;
+    UniqueImageView _placeholderView;
+    uint32_t _placeholderSlot = INVALID;
+    bool _placeholderUploaded = false;
+    uint32_t _heapIndex = 0;                                  // Where the texture memory comes from
+    uint32_t _frameSlot = 0;
+    std::atomic<uint64_t> _frameNumber{0};                    // Read by request() on any thread
+    VkDeviceSize _residentBytes = 0;
+    VkDeviceSize _pendingBytes = 0;                           // Growth of the decodes and uploads under way
+    VkDeviceSize _uploadedBytes = 0;
+    uint64_t _evictionCount = 0;
+};
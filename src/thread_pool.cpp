@@ -0,0 +1,93 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    threadCount = std::max<size_t>(threadCount, 1);
+    _workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        _workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    if (count == 0) {
+        return;
+    }
+    // Every participant pulls the next index until they run out, so uneven items still balance out.
+    // We wait for the items rather than the helpers, so this also works from inside a worker: helpers that only
+    // get scheduled after everything is done find nothing left and return without touching fn.
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t count = 0;
+        const std::function<void(size_t)> *fn = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr firstError;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->fn = &fn;
+    auto drain = [state]() {
+        for (size_t i = state->next++; i < state->count; i = state->next++) {
+            try {
+                (*state->fn)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->firstError) {
+                    state->firstError = std::current_exception();
+                }
+            }
+            if (++state->done == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    size_t helperCount = std::min(_workers.size(), count - 1);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < helperCount; ++i) {
+            _tasks.emplace_back(drain);
+        }
+    }
+    _condition.notify_all();
+    drain();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]() { return state->done == state->count; });
+    if (state->firstError) {
+        std::rethrow_exception(state->firstError);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+            if (_stopping && _tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
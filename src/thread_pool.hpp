@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads pulling from one queue. Vulkan object creation is free-threaded, so startup work
+// like shader module and pipeline creation can be spread across every core.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    template<typename F>
+    auto submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packagedTask->get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.emplace_back([packagedTask]() { (*packagedTask)(); });
+        }
+        _condition.notify_one();
+        return future;
+    }
+
+    // Runs fn(i) for every i in [0, count) on the workers and the calling thread, returns once all are done.
+    // The first exception thrown by fn is rethrown here.
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+    [[nodiscard]] size_t size() const { return _workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    bool _stopping = false;
+};
@@ -0,0 +1,201 @@
+#include "upload_queue.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "base.hpp"
+#include "log.hpp"
+
+void UploadQueue::init() {
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    if (vkCreateSemaphore(_app._device, &semaphoreInfo, _app._allocationCallbacks, &_timeline) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Could not create upload timeline semaphore");
+    }
+
+    _batches.resize(BATCH_COUNT);
+    for (auto &batch : _batches) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = _app._indices.transferFamily.value();
+        if (vkCreateCommandPool(_app._device, &poolInfo, _app._allocationCallbacks, &batch.commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not create upload command pool");
+        }
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = batch.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(_app._device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Error: Could not allocate upload command buffer");
+        }
+    }
+
+    // Host coherent, so writing through the mapping is all it takes before the copy is submitted
+    _staging.create(_app._allocator, STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, BATCH_COUNT);
+    info("Success: Upload queue ready with a {} MiB staging ring on queue family {}{}", STAGING_SIZE / (1024 * 1024),
+         _app._indices.transferFamily.value(), dedicated() ? " (dedicated transfer)" : "");
+}
+
+void UploadQueue::cleanup() {
+    info("Clean up: Upload queue");
+    for (auto &batch : _batches) {
+        vkDestroyCommandPool(_app._device, batch.commandPool, _app._allocationCallbacks);
+    }
+    _batches.clear();
+    _staging.destroy();
+    vkDestroySemaphore(_app._device, _timeline, _app._allocationCallbacks);
+}
+
+void UploadQueue::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+                               VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    VkDeviceSize maxChunk = _staging.capacity() / 2;
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, maxChunk);
+        beginBatch();
+        RingAllocation staging;
+        if (!_staging.allocate(chunk, 16, staging)) {
+            // Hand the ring over to the next batch, which waits for its previous copies and frees their space.
+            // After at most BATCH_COUNT rounds the ring is empty and the chunk fits.
+            submitBatch();
+            continue;
+        }
+        memcpy(staging.mapped, bytes, chunk);
+
+        Batch &batch = _batches[_current];
+        VkBufferCopy region{};
+        region.srcOffset = staging.offset;
+        region.dstOffset = offset;
+        region.size = chunk;
+        vkCmdCopyBuffer(batch.commandBuffer, staging.buffer, buffer, 1, &region);
+
+        if (dedicated()) {
+            // Exclusive buffers have to be handed over to the graphics family. The previous contents don't matter
+            // for the copied range, so nothing needs acquiring on the transfer side first.
+            OwnershipTransfer transfer;
+            transfer.srcFamily = _app._indices.transferFamily.value();
+            transfer.dstFamily = _app._indices.graphicsFamily.value();
+            transfer.srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            transfer.srcAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+            transfer.dstStage = dstStage;
+            transfer.dstAccess = dstAccess;
+            transfer.buffer = buffer;
+            transfer.offset = offset;
+            transfer.size = chunk;
+            _recordedTransfers.push_back(transfer);
+        }
+        _recordedStages |= dstStage;
+
+        bytes += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+uint64_t UploadQueue::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return submitBatch();
+}
+
+void UploadQueue::recordAcquireBarriers(VkCommandBuffer commandBuffer) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_flushedValue == 0) {
+        return;
+    }
+    // The timeline wait makes the copies visible, the barriers only move ownership
+    recordAcquire(commandBuffer, _flushedTransfers);
+    _flushedTransfers.clear();
+    _acquiredValue = _flushedValue;
+    _acquiredStages |= _flushedStages;
+    _flushedValue = 0;
+    _flushedStages = 0;
+}
+
+uint64_t UploadQueue::takeGraphicsWait(VkPipelineStageFlags &waitStages) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t value = _acquiredValue;
+    waitStages = _acquiredStages != 0 ? _acquiredStages
+                                      : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    _acquiredValue = 0;
+    _acquiredStages = 0;
+    return value;
+}
+
+void UploadQueue::wait(uint64_t value) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &_timeline;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(_app._device, &waitInfo, UINT64_MAX);
+}
+
+bool UploadQueue::dedicated() const {
+    return _app._indices.transferFamily.value() != _app._indices.graphicsFamily.value();
+}
+
+void UploadQueue::beginBatch() {
+    Batch &batch = _batches[_current];
+    if (batch.recording) {
+        return;
+    }
+    // The batch's previous copies have to be done before its command buffer and staging space are reused
+    if (batch.value != 0) {
+        wait(batch.value);
+    }
+    _staging.beginFrame(_current);
+    vkResetCommandPool(_app._device, batch.commandPool, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to begin upload command buffer");
+    }
+    batch.recording = true;
+}
+
+uint64_t UploadQueue::submitBatch() {
+    Batch &batch = _batches[_current];
+    if (!batch.recording) {
+        return 0;
+    }
+    recordRelease(batch.commandBuffer, _recordedTransfers);
+    if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to record upload command buffer");
+    }
+
+    batch.value = _nextValue++;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &batch.value;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_timeline;
+    if (vkQueueSubmit(_app._transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Error: Failed to submit upload command buffer");
+    }
+    batch.recording = false;
+    _staging.endFrame(_current);
+    _current = (_current + 1) % BATCH_COUNT;
+
+    _flushedTransfers.insert(_flushedTransfers.end(), _recordedTransfers.begin(), _recordedTransfers.end());
+    _recordedTransfers.clear();
+    _flushedValue = batch.value;
+    _flushedStages |= _recordedStages;
+    _recordedStages = 0;
+    return batch.value;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "device_allocator.hpp"
+#include "ownership_transfer.hpp"
+
+class BaseApplication;
+
+// Copies data into device-local buffers through a persistently mapped staging ring. The copies run on the transfer
+// queue, which is its own family when the device has one, so uploads overlap with rendering. Completion is tracked
+// with a timeline semaphore: the graphics submit waits on it only when it has new uploads to consume.
+class UploadQueue {
+public:
+    static constexpr VkDeviceSize STAGING_SIZE = 32ull * 1024 * 1024;
+    static constexpr uint32_t BATCH_COUNT = 3;                // Batches the staging ring is shared between
+
+    BaseApplication &_app;
+    VkSemaphore _timeline{};
+
+    explicit UploadQueue(BaseApplication &app) : _app(app) {}
+
+    // Needs the allocator and the transfer queue
+    void init();
+
+    void cleanup();
+
+    // Stages `data` and records a copy of it into `buffer`. Uploads bigger than half the staging ring are split, and
+    // the call only blocks when the ring is full of copies the GPU hasn't done yet. `dstStage`/`dstAccess` describe
+    // how the graphics queue reads the buffer afterwards.
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+                      VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    // Submits everything recorded so far and returns the timeline value signalled once it's copied, 0 if there was
+    // nothing to submit. When the transfer queue is the graphics queue this has to be called from the render thread.
+    uint64_t flush();
+
+    // Records the queue family acquire barriers for every flushed upload the graphics queue hasn't consumed yet
+    void recordAcquireBarriers(VkCommandBuffer commandBuffer);
+
+    // Timeline value (0 for none) and stages the next graphics submit has to wait on for the acquired uploads
+    uint64_t takeGraphicsWait(VkPipelineStageFlags &waitStages);
+
+    // Blocks until the timeline reaches `value`
+    void wait(uint64_t value);
+
+    // Whether copies run on a different queue family than graphics, which needs ownership transfers
+    [[nodiscard]] bool dedicated() const;
+
+private:
+    struct Batch {
+        VkCommandPool commandPool{};
+        VkCommandBuffer commandBuffer{};
+        uint64_t value = 0;                                   // Signalled when the batch's copies are done
+        bool recording = false;
+    };
+
+    void beginBatch();
+
+    uint64_t submitBatch();
+
+    RingBuffer _staging;
+    std::vector<Batch> _batches;
+    uint32_t _current = 0;
+    uint64_t _nextValue = 1;
+    uint64_t _flushedValue = 0;                               // Last submitted, not yet handed to the graphics queue
+    VkPipelineStageFlags _flushedStages = 0;
+    uint64_t _acquiredValue = 0;                              // Recorded in a graphics command buffer, to be waited on
+    VkPipelineStageFlags _acquiredStages = 0;
+    VkPipelineStageFlags _recordedStages = 0;                 // Consumer stages of the batch being recorded
+    std::vector<OwnershipTransfer> _recordedTransfers;
+    std::vector<OwnershipTransfer> _flushedTransfers;
+    std::mutex _mutex;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <utility>
+#include <vulkan/vulkan.h>
+
+// Owns one object created from a VkDevice and destroys it with `Destroy`, and the allocation callbacks it was created
+// with, when it goes out of scope. Move-only like MappedFile, so a handle can't end up destroyed twice by copies.
+// Hand it to DeletionQueue::retire instead of letting it go out of scope while frames in flight may still use it.
+template<typename Handle, void (VKAPI_PTR *Destroy)(VkDevice, Handle, const VkAllocationCallbacks *)>
+class DeviceHandle {
+public:
+    DeviceHandle() = default;
+
+    DeviceHandle(VkDevice device, Handle handle, const VkAllocationCallbacks *allocator)
+            : _device(device), _handle(handle), _allocator(allocator) {}
+
+    ~DeviceHandle() { reset(); }
+
+    DeviceHandle(DeviceHandle &&other) noexcept
+            : _device(other._device), _handle(std::exchange(other._handle, VK_NULL_HANDLE)),
+              _allocator(other._allocator) {}
+
+    DeviceHandle &operator=(DeviceHandle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            _device = other._device;
+            _handle = std::exchange(other._handle, VK_NULL_HANDLE);
+            _allocator = other._allocator;
+        }
+        return *this;
+    }
+
+    DeviceHandle(const DeviceHandle &) = delete;
+
+    DeviceHandle &operator=(const DeviceHandle &) = delete;
+
+    [[nodiscard]] Handle get() const { return _handle; }
+
+    [[nodiscard]] VkDevice device() const { return _device; }
+
+    [[nodiscard]] const VkAllocationCallbacks *allocator() const { return _allocator; }
+
+    [[nodiscard]] explicit operator bool() const { return _handle != VK_NULL_HANDLE; }
+
+    // Destroys the current object, if any, and takes ownership of `handle`
+    void reset(VkDevice device = VK_NULL_HANDLE, Handle handle = VK_NULL_HANDLE,
+               const VkAllocationCallbacks *allocator = nullptr) {
+        if (_handle != VK_NULL_HANDLE) {
+            Destroy(_device, _handle, _allocator);
+        }
+        _device = device;
+        _handle = handle;
+        _allocator = allocator;
+    }
+
+    // Gives up ownership without destroying anything
+    [[nodiscard]] Handle release() { return std::exchange(_handle, VK_NULL_HANDLE); }
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    Handle _handle = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *_allocator = nullptr;
+};
+
+using UniqueShaderModule = DeviceHandle<VkShaderModule, vkDestroyShaderModule>;
+using UniquePipeline = DeviceHandle<VkPipeline, vkDestroyPipeline>;
+using UniquePipelineLayout = DeviceHandle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using UniqueRenderPass = DeviceHandle<VkRenderPass, vkDestroyRenderPass>;
+using UniqueFramebuffer = DeviceHandle<VkFramebuffer, vkDestroyFramebuffer>;
+using UniqueImage = DeviceHandle<VkImage, vkDestroyImage>;
+using UniqueImageView = DeviceHandle<VkImageView, vkDestroyImageView>;
+using UniqueSampler = DeviceHandle<VkSampler, vkDestroySampler>;
+using UniqueSemaphore = DeviceHandle<VkSemaphore, vkDestroySemaphore>;
+using UniqueFence = DeviceHandle<VkFence, vkDestroyFence>;
+using UniqueCommandPool = DeviceHandle<VkCommandPool, vkDestroyCommandPool>;
+using UniqueDescriptorPool = DeviceHandle<VkDescriptorPool, vkDestroyDescriptorPool>;
+using UniqueDescriptorSetLayout = DeviceHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
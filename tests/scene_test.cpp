@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "scene.hpp"
+#include "thread_pool.hpp"
+
+// Scene transforms and culling against straightforward versions of the same math: hand-worked hierarchies, a full
+// update of a fresh scene for the incremental one, and every sphere against every plane for the SIMD cull.
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+void check(bool condition, const char *expression, int line) {
+    if (!condition) {
+        fprintf(stderr, "scene_test.cpp:%d: failed: %s\n", line, expression);
+        ++failures;
+    }
+}
+
+// Equal first, so the -infinity radius of objects without bounds matches
+bool near(float a, float b, float tolerance = 1e-4f) {
+    return a == b || std::fabs(a - b) <= tolerance * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+}
+
+bool near(const glm::vec4 &a, const glm::vec4 &b) {
+    return near(a.x, b.x) && near(a.y, b.y) && near(a.z, b.z) && near(a.w, b.w);
+}
+
+void testHierarchy() {
+    Scene scene;
+    // 90 degrees about z and twice the size: x turns into 2y
+    uint32_t root = scene.create();
+    float half = std::sqrt(0.5f);
+    scene.setLocalTransform(root, glm::vec3(1.0f, 0.0f, 0.0f), glm::quat(half, 0.0f, 0.0f, half), 2.0f);
+    uint32_t child = scene.create(root);
+    scene.setLocalPosition(child, glm::vec3(1.0f, 0.0f, 0.0f));
+    scene.setBounds(child, glm::vec3(0.0f, 1.0f, 0.0f), 0.5f);
+    uint32_t grandchild = scene.create(child);
+    scene.setLocalPosition(grandchild, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    CHECK(scene.updateTransforms() == 3);
+    glm::mat4 childMatrix = scene.worldMatrix(child);
+    CHECK(near(childMatrix[3], glm::vec4(1.0f, 2.0f, 0.0f, 1.0f)));
+    CHECK(near(childMatrix[0], glm::vec4(0.0f, 2.0f, 0.0f, 0.0f)));
+    CHECK(near(scene.worldBounds(child), glm::vec4(-1.0f, 2.0f, 0.0f, 1.0f)));
+    CHECK(near(scene.worldMatrix(grandchild)[3], glm::vec4(-1.0f, 2.0f, 0.0f, 1.0f)));
+    // Without bounds it only carries a transform
+    CHECK(scene.worldBounds(grandchild).w < 0.0f);
+
+    CHECK(scene.updateTransforms() == 0);
+    scene.setLocalPosition(child, glm::vec3(1.0f, 0.0f, 0.0f));
+    CHECK(scene.updateTransforms() == 2);
+    scene.setLocalPosition(grandchild, glm::vec3(0.0f, 2.0f, 0.0f));
+    CHECK(scene.updateTransforms() == 1);
+    CHECK(near(scene.worldMatrix(grandchild)[3], glm::vec4(-3.0f, 2.0f, 0.0f, 1.0f)));
+}
+
+// Groups with random rotations and scales, their children spread around them with bounds. More objects than one
+// cull chunk, so several chunks go through the thread pool.
+void buildScene(Scene &scene, std::vector<uint32_t> &groups) {
+    const uint32_t groupCount = 64;
+    const uint32_t childCount = 1023;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> spread(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+    scene.reserve(size_t(groupCount) * (childCount + 1));
+    for (uint32_t i = 0; i < groupCount; ++i) {
+        uint32_t group = scene.create();
+        float x = unit(random), y = unit(random), z = unit(random), w = unit(random);
+        float length = std::sqrt(x * x + y * y + z * z + w * w);
+        scene.setLocalTransform(group, glm::vec3(spread(random), spread(random), spread(random) + 500.0f),
+                                glm::quat(w / length, x / length, y / length, z / length), scale(random));
+        groups.push_back(group);
+        for (uint32_t j = 0; j < childCount; ++j) {
+            uint32_t object = scene.create(group);
+            scene.setLocalPosition(object, glm::vec3(spread(random), spread(random), spread(random)) * 0.1f);
+            // Every 16th only a transform node
+            if (j % 16 != 0) {
+                scene.setBounds(object, glm::vec3(unit(random), unit(random), unit(random)), scale(random));
+            }
+        }
+    }
+}
+
+void moveGroups(Scene &scene, const std::vector<uint32_t> &groups) {
+    for (size_t i = 0; i < groups.size(); i += 7) {
+        scene.setLocalPosition(groups[i], glm::vec3(float(i), -float(i), 300.0f + float(i)));
+    }
+}
+
+void testIncrementalUpdate() {
+    Scene incremental;
+    std::vector<uint32_t> groups;
+    buildScene(incremental, groups);
+    CHECK(incremental.updateTransforms() == incremental.size());
+    moveGroups(incremental, groups);
+    size_t moved = (groups.size() + 6) / 7;
+    CHECK(incremental.updateTransforms() == moved * (incremental.size() / groups.size()));
+
+    // The same edits, but all before the first update
+    Scene full;
+    std::vector<uint32_t> fullGroups;
+    buildScene(full, fullGroups);
+    moveGroups(full, fullGroups);
+    full.updateTransforms();
+    size_t mismatches = 0;
+    for (uint32_t i = 0; i < full.size(); ++i) {
+        if (!near(incremental.worldBounds(i), full.worldBounds(i)) ||
+            !near(incremental.worldMatrix(i)[3], full.worldMatrix(i)[3])) {
+            ++mismatches;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+void testCull() {
+    Scene scene;
+    std::vector<uint32_t> groups;
+    buildScene(scene, groups);
+    scene.updateTransforms();
+
+    // 90 degree perspective looking down +z, Vulkan depth 0..1
+    const float nearZ = 0.1f, farZ = 1000.0f;
+    glm::mat4 viewProjection(0.0f);
+    viewProjection[0][0] = 1.0f;
+    viewProjection[1][1] = 1.0f;
+    viewProjection[2][2] = farZ / (farZ - nearZ);
+    viewProjection[2][3] = 1.0f;
+    viewProjection[3][2] = -farZ * nearZ / (farZ - nearZ);
+
+    ThreadPool threadPool;
+    std::vector<uint32_t> visible;
+    scene.cull(viewProjection, threadPool, visible);
+
+    // Spheres within rounding of a plane may come out either way, depending on how the compiler fused the math
+    Frustum frustum = Frustum::fromViewProjection(viewProjection);
+    auto margin = [&frustum, &scene](uint32_t object) {
+        glm::vec4 sphere = scene.worldBounds(object);
+        float closest = INFINITY;
+        for (const auto &plane : frustum.planes) {
+            closest = std::min(closest, plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w +
+                                        sphere.w);
+        }
+        return closest;
+    };
+    const float edge = 1e-3f;
+    size_t wrong = 0;
+    size_t next = 0;
+    size_t expected = 0;
+    for (uint32_t i = 0; i < scene.size(); ++i) {
+        float distance = margin(i);
+        bool inside = next < visible.size() && visible[next] == i;
+        if (inside) {
+            ++next;
+        }
+        if (distance >= 0.0f) {
+            ++expected;
+        }
+        if ((inside && distance < -edge) || (!inside && distance >= edge)) {
+            ++wrong;
+        }
+    }
+    // Every id was matched in order, so the list is sorted and has no duplicates or strays
+    CHECK(next == visible.size());
+    CHECK(wrong == 0);
+    // Not a trivial frustum that takes everything or nothing
+    CHECK(expected > 0 && expected < scene.size());
+
+    // Reuses its chunk lists, the result must not change
+    std::vector<uint32_t> again;
+    scene.cull(viewProjection, threadPool, again);
+    CHECK(again == visible);
+}
+
+}
+
+int main() {
+    testHierarchy();
+    testIncrementalUpdate();
+    testCull();
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All scene checks passed\n");
+    return EXIT_SUCCESS;
+}
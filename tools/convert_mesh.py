@@ -0,0 +1,234 @@
+import argparse
+import math
+import struct
+
+# Mesh file layout, must match src/mesh_file.hpp
+# header | stream table | vertex streams | indices | meshlet table | meshlet vertices | meshlet triangles
+MESH_MAGIC = 0x48534d4b  # "KMSH"
+MESH_VERSION = 1
+MESH_ALIGNMENT = 64
+MAX_MESHLET_VERTICES = 64
+MAX_MESHLET_TRIANGLES = 124
+# magic, version, vertex count, index count, stream count, meshlet count, stream table offset, vertex data offset,
+# vertex data size, index offset, meshlet data offset, meshlet data size, meshlet vertices offset,
+# meshlet triangles offset, bounds min, bounds max, sphere center, sphere radius, file size
+HEADER_FORMAT = "<6I8Q3f3f3ffQ"
+STREAM_FORMAT = "<4IQQ"  # semantic, format, stride, reserved, offset, size
+MESHLET_FORMAT = "<3ff3ff4I"  # center, radius, cone axis, cone cutoff, vertex/triangle offset, vertex/triangle count
+
+# MeshSemantic, which is also the vertex attribute location
+SEMANTIC_POSITION = 0
+SEMANTIC_COLOR = 1
+SEMANTIC_NORMAL = 2
+SEMANTIC_TEXCOORD = 3
+# VkFormat
+FORMAT_R32G32_SFLOAT = 103
+FORMAT_R32G32B32_SFLOAT = 106
+
+
+def align(offset):
+    return (offset + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1)
+
+
+def read_obj(filename):
+    # Positions may carry a vertex color ("v x y z r g b"), faces with more than three corners are fanned out
+    positions, colors, normals, texcoords = [], [], [], []
+    corners = []
+    with open(filename) as obj_file:
+        for line in obj_file:
+            parts = line.split()
+            if not parts:
+                continue
+            if parts[0] == "v":
+                positions.append(tuple(float(value) for value in parts[1:4]))
+                colors.append(tuple(float(value) for value in parts[4:7]) if len(parts) >= 7 else None)
+            elif parts[0] == "vn":
+                normals.append(tuple(float(value) for value in parts[1:4]))
+            elif parts[0] == "vt":
+                texcoords.append((float(parts[1]), float(parts[2]) if len(parts) > 2 else 0.0))
+            elif parts[0] == "f":
+                face = []
+                for corner in parts[1:]:
+                    # v, v/vt, v//vn or v/vt/vn, negative indices count from the end
+                    fields = corner.split("/")
+                    lists = (positions, texcoords, normals)
+                    face.append(tuple(
+                        (int(field) - 1 if int(field) > 0 else len(lists[i]) + int(field)) if field else -1
+                        for i, field in enumerate(fields + [""] * (3 - len(fields)))))
+                for i in range(1, len(face) - 1):
+                    corners += [face[0], face[i], face[i + 1]]
+    return positions, colors, normals, texcoords, corners
+
+
+def build_vertices(obj, flip_winding):
+    positions, colors, normals, texcoords, corners = obj
+    if flip_winding:
+        for i in range(0, len(corners), 3):
+            corners[i + 1], corners[i + 2] = corners[i + 2], corners[i + 1]
+    has_normals = any(corner[2] >= 0 for corner in corners)
+    has_texcoords = any(corner[1] >= 0 for corner in corners)
+    streams = {SEMANTIC_POSITION: [], SEMANTIC_COLOR: []}
+    if has_normals:
+        streams[SEMANTIC_NORMAL] = []
+    if has_texcoords:
+        streams[SEMANTIC_TEXCOORD] = []
+
+    # One vertex per distinct position/texcoord/normal combination
+    vertex_ids = {}
+    indices = []
+    for corner in corners:
+        if corner not in vertex_ids:
+            vertex_ids[corner] = len(vertex_ids)
+            position_index, texcoord_index, normal_index = corner
+            streams[SEMANTIC_POSITION].append(positions[position_index])
+            streams[SEMANTIC_COLOR].append(colors[position_index] or (1.0, 1.0, 1.0))
+            if has_normals:
+                streams[SEMANTIC_NORMAL].append(normals[normal_index] if normal_index >= 0 else (0.0, 0.0, 1.0))
+            if has_texcoords:
+                streams[SEMANTIC_TEXCOORD].append(texcoords[texcoord_index] if texcoord_index >= 0 else (0.0, 0.0))
+        indices.append(vertex_ids[corner])
+    return streams, indices
+
+
+def subtract(a, b):
+    return a[0] - b[0], a[1] - b[1], a[2] - b[2]
+
+
+def dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+
+def normalize(v):
+    length = math.sqrt(dot(v, v))
+    return (v[0] / length, v[1] / length, v[2] / length) if length > 0 else (0.0, 0.0, 0.0)
+
+
+def bounding_sphere(points):
+    low = [min(point[axis] for point in points) for axis in range(3)]
+    high = [max(point[axis] for point in points) for axis in range(3)]
+    center = tuple((low[axis] + high[axis]) * 0.5 for axis in range(3))
+    radius = max(math.sqrt(dot(subtract(point, center), subtract(point, center))) for point in points)
+    return low, high, center, radius
+
+
+def build_meshlets(positions, indices, max_vertices, max_triangles):
+    # Greedy, in index order: a meshlet is closed once the next triangle doesn't fit
+    meshlets, meshlet_vertices, meshlet_triangles = [], [], []
+    local = {}
+    triangles = []
+
+    def close():
+        if not triangles:
+            return
+        points = [positions[vertex] for vertex in local]
+        _, _, center, radius = bounding_sphere(points)
+        face_normals = []
+        for triangle in triangles:
+            a, b, c = (positions[vertex] for vertex in triangle)
+            e0, e1 = subtract(b, a), subtract(c, a)
+            face_normals.append(normalize((e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2],
+                                           e0[0] * e1[1] - e0[1] * e1[0])))
+        # Degenerate triangles face nowhere and don't narrow the cone
+        face_normals = [normal for normal in face_normals if normal != (0.0, 0.0, 0.0)] or [(0.0, 0.0, 0.0)]
+        axis = normalize(tuple(sum(normal[i] for normal in face_normals) for i in range(3)))
+        cutoff = min(dot(axis, normal) for normal in face_normals)
+        if axis == (0.0, 0.0, 0.0) or cutoff <= 0.0:
+            cutoff = -1.0
+        meshlets.append(center + (radius,) + axis + (cutoff, len(meshlet_vertices), len(meshlet_triangles) // 3,
+                                                     len(local), len(triangles)))
+        meshlet_vertices.extend(local)
+        for triangle in triangles:
+            meshlet_triangles.extend(local[vertex] for vertex in triangle)
+        local.clear()
+        triangles.clear()
+
+    for i in range(0, len(indices), 3):
+        triangle = indices[i:i + 3]
+        new_vertices = len(set(vertex for vertex in triangle if vertex not in local))
+        if len(local) + new_vertices > max_vertices or len(triangles) + 1 > max_triangles:
+            close()
+        for vertex in triangle:
+            if vertex not in local:
+                local[vertex] = len(local)
+        triangles.append(triangle)
+    close()
+    return meshlets, meshlet_vertices, meshlet_triangles
+
+
+def write_mesh_file(filename, streams, indices, meshlets, meshlet_vertices, meshlet_triangles):
+    vertex_count = len(streams[SEMANTIC_POSITION])
+    header_size = struct.calcsize(HEADER_FORMAT)
+    stream_size = struct.calcsize(STREAM_FORMAT)
+
+    # Each stream starts on an aligned offset, the whole vertex section is still one range
+    vertex_data_offset = align(header_size + len(streams) * stream_size)
+    vertex_data = b""
+    stream_table = b""
+    for semantic in sorted(streams):
+        values = streams[semantic]
+        components = len(values[0]) if values else 3
+        vk_format = FORMAT_R32G32_SFLOAT if components == 2 else FORMAT_R32G32B32_SFLOAT
+        data = struct.pack("<{}f".format(components * len(values)), *(c for value in values for c in value))
+        vertex_data += b"\0" * (align(len(vertex_data)) - len(vertex_data))
+        stream_table += struct.pack(STREAM_FORMAT, semantic, vk_format, components * 4, 0,
+                                    vertex_data_offset + len(vertex_data), len(data))
+        vertex_data += data
+
+    index_offset = align(vertex_data_offset + len(vertex_data))
+    index_data = struct.pack("<{}I".format(len(indices)), *indices)
+
+    meshlet_data_offset = align(index_offset + len(index_data))
+    meshlet_table = b"".join(struct.pack(MESHLET_FORMAT, *meshlet) for meshlet in meshlets)
+    meshlet_vertices_offset = meshlet_data_offset + len(meshlet_table)
+    vertices_data = struct.pack("<{}I".format(len(meshlet_vertices)), *meshlet_vertices)
+    meshlet_triangles_offset = meshlet_vertices_offset + len(vertices_data)
+    triangles_data = bytes(meshlet_triangles)
+    # Buffer copies want a size that is a multiple of 4
+    triangles_data += b"\0" * (-len(triangles_data) % 4)
+    meshlet_data = meshlet_table + vertices_data + triangles_data
+
+    low, high, center, radius = bounding_sphere(streams[SEMANTIC_POSITION])
+    file_size = meshlet_data_offset + len(meshlet_data)
+    with open(filename, "wb") as mesh_file:
+        mesh_file.write(struct.pack(HEADER_FORMAT, MESH_MAGIC, MESH_VERSION, vertex_count, len(indices), len(streams),
+                                    len(meshlets), header_size, vertex_data_offset, len(vertex_data), index_offset,
+                                    meshlet_data_offset, len(meshlet_data), meshlet_vertices_offset,
+                                    meshlet_triangles_offset, *low, *high, *center, radius, file_size))
+        mesh_file.write(stream_table)
+        mesh_file.write(b"\0" * (vertex_data_offset - header_size - len(stream_table)))
+        mesh_file.write(vertex_data)
+        mesh_file.write(b"\0" * (index_offset - vertex_data_offset - len(vertex_data)))
+        mesh_file.write(index_data)
+        mesh_file.write(b"\0" * (meshlet_data_offset - index_offset - len(index_data)))
+        mesh_file.write(meshlet_data)
+    print("Wrote {} vertices, {} indices and {} meshlets to {} ({} bytes)".format(
+        vertex_count, len(indices), len(meshlets), filename, file_size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Converts an OBJ file into a mesh file for MeshFile::open")
+    parser.add_argument("input", help="OBJ file")
+    parser.add_argument("output", help="mesh file to write")
+    parser.add_argument("--no-meshlets", action="store_true", help="leave the meshlet sections empty")
+    parser.add_argument("--max-vertices", type=int, default=MAX_MESHLET_VERTICES)
+    parser.add_argument("--max-triangles", type=int, default=MAX_MESHLET_TRIANGLES)
+    parser.add_argument("--flip-winding", action="store_true",
+                        help="swap the triangle winding, for meshes whose faces come out culled")
+    args = parser.parse_args()
+    if not 3 <= args.max_vertices <= MAX_MESHLET_VERTICES or not 1 <= args.max_triangles <= MAX_MESHLET_TRIANGLES:
+        parser.error("meshlets hold at most {} vertices and {} triangles".format(MAX_MESHLET_VERTICES,
+                                                                               MAX_MESHLET_TRIANGLES))
+
+    print("Converting mesh: {}".format(args.input))
+    streams, indices = build_vertices(read_obj(args.input), args.flip_winding)
+    if not indices:
+        parser.error("{} has no faces".format(args.input))
+    meshlets, meshlet_vertices, meshlet_triangles = [], [], []
+    if not args.no_meshlets:
+        meshlets, meshlet_vertices, meshlet_triangles = build_meshlets(
+            streams[SEMANTIC_POSITION], indices, args.max_vertices, args.max_triangles)
+    write_mesh_file(args.output, streams, indices, meshlets, meshlet_vertices, meshlet_triangles)
+
+
+if __name__ == "__main__":
+    main()